@@ -0,0 +1,115 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Sliding window activity fraction, see activity.h.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "activity.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * This function prepares "a" for a window of "window" milliseconds, rounded
+ * up to whole seconds.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int activity_init(struct activity *a, uint64_t window) {
+  memset(a, 0, sizeof(*a));
+  a->seconds = (size_t)((window + 999) / 1000);
+  if (a->seconds == 0)
+    a->seconds = 1;
+
+  a->bits = calloc((a->seconds + 63) / 64, sizeof(*a->bits));
+  if (a->bits == NULL) {
+    fprintf(stderr, "couldn't allocate activity window\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+/* This function sets the bit of second "s" of "a" to "on". */
+static void set_second(struct activity *a, uint64_t s, int on) {
+  size_t i = (size_t)(s % a->seconds);
+  uint64_t mask = (uint64_t)1 << (i % 64);
+  uint64_t *word = &a->bits[i / 64];
+
+  if (a->filled == a->seconds)
+    a->active -= (*word & mask) != 0;
+  else
+    a->filled++;
+  if (on) {
+    *word |= mask;
+    a->active++;
+  } else {
+    *word &= ~mask;
+  }
+}
+
+/*
+ * This function records the sample "idle" taken at "now" (both in
+ * milliseconds) in "a", filling in the seconds since the previous sample as
+ * active where the idle time was below "threshold".
+ */
+void activity_sample(struct activity *a, uint64_t now, uint64_t idle,
+                     uint64_t threshold) {
+  uint64_t second = now / 1000, input = idle < now ? now - idle : 0;
+  uint64_t s;
+
+  /* seconds which have left the window anyway */
+  if (a->second && second > a->second + a->seconds)
+    a->second = second - a->seconds;
+
+  for (s = a->second + 1; a->second && s <= second; s++) {
+    uint64_t start = s * 1000;
+    uint64_t from = start >= input ? input : a->last_input;
+
+    set_second(a, s, start - from < threshold);
+  }
+
+  /* the first sample only starts the window; after the wall clock was set
+   * back, nothing is filled in until it passes the last second again */
+  if (second > a->second)
+    a->second = second;
+  a->last_input = input;
+}
+
+/*
+ * This function writes the active fraction "permille" (see activity_permille())
+ * as a decimal with three places (e.g. "0.734") to "buf", which must hold at
+ * least ACTIVITY_STR_MAX characters, or the JSON "null" while it isn't known
+ * yet. The number of characters written is returned.
+ */
+size_t activity_format(char *buf, int permille) {
+  if (permille < 0) {
+    memcpy(buf, "null", 4);
+    return 4;
+  }
+
+  buf[0] = (char)('0' + permille / 1000);
+  buf[1] = '.';
+  buf[2] = (char)('0' + permille / 100 % 10);
+  buf[3] = (char)('0' + permille / 10 % 10);
+  buf[4] = (char)('0' + permille % 10);
+  return 5;
+}
+
+void activity_free(struct activity *a) {
+  free(a->bits);
+  a->bits = NULL;
+}
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Fraction of a sliding window (e.g. the last 10 minutes) in which the user
+ * was active, i.e. below the idle threshold. Every second of the window is a
+ * bit in a ring, and the number of set bits is kept along, so the fraction is
+ * available at any time without looking at the ring. A sample fills in the
+ * seconds since the previous one from the idle times of both, which costs one
+ * bit per second passed; the memory is one bit per second of the window.
+ *
+ * A second counts as active if the time since the last input known at its
+ * start is below the threshold. Inputs between two samples other than the
+ * latest one aren't seen, so the fraction errs towards idle by at most the
+ * sampling interval per idle period.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_ACTIVITY_H
+#define XPRINTIDLE_ACTIVITY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Maximum number of characters activity_format() writes. */
+#define ACTIVITY_STR_MAX 5
+
+struct activity {
+  uint64_t *bits;
+  /* length of the window in seconds */
+  size_t seconds;
+  /* number of active seconds in the window, and of seconds filled in (up to
+   * "seconds") */
+  size_t active, filled;
+  /* last second filled in and time of the last input as of the last sample,
+   * in milliseconds; "second" is 0 before the first sample */
+  uint64_t second;
+  uint64_t last_input;
+};
+
+int activity_init(struct activity *a, uint64_t window);
+void activity_sample(struct activity *a, uint64_t now, uint64_t idle,
+                     uint64_t threshold);
+size_t activity_format(char *buf, int permille);
+void activity_free(struct activity *a);
+
+/* This function returns the active fraction of the window of "a" in
+ * thousandths; while the window isn't filled yet, of the part filled, and -1
+ * while no second is filled in, i.e. while it isn't known yet. */
+static inline int activity_permille(const struct activity *a) {
+  if (a->filled == 0)
+    return -1;
+  return (int)((a->active * 1000 + a->filled / 2) / a->filled);
+}
+
+#endif /* XPRINTIDLE_ACTIVITY_H */
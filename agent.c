@@ -0,0 +1,229 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Agent side of the collector stream. The connection is non-blocking, so a
+ * slow or unreachable collector never delays sampling: samples which don't
+ * fit into the send buffer are dropped, and after an error the agent
+ * reconnects at the latest AGENT_RETRY_INTERVAL milliseconds later, starting
+ * the stream over with its session frames.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "agent.h"
+#include "collector.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+static void put16(unsigned char *p, uint16_t v) {
+  p[0] = (unsigned char)v;
+  p[1] = (unsigned char)(v >> 8);
+}
+
+static void put32(unsigned char *p, uint32_t v) {
+  put16(p, (uint16_t)v);
+  put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void put64(unsigned char *p, uint64_t v) {
+  put32(p, (uint32_t)v);
+  put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint64_t monotonic_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void disconnect(struct agent *a) {
+  close(a->fd);
+  a->fd = -1;
+  a->len = 0;
+  a->retry_at = monotonic_ms() + AGENT_RETRY_INTERVAL;
+}
+
+/*
+ * This function starts connecting "a" to the collector and queues the start
+ * of the stream: the magic and a session frame per display, named
+ * "HOST DISPLAY".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int start(struct agent *a) {
+  struct addrinfo hints, *res, *ai;
+  char host[256];
+  size_t i, host_len;
+  int err;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  err = getaddrinfo(a->host, a->port, &hints, &res);
+  if (err) {
+    fprintf(stderr, "couldn't resolve collector '%s': %s\n", a->host,
+            gai_strerror(err));
+    return -1;
+  }
+
+  for (ai = res; ai; ai = ai->ai_next) {
+    a->fd = socket(ai->ai_family,
+                   ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                   ai->ai_protocol);
+    if (a->fd < 0)
+      continue;
+    if (connect(a->fd, ai->ai_addr, ai->ai_addrlen) == 0 ||
+        errno == EINPROGRESS)
+      break;
+    close(a->fd);
+    a->fd = -1;
+  }
+  freeaddrinfo(res);
+  if (a->fd < 0)
+    return -1;
+
+  if (gethostname(host, sizeof(host)) < 0)
+    strcpy(host, "localhost");
+  host[sizeof(host) - 1] = '\0';
+  host_len = strlen(host);
+
+  memcpy(a->buf, COLLECTOR_MAGIC, COLLECTOR_MAGIC_SIZE);
+  a->len = COLLECTOR_MAGIC_SIZE;
+  for (i = 0; i < a->n; i++) {
+    size_t name_len = host_len + 1 + strlen(a->names[i]);
+    unsigned char *p = a->buf + a->len;
+
+    if (name_len > COLLECTOR_NAME_MAX)
+      name_len = COLLECTOR_NAME_MAX;
+    if (a->len + COLLECTOR_FRAME_HEADER_SIZE + 4 + name_len > AGENT_BUF_SIZE) {
+      fprintf(stderr, "too many displays for the collector\n");
+      disconnect(a);
+      return -1;
+    }
+
+    p[0] = COLLECTOR_FRAME_SESSION;
+    p[1] = 0;
+    put16(p + 2, (uint16_t)(4 + name_len));
+    put32(p + 4, (uint32_t)i);
+    p += COLLECTOR_FRAME_HEADER_SIZE + 4;
+    memcpy(p, host, host_len);
+    p[host_len] = ' ';
+    memcpy(p + host_len + 1, a->names[i], name_len - host_len - 1);
+    a->len += COLLECTOR_FRAME_HEADER_SIZE + 4 + name_len;
+  }
+
+  return 0;
+}
+
+/*
+ * This function prepares "a" to send the samples of the displays "names" to
+ * the collector at "addr" ("HOST:PORT" or "HOST", "[ADDRESS]:PORT" for IPv6).
+ * The connection is established lazily.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int agent_open(struct agent *a, const char *addr, const char **names,
+               size_t n) {
+  a->buf_addr = strdup(addr);
+  if (a->buf_addr == NULL) {
+    fprintf(stderr, "couldn't allocate collector address\n");
+    return -1;
+  }
+
+  a->host = collector_split_address(a->buf_addr, &a->port);
+  if (a->host == NULL) {
+    fprintf(stderr, "invalid collector address '%s'\n", addr);
+    free(a->buf_addr);
+    return -1;
+  }
+
+  a->names = names;
+  a->n = n;
+  a->fd = -1;
+  a->len = 0;
+  a->retry_at = 0;
+  return 0;
+}
+
+/*
+ * This function queues a sample of "session" (the index of the display) for
+ * the collector. While the collector isn't reachable or the buffer is full
+ * the sample is dropped.
+ */
+void agent_sample(struct agent *a, size_t session, uint64_t time,
+                  uint64_t idle) {
+  unsigned char *p = a->buf + a->len;
+
+  if (a->fd < 0) {
+    if (monotonic_ms() < a->retry_at)
+      return;
+    if (start(a) < 0) {
+      a->retry_at = monotonic_ms() + AGENT_RETRY_INTERVAL;
+      return;
+    }
+    p = a->buf + a->len;
+  }
+  if (a->len + COLLECTOR_SAMPLE_SIZE > AGENT_BUF_SIZE)
+    return;
+
+  p[0] = COLLECTOR_FRAME_SAMPLE;
+  p[1] = 0;
+  put16(p + 2, COLLECTOR_SAMPLE_SIZE - COLLECTOR_FRAME_HEADER_SIZE);
+  put32(p + 4, (uint32_t)session);
+  put64(p + 8, time);
+  put64(p + 16, idle);
+  a->len += COLLECTOR_SAMPLE_SIZE;
+}
+
+/*
+ * This function sends as much of the queued stream of "a" as the socket
+ * takes without blocking.
+ */
+void agent_flush(struct agent *a) {
+  size_t off = 0;
+
+  while (a->fd >= 0 && off < a->len) {
+    ssize_t ret = send(a->fd, a->buf + off, a->len - off,
+                       MSG_NOSIGNAL | MSG_DONTWAIT);
+
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        disconnect(a);
+      break;
+    }
+    off += (size_t)ret;
+  }
+
+  if (a->fd >= 0 && off) {
+    memmove(a->buf, a->buf + off, a->len - off);
+    a->len -= off;
+  }
+}
+
+void agent_close(struct agent *a) {
+  if (a->fd >= 0)
+    close(a->fd);
+  free(a->buf_addr);
+}
@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Agent side of the collector stream (see collector.h): sends the samples of
+ * the watch mode to xprintidle-collector over TCP.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_AGENT_H
+#define XPRINTIDLE_AGENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Size of the send buffer; samples that don't fit are dropped. */
+#define AGENT_BUF_SIZE 8192
+
+/* Milliseconds to wait before reconnecting after an error. */
+#define AGENT_RETRY_INTERVAL 5000
+
+struct agent {
+  char *buf_addr;
+  const char *host;
+  const char *port;
+  int fd;
+  uint64_t retry_at;
+  const char **names;
+  size_t n;
+  size_t len;
+  unsigned char buf[AGENT_BUF_SIZE];
+};
+
+#ifdef XPRINTIDLE_NO_SEND
+
+/* Built without the "send" feature, --send isn't accepted. */
+static inline int agent_open(struct agent *a, const char *addr,
+                             const char **names, size_t n) {
+  (void)a;
+  (void)addr;
+  (void)names;
+  (void)n;
+  return -1;
+}
+static inline void agent_sample(struct agent *a, size_t session,
+                                uint64_t time, uint64_t idle) {
+  (void)a;
+  (void)session;
+  (void)time;
+  (void)idle;
+}
+static inline void agent_flush(struct agent *a) { (void)a; }
+static inline void agent_close(struct agent *a) { (void)a; }
+
+#else
+
+int agent_open(struct agent *a, const char *addr, const char **names,
+               size_t n);
+void agent_sample(struct agent *a, size_t session, uint64_t time,
+                  uint64_t idle);
+void agent_flush(struct agent *a);
+void agent_close(struct agent *a);
+
+#endif /* XPRINTIDLE_NO_SEND */
+
+#endif /* XPRINTIDLE_AGENT_H */
@@ -0,0 +1,309 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Active time per application, see apps.h.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "apps.h"
+
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t monotonic_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/* Windows vanish at any time, so errors about them are expected. */
+static int ignore_error(Display *dpy, XErrorEvent *ev) {
+  (void)dpy;
+  (void)ev;
+  return 0;
+}
+
+/*
+ * This function looks up the application "name" in "t" and adds it if it's
+ * unknown.
+ * On success the index of the application is returned.
+ * On error -1 is returned.
+ */
+static long intern(struct app_table *t, const char *name) {
+  size_t len = strnlen(name, APPS_NAME_MAX), n = t->names.n;
+  long app = names_find(&t->names, name, len);
+
+  if (app >= 0)
+    return app;
+  if (names_reserve(&t->names, len) < 0)
+    return -1;
+
+  if (n == t->cap) {
+    size_t cap = t->cap ? t->cap * 2 : 32;
+    uint64_t *active = realloc(t->active, cap * sizeof(*active));
+    char(*title)[APPS_TITLE_MAX + 1] =
+        active ? realloc(t->title, cap * sizeof(*title)) : NULL;
+
+    if (active)
+      t->active = active;
+    if (title == NULL) {
+      fprintf(stderr, "couldn't allocate applications\n");
+      return -1;
+    }
+    t->title = title;
+    t->cap = cap;
+  }
+
+  t->active[n] = 0;
+  t->title[n][0] = '\0';
+  return (long)names_add(&t->names, name, len);
+}
+
+void app_table_free(struct app_table *t) {
+  names_free(&t->names);
+  free(t->active);
+  free(t->title);
+  memset(t, 0, sizeof(*t));
+}
+
+/*
+ * This function adds the time since the last call to the application of the
+ * active window of "at", as far as the user didn't count as idle.
+ */
+static void account(struct app_tracker *at, uint64_t now) {
+  uint64_t end = at->last_input + at->threshold;
+
+  if (end > now)
+    end = now;
+  if (at->app >= 0 && end > at->since)
+    at->table->active[at->app] += end - at->since;
+  at->since = now;
+}
+
+/* This function returns the active window of "at", None if there is none. */
+static Window get_active_window(struct app_tracker *at) {
+  unsigned long n, after;
+  unsigned char *data = NULL;
+  Window w = None;
+  Atom type;
+  int format;
+
+  if (XGetWindowProperty(at->dpy, at->root, at->net_active_window, 0, 1, False,
+                         XA_WINDOW, &type, &format, &n, &after,
+                         &data) == Success &&
+      type == XA_WINDOW && format == 32 && n == 1)
+    w = ((unsigned long *)data)[0];
+  if (data)
+    XFree(data);
+
+  return w == at->root ? None : w;
+}
+
+/* This function reads the class of the active window of "at". */
+static void read_class(struct app_tracker *at) {
+  XClassHint hint = {NULL, NULL};
+
+  at->app = -1;
+  if (at->table == NULL || at->active == None ||
+      !XGetClassHint(at->dpy, at->active, &hint))
+    return;
+  if (hint.res_class && *hint.res_class)
+    at->app = intern(at->table, hint.res_class);
+  else if (hint.res_name && *hint.res_name)
+    at->app = intern(at->table, hint.res_name);
+  XFree(hint.res_name);
+  XFree(hint.res_class);
+}
+
+/*
+ * This function reads the title of the active window of "at" into the title
+ * of its application, truncated to APPS_TITLE_MAX bytes of whole UTF-8
+ * characters.
+ */
+static void read_title(struct app_tracker *at) {
+  unsigned long n, after;
+  unsigned char *data = NULL;
+  Atom type;
+  int format;
+  char *title;
+
+  if (at->app < 0)
+    return;
+  title = at->table->title[at->app];
+  if (XGetWindowProperty(at->dpy, at->active, at->net_wm_name, 0,
+                         (APPS_TITLE_MAX + 4) / 4, False, at->utf8_string,
+                         &type, &format, &n, &after, &data) == Success &&
+      type == at->utf8_string && format == 8) {
+    if (n > APPS_TITLE_MAX) {
+      n = APPS_TITLE_MAX;
+      while (n && (data[n] & 0xc0) == 0x80)
+        n--;
+    }
+    memcpy(title, data, n);
+    title[n] = '\0';
+  }
+  if (data)
+    XFree(data);
+}
+
+/* This function reads whether the active window of "at" is fullscreen. */
+static void read_state(struct app_tracker *at) {
+  unsigned long n, after, i;
+  unsigned char *data = NULL;
+  Atom type;
+  int format;
+
+  at->fullscreen = 0;
+  if (at->active != None &&
+      XGetWindowProperty(at->dpy, at->active, at->net_wm_state, 0, 64, False,
+                         XA_ATOM, &type, &format, &n, &after,
+                         &data) == Success &&
+      type == XA_ATOM && format == 32) {
+    for (i = 0; i < n; i++) {
+      if (((Atom *)data)[i] == at->net_wm_state_fullscreen)
+        at->fullscreen = 1;
+    }
+  }
+  if (data)
+    XFree(data);
+}
+
+/*
+ * This function makes "w" the active window of "at", accounting the time up
+ * to now to the previous one, and follows the changes of its class, title and
+ * state from now on.
+ */
+static void set_active(struct app_tracker *at, Window w) {
+  XErrorHandler old;
+
+  account(at, monotonic_ms());
+  if (w == at->active)
+    return;
+
+  /* the replies of the property requests flush out errors of the windows */
+  old = XSetErrorHandler(ignore_error);
+  if (at->active != None)
+    XSelectInput(at->dpy, at->active, NoEventMask);
+  at->active = w;
+  if (w != None)
+    XSelectInput(at->dpy, w, PropertyChangeMask);
+  read_class(at);
+  read_title(at);
+  read_state(at);
+  XSync(at->dpy, False);
+  XSetErrorHandler(old);
+}
+
+/*
+ * This function starts following the active window of the display "dpy" for
+ * the applications of "t", with the user counting as idle from "threshold"
+ * milliseconds on. If "t" is NULL, only whether the active window is
+ * fullscreen is followed.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int app_tracker_open(struct app_tracker *at, Display *dpy, struct app_table *t,
+                     uint64_t threshold) {
+  char *names[] = {"_NET_ACTIVE_WINDOW", "_NET_WM_NAME", "UTF8_STRING",
+                   "_NET_WM_STATE", "_NET_WM_STATE_FULLSCREEN"};
+  Atom atoms[5];
+
+  if (!XInternAtoms(dpy, names, 5, False, atoms)) {
+    fprintf(stderr, "couldn't intern the window manager atoms\n");
+    return -1;
+  }
+
+  at->dpy = dpy;
+  at->root = DefaultRootWindow(dpy);
+  at->table = t;
+  at->net_active_window = atoms[0];
+  at->net_wm_name = atoms[1];
+  at->utf8_string = atoms[2];
+  at->net_wm_state = atoms[3];
+  at->net_wm_state_fullscreen = atoms[4];
+  at->active = None;
+  at->fullscreen = 0;
+  at->app = -1;
+  at->threshold = threshold;
+  at->since = monotonic_ms();
+  at->last_input = 0;
+
+  XSelectInput(dpy, at->root, PropertyChangeMask);
+  set_active(at, get_active_window(at));
+  return 0;
+}
+
+/*
+ * This function handles the events of the display of "at" which have arrived
+ * so far, without blocking.
+ */
+void app_tracker_handle(struct app_tracker *at) {
+  while (XPending(at->dpy)) {
+    XEvent ev;
+    XErrorHandler old;
+
+    XNextEvent(at->dpy, &ev);
+    if (ev.type != PropertyNotify)
+      continue;
+
+    if (ev.xproperty.window == at->root) {
+      if (ev.xproperty.atom == at->net_active_window)
+        set_active(at, get_active_window(at));
+    } else if (ev.xproperty.window == at->active &&
+               ev.xproperty.atom == at->net_wm_state) {
+      old = XSetErrorHandler(ignore_error);
+      read_state(at);
+      XSetErrorHandler(old);
+    } else if (ev.xproperty.window == at->active &&
+               (ev.xproperty.atom == XA_WM_CLASS ||
+                ev.xproperty.atom == at->net_wm_name)) {
+      account(at, monotonic_ms());
+      old = XSetErrorHandler(ignore_error);
+      if (ev.xproperty.atom == XA_WM_CLASS)
+        read_class(at);
+      read_title(at);
+      XSetErrorHandler(old);
+    }
+  }
+}
+
+/*
+ * This function accounts the time up to now with the idle time "idle" just
+ * sampled on the display of "at".
+ */
+void app_tracker_sample(struct app_tracker *at, uint64_t idle) {
+  uint64_t now = monotonic_ms();
+
+  at->last_input = idle < now ? now - idle : 0;
+  account(at, now);
+}
+
+/* This function accounts the time up to now and stops following windows. */
+void app_tracker_close(struct app_tracker *at) {
+  XErrorHandler old = XSetErrorHandler(ignore_error);
+
+  account(at, monotonic_ms());
+  XSelectInput(at->dpy, at->root, NoEventMask);
+  if (at->active != None)
+    XSelectInput(at->dpy, at->active, NoEventMask);
+  XSync(at->dpy, True);
+  XSetErrorHandler(old);
+}
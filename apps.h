@@ -0,0 +1,119 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Active time per application for the watch mode (--apps). The active window
+ * of every display is followed through PropertyNotify events: on the root
+ * window for _NET_ACTIVE_WINDOW, and on the active window itself for WM_CLASS
+ * and _NET_WM_NAME. No polling is involved; the events are read when the
+ * connection of the display becomes readable.
+ *
+ * Applications are identified by the class of their windows, interned (see
+ * names.h) with columns holding the active time and the latest title. The
+ * time between two samples or events is added to the application of the
+ * active window as long as the user doesn't count as idle, i.e. up to
+ * "threshold" milliseconds after the last input.
+ * Time without an active window or with a window without class isn't
+ * accounted.
+ *
+ * The tracker also keeps whether the active window is fullscreen
+ * (_NET_WM_STATE_FULLSCREEN in its _NET_WM_STATE), updated from the same
+ * events, so the watch mode can report it with every sample (--fullscreen)
+ * without any requests of its own. Without a table, only this flag is kept.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_APPS_H
+#define XPRINTIDLE_APPS_H
+
+#include "names.h"
+
+#include <X11/Xlib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Longest class name kept, longer ones are truncated. */
+#define APPS_NAME_MAX 255
+
+/* Longest title kept in bytes, longer ones are truncated. */
+#define APPS_TITLE_MAX 255
+
+/* The applications seen so far. */
+struct app_table {
+  /* the class names; "names.n" is the number of applications */
+  struct names names;
+  size_t cap;
+  /* active time in milliseconds */
+  uint64_t *active;
+  /* latest title of the active window of the application */
+  char (*title)[APPS_TITLE_MAX + 1];
+};
+
+/* The active window of one display. */
+struct app_tracker {
+  Display *dpy;
+  Window root;
+  struct app_table *table;
+  Atom net_active_window;
+  Atom net_wm_name;
+  Atom utf8_string;
+  Atom net_wm_state;
+  Atom net_wm_state_fullscreen;
+  Window active;
+  /* set if "active" is fullscreen */
+  int fullscreen;
+  /* index of the application of "active", -1 if unknown */
+  long app;
+  uint64_t threshold;
+  /* monotonic time up to which the active time is accounted */
+  uint64_t since;
+  /* monotonic time of the last input as of the latest sample */
+  uint64_t last_input;
+};
+
+#ifdef XPRINTIDLE_NO_APPS
+
+/* Built without the "apps" feature, --apps isn't accepted. */
+static inline void app_table_free(struct app_table *t) { (void)t; }
+static inline int app_tracker_open(struct app_tracker *at, Display *dpy,
+                                   struct app_table *t, uint64_t threshold) {
+  (void)at;
+  (void)dpy;
+  (void)t;
+  (void)threshold;
+  return -1;
+}
+static inline void app_tracker_handle(struct app_tracker *at) { (void)at; }
+static inline void app_tracker_sample(struct app_tracker *at, uint64_t idle) {
+  (void)at;
+  (void)idle;
+}
+static inline void app_tracker_close(struct app_tracker *at) { (void)at; }
+
+#else
+
+void app_table_free(struct app_table *t);
+int app_tracker_open(struct app_tracker *at, Display *dpy, struct app_table *t,
+                     uint64_t threshold);
+void app_tracker_handle(struct app_tracker *at);
+void app_tracker_sample(struct app_tracker *at, uint64_t idle);
+void app_tracker_close(struct app_tracker *at);
+
+#endif /* XPRINTIDLE_NO_APPS */
+
+/* This function returns the class name of application "i" of "t". */
+static inline const char *app_name(const struct app_table *t, size_t i) {
+  return names_get(&t->names, i);
+}
+
+#endif /* XPRINTIDLE_APPS_H */
@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Benchmark and check of the workaround for old X servers (vendor release
+ * below 12000000), which adds the DPMS timeouts to the idle time while the
+ * monitor is in standby, suspend or off. It runs xprintidle against the fake
+ * X server (see fakex.c) reporting an old release and each DPMS mode, checks
+ * the printed idle times, and measures the extra round trips of the
+ * workaround with delayed replies.
+ *
+ * Usage: bench-dpms FAKEX XPRINTIDLE
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "xrun.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#define OLD "--release=11000000"
+#define NEW "--release=12101004"
+
+#define RUNS 50
+#define DELAY_US 1000
+#define DELAY "--delay=1000"
+
+struct fixture {
+  const char *label;
+  const char *args[8];
+  const char *expect;
+};
+
+/* The default DPMS timeouts of fakex are 600 seconds each. */
+static const struct fixture fixtures[] = {
+    {"on", {OLD, "-i", "1000", "--dpms-state=on", NULL}, "1000\n"},
+    {"standby", {OLD, "-i", "1000", "--dpms-state=standby", NULL}, "601000\n"},
+    {"suspend", {OLD, "-i", "1000", "--dpms-state=suspend", NULL}, "1201000\n"},
+    {"off", {OLD, "-i", "1000", "--dpms-state=off", NULL}, "1801000\n"},
+    {"off, timeouts",
+     {OLD, "-i", "1000", "--dpms-state=off", "--dpms-timeouts=60,120,300",
+      NULL},
+     "481000\n"},
+    {"off, idle above",
+     {OLD, "-i", "5000000", "--dpms-state=off", NULL},
+     "5000000\n"},
+    {"off, disabled",
+     {OLD, "-i", "1000", "--dpms-state=off", "--dpms-disabled", NULL},
+     "1000\n"},
+    {"no DPMS", {OLD, "-i", "1000", "--no-dpms", NULL}, "1000\n"},
+    {"off, new release",
+     {NEW, "-i", "1000", "--dpms-state=off", NULL},
+     "1000\n"},
+};
+
+static const char *fakex_path, *xprintidle_path;
+
+/*
+ * This function checks that xprintidle prints "f->expect" against the server
+ * set up by "f".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int check(const struct fixture *f, int display) {
+  char out[64];
+  pid_t server;
+  int status, ret = 0;
+
+  server = xrun_start_server(fakex_path, display, f->args);
+  if (server < 0)
+    return -1;
+
+  if (xrun_run(xprintidle_path, display, NULL, out, sizeof(out), &status,
+               NULL) < 0 ||
+      !WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+      strcmp(out, f->expect)) {
+    fprintf(stderr, "%s: printed '%s' instead of '%s'\n", f->label, out,
+            f->expect);
+    ret = -1;
+  } else {
+    printf("%-20s ok\n", f->label);
+  }
+
+  xrun_stop_server(server);
+  return ret;
+}
+
+/*
+ * This function returns the median duration of RUNS runs of xprintidle
+ * against the server started with "args", or -1 on error.
+ */
+static double median(int display, const char *const *args) {
+  double times[RUNS];
+  char out[64];
+  pid_t server;
+  int i, status;
+
+  server = xrun_start_server(fakex_path, display, args);
+  if (server < 0)
+    return -1;
+
+  for (i = 0; i < RUNS; i++) {
+    times[i] = xrun_run(xprintidle_path, display, NULL, out, sizeof(out),
+                        &status, NULL);
+    if (times[i] < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      xrun_stop_server(server);
+      return -1;
+    }
+  }
+
+  xrun_stop_server(server);
+  qsort(times, RUNS, sizeof(*times), xrun_cmp_double);
+  return times[RUNS / 2];
+}
+
+int main(int argc, char *argv[]) {
+  static const char *const old_args[] = {OLD, "--dpms-state=off", DELAY, NULL};
+  static const char *const new_args[] = {NEW, "--dpms-state=off", DELAY, NULL};
+  double old_time, new_time;
+  size_t i;
+
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s FAKEX XPRINTIDLE\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  fakex_path = argv[1];
+  xprintidle_path = argv[2];
+  signal(SIGPIPE, SIG_IGN);
+
+  for (i = 0; i < sizeof(fixtures) / sizeof(*fixtures); i++) {
+    if (check(&fixtures[i], XRUN_DISPLAY_DPMS + (int)i) < 0)
+      return EXIT_FAILURE;
+  }
+
+  /* with every reply delayed, the difference in run time counts the extra
+   * round trips of the workaround */
+  new_time = median(XRUN_DISPLAY_DPMS, new_args);
+  old_time = median(XRUN_DISPLAY_DPMS + 1, old_args);
+  if (new_time < 0 || old_time < 0) {
+    fprintf(stderr, "timed runs failed\n");
+    return EXIT_FAILURE;
+  }
+  printf("new release:         %.3f ms per run (median, %d us per reply)\n",
+         new_time * 1e3, DELAY_US);
+  printf("old release:         %.3f ms per run, %.1f extra round trips\n",
+         old_time * 1e3, (old_time - new_time) * 1e6 / DELAY_US);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,189 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Benchmark of the stdin filter mode of xprintidle (--format-stdin). It feeds
+ * a file of pseudo random idle times, once as text lines and once as binary
+ * records, through the filter of the built xprintidle into /dev/null and
+ * reports the values per second, reading, parsing and formatting included.
+ * For comparison it also reports how fast format_human_time() alone formats
+ * the same values through the buffered writer.
+ *
+ * Usage: bench-format XPRINTIDLE
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "format.h"
+#include "xrun.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define VALUES 4096
+#define ROUNDS 2000
+
+/* Values fed through the filter per run, and number of runs. */
+#define FILTER_VALUES (1024 * 1024)
+#define FILTER_RUNS 5
+
+static uint64_t values[VALUES];
+
+/*
+ * This function writes FILTER_VALUES values, cycling through "values", to a
+ * new temporary file, as text lines or, if "binary" is set, as 64 bit little
+ * endian records.
+ * On success its descriptor, positioned at the start, is returned.
+ * On error -1 is returned.
+ */
+static int write_input(int binary) {
+  static struct outbuf out;
+  char path[] = "/tmp/bench-format-XXXXXX";
+  int fd = mkstemp(path);
+  size_t i;
+
+  if (fd < 0) {
+    perror("mkstemp");
+    return -1;
+  }
+  unlink(path);
+
+  outbuf_init(&out, fd);
+  for (i = 0; i < FILTER_VALUES; i++) {
+    uint64_t v = values[i % VALUES];
+    char *p = outbuf_reserve(&out, U64_STR_MAX + 1);
+    int b;
+
+    if (binary) {
+      for (b = 0; b < 8; b++)
+        p[b] = (char)(v >> (8 * b));
+      outbuf_commit(&out, 8);
+    } else {
+      size_t len = format_u64(p, v);
+
+      p[len++] = '\n';
+      outbuf_commit(&out, len);
+    }
+  }
+  if (outbuf_flush(&out) < 0 || lseek(fd, 0, SEEK_SET) < 0) {
+    perror("write input");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/*
+ * This function runs "xprintidle" with "arg" FILTER_RUNS times on the input
+ * "in" and returns the median of the values per second, or -1 on error.
+ */
+static double filter_rate(const char *xprintidle, const char *arg, int in) {
+  double rates[FILTER_RUNS];
+  int null = open("/dev/null", O_WRONLY), r;
+
+  if (null < 0) {
+    perror("open /dev/null");
+    return -1;
+  }
+
+  for (r = 0; r < FILTER_RUNS; r++) {
+    double start = xrun_now();
+    int status;
+    pid_t pid;
+
+    if (lseek(in, 0, SEEK_SET) < 0)
+      break;
+    pid = fork();
+    if (pid == 0) {
+      dup2(in, STDIN_FILENO);
+      dup2(null, STDOUT_FILENO);
+      execl(xprintidle, xprintidle, arg, (char *)NULL);
+      _exit(127);
+    }
+    if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "%s %s failed\n", xprintidle, arg);
+      break;
+    }
+    rates[r] = FILTER_VALUES / (xrun_now() - start);
+  }
+  close(null);
+  if (r < FILTER_RUNS)
+    return -1;
+
+  qsort(rates, FILTER_RUNS, sizeof(*rates), xrun_cmp_double);
+  return rates[FILTER_RUNS / 2];
+}
+
+int main(int argc, char *argv[]) {
+  static struct outbuf out;
+  uint64_t seed = 0x9e3779b97f4a7c15ULL;
+  double start, elapsed, text_rate, binary_rate;
+  int fd, text, binary, i, r;
+
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s XPRINTIDLE\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  fd = open("/dev/null", O_WRONLY);
+  if (fd < 0) {
+    perror("open /dev/null");
+    return EXIT_FAILURE;
+  }
+  /* Mostly short idle times with an occasional multi-day one, roughly what a
+   * logged day of samples looks like. */
+  for (i = 0; i < VALUES; i++) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    values[i] = (i % 64) ? seed % (10 * 60 * 1000) : seed % (7ULL * 86400000);
+  }
+
+  outbuf_init(&out, fd);
+  start = xrun_now();
+  for (r = 0; r < ROUNDS; r++) {
+    for (i = 0; i < VALUES; i++) {
+      char *p = outbuf_reserve(&out, HUMAN_TIME_MAX + 1);
+      size_t len = format_human_time(p, values[i]);
+      p[len++] = '\n';
+      outbuf_commit(&out, len);
+    }
+  }
+  outbuf_flush(&out);
+  elapsed = xrun_now() - start;
+
+  printf("format_human_time:         %.0f values/s\n",
+         (double)VALUES * ROUNDS / elapsed);
+  close(fd);
+
+  text = write_input(0);
+  binary = write_input(1);
+  if (text < 0 || binary < 0)
+    return EXIT_FAILURE;
+  text_rate = filter_rate(argv[1], "--format-stdin", text);
+  binary_rate = filter_rate(argv[1], "--format-stdin=binary", binary);
+  close(text);
+  close(binary);
+  if (text_rate < 0 || binary_rate < 0)
+    return EXIT_FAILURE;
+  printf("--format-stdin:            %.0f values/s (median of %d runs)\n",
+         text_rate, FILTER_RUNS);
+  printf("--format-stdin=binary:     %.0f values/s\n", binary_rate);
+
+  return EXIT_SUCCESS;
+}
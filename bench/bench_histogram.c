@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Benchmark for the idle period histogram. It checks that every bucket starts
+ * at its lower bound and that a bucket is at most 1/HISTOGRAM_SUB of it wide,
+ * then measures adding periods with lengths spread log-uniformly between a
+ * second and a day.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "histogram.h"
+#include "xrun.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define VALUES 4096
+#define ROUNDS 2000
+
+static uint64_t rnd(uint64_t *seed) {
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 7;
+  *seed ^= *seed << 17;
+  return *seed;
+}
+
+/*
+ * This function checks the bucket boundaries.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int check(void) {
+  size_t i;
+
+  for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    uint64_t low = histogram_lower_bound(i);
+    uint64_t next = (uint64_t)1 << HISTOGRAM_MAX_BITS;
+
+    if (i + 1 < HISTOGRAM_BUCKETS)
+      next = histogram_lower_bound(i + 1);
+
+    if (histogram_index(low) != i || histogram_index(next - 1) != i ||
+        (low >= HISTOGRAM_SUB && (next - low) * HISTOGRAM_SUB > low)) {
+      fprintf(stderr, "bucket %zu [%llu, %llu) is wrong\n", i,
+              (unsigned long long)low, (unsigned long long)next);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int main(void) {
+  static struct histogram h;
+  static uint64_t values[VALUES];
+  uint64_t seed = 0x9e3779b97f4a7c15ULL;
+  double start, elapsed;
+  size_t i, used = 0;
+  int r;
+
+  if (check() < 0)
+    return EXIT_FAILURE;
+
+  /* 1 s * 2^(0..16.4) reaches a day */
+  for (i = 0; i < VALUES; i++) {
+    unsigned shift = (unsigned)(rnd(&seed) % 17);
+
+    values[i] = (1000 + rnd(&seed) % 1000) << shift;
+  }
+
+  start = xrun_now();
+  for (r = 0; r < ROUNDS; r++) {
+    for (i = 0; i < VALUES; i++)
+      histogram_add(&h, values[i]);
+  }
+  elapsed = xrun_now() - start;
+
+  for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+    used += h.buckets[i] != 0;
+
+  printf("buckets:  %d (%zu used), %zu bytes\n", HISTOGRAM_BUCKETS, used,
+         sizeof(h));
+  printf("add:      %.2f ns/period (%llu periods)\n",
+         elapsed * 1e9 / ((double)VALUES * ROUNDS),
+         (unsigned long long)h.count);
+  return EXIT_SUCCESS;
+}
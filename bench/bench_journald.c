@@ -0,0 +1,448 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Check and benchmark of the journald sink (see journald.h). It binds a
+ * datagram socket standing in for journald, runs xprintidle --watch
+ * --journal=SOCKET against the fake X server (see fakex.c) and checks the
+ * fields of the entries, the binary MESSAGE and DISPLAY ones included, that
+ * the entries of a --batch=journal:N batch arrive together, and that entries
+ * which don't fit into the socket are dropped and counted instead of holding
+ * up xprintidle.
+ *
+ * Usage: bench-journald FAKEX XPRINTIDLE
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "xrun.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DISPLAY_NAME XRUN_DISPLAY_NAME(XRUN_DISPLAY_JOURNALD)
+
+/* Entries of a batch, and number of batches received. */
+#define BATCH 4
+#define BATCH_ARG "--batch=journal:4"
+#define BATCHES 5
+
+/* Gap in seconds which separates two batches; the entries of a batch arrive
+ * at once, batches BATCH rounds of 50 milliseconds apart. */
+#define BATCH_GAP 0.1
+
+/* How long entries are sent to a socket which isn't read, in milliseconds. */
+#define FLOOD_MS 500
+
+/* Largest entry received. */
+#define ENTRY_MAX 4096
+
+/* How long to wait for an entry, in milliseconds. */
+#define ENTRY_TIMEOUT 5000
+
+static const char *fakex_path, *xprintidle_path;
+static char dir[] = "/tmp/bench-journald-XXXXXX";
+static char sock_path[sizeof(dir) + 16], out_path[sizeof(dir) + 16],
+    err_path[sizeof(dir) + 16];
+
+/* A field expected in an entry; "value" is NULL if it must be missing. */
+struct field {
+  const char *name;
+  const char *value;
+  int binary;
+};
+
+/*
+ * This function looks up the field "name" in the entry "buf" of "len" bytes,
+ * which may be in the text (NAME=VALUE) or the binary format (NAME, newline,
+ * 64 bit little endian length, VALUE) of the native protocol, and writes its
+ * value and length to "value" and "value_len".
+ * If the field is binary 1 is returned, if it is text 0.
+ * If it is missing or the entry is malformed -1 is returned.
+ */
+static int find_field(const char *buf, size_t len, const char *name,
+                      const char **value, size_t *value_len) {
+  size_t name_len = strlen(name), pos = 0;
+
+  while (pos < len) {
+    const char *line = buf + pos;
+    size_t rest = len - pos, n = 0, vlen;
+    int binary;
+
+    while (n < rest && line[n] != '=' && line[n] != '\n')
+      n++;
+    if (n == rest)
+      return -1;
+    binary = line[n] == '\n';
+    if (binary) {
+      uint64_t v = 0;
+      int i;
+
+      if (rest - n < 10)
+        return -1;
+      for (i = 7; i >= 0; i--)
+        v = v << 8 | (unsigned char)line[n + 1 + i];
+      if (v > rest - n - 10 || line[n + 9 + v] != '\n')
+        return -1;
+      vlen = (size_t)v;
+      *value = line + n + 9;
+      pos += n + 10 + vlen;
+    } else {
+      const char *end = memchr(line + n, '\n', rest - n);
+
+      if (end == NULL)
+        return -1;
+      vlen = (size_t)(end - line) - n - 1;
+      *value = line + n + 1;
+      pos += (size_t)(end - line) + 1;
+    }
+    if (n == name_len && !memcmp(line, name, n)) {
+      *value_len = vlen;
+      return binary;
+    }
+  }
+
+  return -1;
+}
+
+/*
+ * This function checks the entry "buf" of "len" bytes against the "n"
+ * expected fields "fields".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int check_entry(const char *buf, size_t len, const struct field *fields,
+                       size_t n) {
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    const struct field *f = &fields[i];
+    const char *value;
+    size_t value_len;
+    int binary = find_field(buf, len, f->name, &value, &value_len);
+
+    if (f->value == NULL) {
+      if (binary >= 0) {
+        fprintf(stderr, "unexpected field %s\n", f->name);
+        return -1;
+      }
+      continue;
+    }
+    if (binary < 0) {
+      fprintf(stderr, "missing field %s\n", f->name);
+      return -1;
+    }
+    if (binary != f->binary || value_len != strlen(f->value) ||
+        memcmp(value, f->value, value_len)) {
+      fprintf(stderr, "field %s is %s '%.*s' instead of %s '%s'\n", f->name,
+              binary ? "binary" : "text", (int)value_len, value,
+              f->binary ? "binary" : "text", f->value);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * This function starts xprintidle --watch with the options "args" (NULL
+ * terminated), writing to the socket of the check, its stdout to "out_path"
+ * and its stderr to "err_path".
+ * On success the pid of xprintidle is returned.
+ * On error -1 is returned.
+ */
+static pid_t start(const char *const *args) {
+  char journal[sizeof("--journal=") + sizeof(sock_path)];
+  const char *argv[16];
+  size_t n = 0;
+  pid_t pid;
+
+  snprintf(journal, sizeof(journal), "--journal=%s", sock_path);
+  argv[n++] = xprintidle_path;
+  argv[n++] = "-d";
+  argv[n++] = DISPLAY_NAME;
+  argv[n++] = journal;
+  while (*args && n < sizeof(argv) / sizeof(*argv) - 1)
+    argv[n++] = *args++;
+  argv[n] = NULL;
+
+  pid = fork();
+  if (pid == 0) {
+    int out = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    int err = open(err_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+    dup2(out, STDOUT_FILENO);
+    dup2(err, STDERR_FILENO);
+    execv(argv[0], (char *const *)argv);
+    _exit(127);
+  }
+  if (pid < 0)
+    fprintf(stderr, "couldn't start %s\n", xprintidle_path);
+  return pid;
+}
+
+/*
+ * This function stops xprintidle "pid" with SIGTERM.
+ * If it exited successfully 0 is returned.
+ * Otherwise -1 is returned.
+ */
+static int stop(pid_t pid) {
+  int status;
+
+  kill(pid, SIGTERM);
+  if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "xprintidle failed\n");
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * This function receives an entry from "fd" into "buf" (of ENTRY_MAX bytes)
+ * and writes its length to "len", waiting at most ENTRY_TIMEOUT milliseconds.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int receive(int fd, char *buf, size_t *len) {
+  struct pollfd pfd = {fd, POLLIN, 0};
+  ssize_t ret;
+
+  if (poll(&pfd, 1, ENTRY_TIMEOUT) <= 0) {
+    fprintf(stderr, "no entry received\n");
+    return -1;
+  }
+  ret = recv(fd, buf, ENTRY_MAX, 0);
+  if (ret < 0) {
+    perror("recv");
+    return -1;
+  }
+  *len = (size_t)ret;
+  return 0;
+}
+
+/*
+ * This function checks the fields of the entries of a display going idle in
+ * its second round, with the monitor in standby.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int check_fields(int fd) {
+  static const char *const server_args[] = {"-i", "1000,70000",
+                                            "--dpms-state=standby", NULL};
+  static const char *const args[] = {"--watch=50", NULL};
+  static const struct field active[] = {
+      {"MESSAGE", DISPLAY_NAME " idle 1000 ms", 1},
+      {"DISPLAY", DISPLAY_NAME, 1},
+      {"SYSLOG_IDENTIFIER", "xprintidle", 0},
+      {"PRIORITY", "6", 0},
+      {"IDLE_MS", "1000", 0},
+      {"DPMS_STATE", "standby", 0},
+      {"TRANSITION", NULL, 0},
+  };
+  static const struct field idle[] = {
+      {"MESSAGE", DISPLAY_NAME " idle 70000 ms, now idle", 1},
+      {"DISPLAY", DISPLAY_NAME, 1},
+      {"IDLE_MS", "70000", 0},
+      {"DPMS_STATE", "standby", 0},
+      {"TRANSITION", "idle", 0},
+  };
+  char buf[ENTRY_MAX];
+  pid_t server, pid;
+  size_t len;
+  int ret = -1;
+
+  server = xrun_start_server(fakex_path, XRUN_DISPLAY_JOURNALD, server_args);
+  if (server < 0)
+    return -1;
+  pid = start(args);
+  if (pid < 0) {
+    xrun_stop_server(server);
+    return -1;
+  }
+
+  if (receive(fd, buf, &len) == 0 &&
+      check_entry(buf, len, active, sizeof(active) / sizeof(*active)) == 0 &&
+      receive(fd, buf, &len) == 0 &&
+      check_entry(buf, len, idle, sizeof(idle) / sizeof(*idle)) == 0)
+    ret = 0;
+
+  if (stop(pid) < 0)
+    ret = -1;
+  xrun_stop_server(server);
+  /* entries of the rounds after the second */
+  while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) >= 0)
+    ;
+  if (ret == 0)
+    printf("%-20s ok\n", "fields");
+  return ret;
+}
+
+/*
+ * This function checks that the entries of every batch of BATCH samples
+ * arrive together, sent with one sendmmsg(), and measures how far they are
+ * spread out.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int check_batch(int fd) {
+  static const char *const server_args[] = {"-i", "1000", NULL};
+  static const char *const args[] = {"--watch=50", BATCH_ARG, NULL};
+  double times[BATCH * BATCHES], spread = 0;
+  char buf[ENTRY_MAX];
+  pid_t server, pid;
+  size_t i, len;
+  int ret = 0;
+
+  server = xrun_start_server(fakex_path, XRUN_DISPLAY_JOURNALD, server_args);
+  if (server < 0)
+    return -1;
+  pid = start(args);
+  if (pid < 0) {
+    xrun_stop_server(server);
+    return -1;
+  }
+
+  for (i = 0; i < BATCH * BATCHES && ret == 0; i++) {
+    ret = receive(fd, buf, &len);
+    times[i] = xrun_now();
+  }
+
+  if (stop(pid) < 0)
+    ret = -1;
+  xrun_stop_server(server);
+  while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) >= 0)
+    ;
+  if (ret < 0)
+    return -1;
+
+  for (i = 1; i < BATCH * BATCHES; i++) {
+    double gap = times[i] - times[i - 1];
+
+    if ((i % BATCH == 0) != (gap > BATCH_GAP)) {
+      fprintf(stderr, "entry %zu arrived %.1f ms after the one before\n", i,
+              gap * 1e3);
+      return -1;
+    }
+    if (i % BATCH && gap > spread)
+      spread = gap;
+  }
+  printf("%-20s ok, entries of a batch at most %.3f ms apart\n", "batches",
+         spread * 1e3);
+  return 0;
+}
+
+/*
+ * This function checks that entries are dropped and counted once the socket
+ * is full: the socket isn't read while xprintidle writes to it for FLOOD_MS
+ * milliseconds, and the entries received and dropped must add up to the
+ * samples printed.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int check_drop(int fd) {
+  static const char *const server_args[] = {"-i", "1000", NULL};
+  static const char *const args[] = {"--watch=5", NULL};
+  struct timespec flood = {0, FLOOD_MS * 1000000L};
+  unsigned long long dropped = 0, received = 0, samples = 0;
+  char buf[ENTRY_MAX];
+  pid_t server, pid;
+  FILE *f;
+  int c, ret;
+
+  server = xrun_start_server(fakex_path, XRUN_DISPLAY_JOURNALD, server_args);
+  if (server < 0)
+    return -1;
+  pid = start(args);
+  if (pid < 0) {
+    xrun_stop_server(server);
+    return -1;
+  }
+  nanosleep(&flood, NULL);
+  ret = stop(pid);
+  xrun_stop_server(server);
+
+  while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) >= 0)
+    received++;
+  f = fopen(out_path, "r");
+  while (f && (c = getc(f)) != EOF)
+    samples += c == '\n';
+  if (f)
+    fclose(f);
+  f = fopen(err_path, "r");
+  if (f == NULL || fscanf(f, "%llu journal entries dropped", &dropped) != 1)
+    dropped = 0;
+  if (f)
+    fclose(f);
+
+  if (ret < 0 || dropped == 0 || received + dropped != samples) {
+    fprintf(stderr,
+            "%llu samples, %llu entries received and %llu reported dropped\n",
+            samples, received, dropped);
+    return -1;
+  }
+  printf("%-20s ok, %llu of %llu entries dropped\n", "full socket", dropped,
+         samples);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  struct sockaddr_un addr;
+  int fd, ret;
+
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s FAKEX XPRINTIDLE\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  fakex_path = argv[1];
+  xprintidle_path = argv[2];
+  signal(SIGPIPE, SIG_IGN);
+
+  if (mkdtemp(dir) == NULL) {
+    perror("mkdtemp");
+    return EXIT_FAILURE;
+  }
+  snprintf(sock_path, sizeof(sock_path), "%s/socket", dir);
+  snprintf(out_path, sizeof(out_path), "%s/stdout", dir);
+  snprintf(err_path, sizeof(err_path), "%s/stderr", dir);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, sock_path);
+  fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    perror("socket");
+    rmdir(dir);
+    return EXIT_FAILURE;
+  }
+
+  ret = check_fields(fd) < 0 || check_batch(fd) < 0 || check_drop(fd) < 0;
+
+  close(fd);
+  unlink(sock_path);
+  unlink(out_path);
+  unlink(err_path);
+  rmdir(dir);
+  return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,212 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Check of the futex wake-up of the shared memory segment (see publish.h). It
+ * runs xprintidle --watch --publish=FILE against the fake X server (see
+ * fakex.c) answering with an idle, then an active idle time, maps the segment
+ * and blocks in publish_wait(). It checks that each change between active and
+ * idle wakes it up within a round of the sample, that the rounds in between
+ * don't, and that the exit of xprintidle wakes it up with "pid" set to 0.
+ *
+ * Usage: bench-publish FAKEX XPRINTIDLE
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "publish.h"
+#include "xrun.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DISPLAY_NAME XRUN_DISPLAY_NAME(XRUN_DISPLAY_PUBLISH)
+
+/* Length of a round of xprintidle, in milliseconds. */
+#define ROUND 100
+#define ROUND_ARG "--watch=100"
+
+/* Idle times of the rounds: active for 5 rounds, idle for 5, then active
+ * again. The threshold is the default one of 60000 milliseconds. */
+#define IDLE_TIMES "100,100,100,100,100,70000,70000,70000,70000,70000,100"
+
+/* How long to wait for the segment and for a wake-up, in milliseconds. */
+#define TIMEOUT 5000
+
+static char dir[] = "/tmp/bench-publish-XXXXXX";
+static char seg_path[sizeof(dir) + 16];
+
+/*
+ * This function starts xprintidle --watch publishing to "seg_path".
+ * On success the pid of xprintidle is returned.
+ * On error -1 is returned.
+ */
+static pid_t start(const char *xprintidle) {
+  char publish[sizeof("--publish=") + sizeof(seg_path)];
+  pid_t pid;
+
+  snprintf(publish, sizeof(publish), "--publish=%s", seg_path);
+  pid = fork();
+  if (pid == 0) {
+    if (freopen("/dev/null", "w", stdout) == NULL)
+      _exit(127);
+    execl(xprintidle, xprintidle, "-d", DISPLAY_NAME, ROUND_ARG, publish,
+          (char *)NULL);
+    _exit(127);
+  }
+  if (pid < 0)
+    fprintf(stderr, "couldn't start %s\n", xprintidle);
+  return pid;
+}
+
+/*
+ * This function maps the segment into "rd" once xprintidle has put it in
+ * place, waiting at most TIMEOUT milliseconds.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int map(struct publish_reader *rd) {
+  struct timespec step = {0, 1000000L};
+  struct stat st;
+  int i;
+
+  for (i = 0; i < TIMEOUT && stat(seg_path, &st) < 0; i++)
+    nanosleep(&step, NULL);
+  return publish_map(rd, seg_path);
+}
+
+/*
+ * This function waits for the display of "rd" to change to "state" (1 for
+ * idle) and checks that the wake-up came within a round of the sample.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int check_transition(struct publish_reader *rd, uint32_t *generation,
+                            uint32_t state, const char *label) {
+  struct publish_display d;
+  struct timespec ts;
+  double latency;
+
+  if (publish_wait(rd, generation, TIMEOUT) != 0) {
+    fprintf(stderr, "%s: no wake-up\n", label);
+    return -1;
+  }
+  clock_gettime(CLOCK_REALTIME, &ts);
+  publish_read(rd, 0, &d);
+
+  latency = (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6 -
+            (double)d.time;
+  if (d.idle_state != state) {
+    fprintf(stderr, "%s: woken up with the display %s\n", label,
+            d.idle_state ? "idle" : "active");
+    return -1;
+  }
+  /* the sample time is taken at the start of the round */
+  if (latency > ROUND) {
+    fprintf(stderr, "%s: woken up %.1f ms after the sample\n", label,
+            latency);
+    return -1;
+  }
+  printf("%-20s ok, woken up %.1f ms after the sample\n", label, latency);
+  return 0;
+}
+
+/*
+ * This function stops xprintidle "pid" and checks that its exit wakes up the
+ * reader of "rd" with "pid" set to 0 in the segment.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int check_exit(struct publish_reader *rd, uint32_t *generation,
+                      pid_t pid) {
+  double stopped, latency;
+  int status, ret = -1;
+
+  stopped = xrun_now();
+  kill(pid, SIGTERM);
+  if (publish_wait(rd, generation, TIMEOUT) != 0)
+    fprintf(stderr, "exit: no wake-up\n");
+  else if (__atomic_load_n(&rd->hdr->pid, __ATOMIC_ACQUIRE) != 0)
+    fprintf(stderr, "exit: woken up with pid still set\n");
+  else
+    ret = 0;
+  latency = (xrun_now() - stopped) * 1e3;
+
+  if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "xprintidle failed\n");
+    return -1;
+  }
+  if (ret == 0)
+    printf("%-20s ok, woken up %.1f ms after SIGTERM\n", "exit", latency);
+  return ret;
+}
+
+int main(int argc, char *argv[]) {
+  static const char *const server_args[] = {"-i", IDLE_TIMES, NULL};
+  struct publish_reader rd;
+  uint32_t generation;
+  pid_t server, pid;
+  int ret = -1;
+
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s FAKEX XPRINTIDLE\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (mkdtemp(dir) == NULL) {
+    perror("mkdtemp");
+    return EXIT_FAILURE;
+  }
+  snprintf(seg_path, sizeof(seg_path), "%s/segment", dir);
+
+  server = xrun_start_server(argv[1], XRUN_DISPLAY_PUBLISH, server_args);
+  if (server < 0)
+    goto out;
+  pid = start(argv[2]);
+  if (pid < 0) {
+    xrun_stop_server(server);
+    goto out;
+  }
+
+  if (map(&rd) < 0) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    xrun_stop_server(server);
+    goto out;
+  }
+  generation = __atomic_load_n(&rd.hdr->generation, __ATOMIC_SEQ_CST);
+
+  if (check_transition(&rd, &generation, 1, "to idle") == 0 &&
+      check_transition(&rd, &generation, 0, "to active") == 0)
+    ret = 0;
+  else
+    kill(pid, SIGTERM);
+  if (ret == 0)
+    ret = check_exit(&rd, &generation, pid);
+  else
+    waitpid(pid, NULL, 0);
+
+  publish_unmap(&rd);
+  xrun_stop_server(server);
+
+out:
+  unlink(seg_path);
+  rmdir(dir);
+  return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
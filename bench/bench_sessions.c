@@ -0,0 +1,150 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Benchmark for the session store. For 10k and 100k sessions it measures
+ * updating every session with a sample and sweeping all of them for the
+ * number of idle ones, and compares the sweep with the same state kept in one
+ * heap record per session reached through a pointer (as state hanging off
+ * every Display would be).
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "sessions.h"
+#include "xrun.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ROUNDS 200
+#define THRESHOLD 60000
+
+/* Per session state as a record of its own, with some neighbours. */
+struct record {
+  void *dpy;
+  char name[64];
+  uint64_t time;
+  uint64_t idle;
+  uint32_t transitions;
+  unsigned char dpms;
+  unsigned char state;
+  unsigned char live;
+};
+
+static uint64_t rnd(uint64_t *seed) {
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 7;
+  *seed ^= *seed << 17;
+  return *seed;
+}
+
+static size_t sweep_records(struct record *const *recs, size_t n,
+                            uint64_t stamp, uint64_t ms) {
+  size_t i, count = 0;
+
+  for (i = 0; i < n; i++) {
+    const struct record *r = recs[i];
+
+    count += r->live && r->idle + stamp - r->time > ms;
+  }
+  return count;
+}
+
+static int run(size_t n) {
+  static struct session_store store;
+  struct record **recs;
+  uint64_t seed = 0x9e3779b97f4a7c15ULL, stamp = 1700000000000ULL;
+  uint64_t *idles;
+  size_t i, count = 0, check = 0;
+  double start, update_time, sweep_time, record_time;
+  int r;
+
+  recs = malloc(n * sizeof(*recs));
+  idles = malloc(n * sizeof(*idles));
+  if (recs == NULL || idles == NULL ||
+      session_store_init(&store, 0, THRESHOLD) < 0) {
+    fprintf(stderr, "out of memory\n");
+    return -1;
+  }
+
+  for (i = 0; i < n; i++) {
+    recs[i] = calloc(1, sizeof(**recs));
+    if (recs[i] == NULL || session_store_add(&store) < 0) {
+      fprintf(stderr, "out of memory\n");
+      return -1;
+    }
+  }
+  /* sessions come and go, so their records end up spread over the heap */
+  for (i = n - 1; i > 0; i--) {
+    size_t j = rnd(&seed) % (i + 1);
+    struct record *tmp = recs[i];
+
+    recs[i] = recs[j];
+    recs[j] = tmp;
+  }
+
+  update_time = sweep_time = record_time = 0;
+  for (r = 0; r < ROUNDS; r++) {
+    stamp += 1000;
+    for (i = 0; i < n; i++)
+      idles[i] = rnd(&seed) % (2 * THRESHOLD);
+
+    start = xrun_now();
+    for (i = 0; i < n; i++)
+      session_store_update(&store, i, stamp, idles[i]);
+    update_time += xrun_now() - start;
+
+    for (i = 0; i < n; i++) {
+      recs[i]->time = stamp;
+      recs[i]->idle = idles[i];
+      recs[i]->live = 1;
+    }
+
+    start = xrun_now();
+    count = session_store_count_idle(&store, stamp + 500, THRESHOLD, 1);
+    sweep_time += xrun_now() - start;
+
+    start = xrun_now();
+    check = sweep_records(recs, n, stamp + 500, THRESHOLD);
+    record_time += xrun_now() - start;
+
+    if (count != check) {
+      fprintf(stderr, "sweeps disagree: %zu != %zu\n", count, check);
+      return -1;
+    }
+  }
+
+  printf("sessions:      %zu (%zu idle in the last round)\n", n, count);
+  printf("update:        %.2f ns/session\n",
+         update_time * 1e9 / ((double)n * ROUNDS));
+  printf("sweep:         %.2f ns/session, %.1f us/sweep\n",
+         sweep_time * 1e9 / ((double)n * ROUNDS), sweep_time * 1e6 / ROUNDS);
+  printf("record sweep:  %.2f ns/session, %.1f us/sweep (%.1fx slower)\n",
+         record_time * 1e9 / ((double)n * ROUNDS), record_time * 1e6 / ROUNDS,
+         record_time / sweep_time);
+
+  for (i = 0; i < n; i++)
+    free(recs[i]);
+  free(recs);
+  free(idles);
+  session_store_free(&store);
+  return 0;
+}
+
+int main(void) {
+  if (run(10000) < 0 || run(100000) < 0)
+    return EXIT_FAILURE;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Benchmark for the startup cost of xprintidle linked against libXss and
+ * libXext compared to loading them lazily (the "lazy_x_extensions" build
+ * option). Both builds are run for --version and the stdin filter, which
+ * don't query a display, and for one-shot queries against the fake X server
+ * (see fakex.c) with a new and an old vendor release, the latter using the
+ * DPMS workaround. The median run time and peak RSS of every case are
+ * reported.
+ *
+ * Usage: bench-startup FAKEX LINKED LAZY
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "xrun.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+
+#define DISPLAY_NEW XRUN_DISPLAY_STARTUP
+#define DISPLAY_OLD (XRUN_DISPLAY_STARTUP + 1)
+
+#define RUNS 100
+
+struct workload {
+  const char *label;
+  int display;
+  const char *args[4];
+};
+
+static const struct workload workloads[] = {
+    {"--version", -1, {"--version", NULL}},
+    {"--format-stdin", -1, {"--format-stdin", NULL}},
+    {"query", DISPLAY_NEW, {NULL}},
+    {"query, DPMS", DISPLAY_OLD, {NULL}},
+};
+
+/*
+ * This function runs "prog" RUNS times with workload "w" and writes the
+ * median run time to "time" and the peak RSS to "rss".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int measure(const char *prog, const struct workload *w, double *time,
+                   long *rss) {
+  double times[RUNS];
+  char out[256];
+  int i, status;
+
+  *rss = 0;
+  for (i = 0; i < RUNS; i++) {
+    long maxrss;
+
+    times[i] = xrun_run(prog, w->display, w->args, out, sizeof(out), &status,
+                        &maxrss);
+    if (times[i] < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "%s %s failed\n", prog, w->label);
+      return -1;
+    }
+    if (maxrss > *rss)
+      *rss = maxrss;
+  }
+
+  qsort(times, RUNS, sizeof(*times), xrun_cmp_double);
+  *time = times[RUNS / 2];
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  static const char *const new_args[] = {"--release=12101004", NULL};
+  static const char *const old_args[] = {"--release=11000000",
+                                         "--dpms-state=off", NULL};
+  pid_t new_server, old_server;
+  size_t i;
+  int ret = EXIT_SUCCESS;
+
+  if (argc != 4) {
+    fprintf(stderr, "usage: %s FAKEX LINKED LAZY\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  new_server = xrun_start_server(argv[1], DISPLAY_NEW, new_args);
+  old_server = xrun_start_server(argv[1], DISPLAY_OLD, old_args);
+  if (new_server < 0 || old_server < 0)
+    return EXIT_FAILURE;
+
+  printf("%-16s %12s %12s %12s %12s\n", "", "linked", "lazy", "linked RSS",
+         "lazy RSS");
+  for (i = 0; i < sizeof(workloads) / sizeof(*workloads); i++) {
+    double linked_time, lazy_time;
+    long linked_rss, lazy_rss;
+
+    if (measure(argv[2], &workloads[i], &linked_time, &linked_rss) < 0 ||
+        measure(argv[3], &workloads[i], &lazy_time, &lazy_rss) < 0) {
+      ret = EXIT_FAILURE;
+      break;
+    }
+    printf("%-16s %9.3f ms %9.3f ms %8ld KiB %8ld KiB\n", workloads[i].label,
+           linked_time * 1e3, lazy_time * 1e3, linked_rss, lazy_rss);
+  }
+
+  xrun_stop_server(new_server);
+  xrun_stop_server(old_server);
+  return ret;
+}
@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Benchmark for the timeline encoder and decoder. It encodes a synthetic day
+ * of one second samples (alternating active and idle periods with some timer
+ * jitter) many times over and reports the compression ratio compared to CSV
+ * as well as the encode and decode throughput.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "timeline.h"
+#include "xrun.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SAMPLES (86400 * 16)
+#define ROUNDS 8
+
+static uint64_t rnd(uint64_t *seed) {
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 7;
+  *seed ^= *seed << 17;
+  return *seed;
+}
+
+int main(void) {
+  static struct tl_encoder enc;
+  static uint64_t times[TL_BLOCK_SAMPLES_MAX], idles[TL_BLOCK_SAMPLES_MAX];
+  uint64_t *t, *idle;
+  unsigned char *buf;
+  size_t len = 0, off, csv = 0, i;
+  uint64_t seed = 0x9e3779b97f4a7c15ULL, stamp = 1700000000000ULL, last = 0;
+  uint64_t decoded = 0, check = 0;
+  double start, enc_time, dec_time;
+  int r;
+
+  t = malloc(SAMPLES * sizeof(*t));
+  idle = malloc(SAMPLES * sizeof(*idle));
+  buf = malloc((SAMPLES / TL_BLOCK_SAMPLES_MAX + 1) * TL_BLOCK_MAX);
+  if (t == NULL || idle == NULL || buf == NULL) {
+    fprintf(stderr, "out of memory\n");
+    return EXIT_FAILURE;
+  }
+
+  for (i = 0; i < SAMPLES; i++) {
+    stamp += 1000 + rnd(&seed) % 5 - 2;
+    /* every ten minutes or so flip between typing and being away */
+    if ((i / 600) % 2 == 0 && rnd(&seed) % 4)
+      last = stamp - rnd(&seed) % 900;
+    t[i] = stamp;
+    idle[i] = stamp - last;
+    csv += (size_t)snprintf(NULL, 0, "%llu,%llu\n", (unsigned long long)t[i],
+                            (unsigned long long)idle[i]);
+  }
+
+  start = xrun_now();
+  for (r = 0; r < ROUNDS; r++) {
+    tl_encoder_init(&enc, 0);
+    len = 0;
+    for (i = 0; i < SAMPLES; i++) {
+      tl_encoder_append(&enc, t[i], idle[i]);
+      if (enc.count == TL_BLOCK_SAMPLES_MAX)
+        len += tl_encoder_finish(&enc, buf + len);
+    }
+    if (enc.count)
+      len += tl_encoder_finish(&enc, buf + len);
+  }
+  enc_time = xrun_now() - start;
+
+  start = xrun_now();
+  for (r = 0; r < ROUNDS; r++) {
+    struct tl_block blk;
+    int blen;
+
+    for (off = 0; off < len; off += (size_t)blen) {
+      blen = tl_block_parse(buf + off, len - off, &blk);
+      if (blen < 0 || tl_block_decode(&blk, times, idles) < 0) {
+        fprintf(stderr, "decode failed at offset %zu\n", off);
+        return EXIT_FAILURE;
+      }
+      check += idles[blk.count - 1];
+      decoded += blk.count;
+    }
+  }
+  dec_time = xrun_now() - start;
+
+  if (decoded != (uint64_t)SAMPLES * ROUNDS) {
+    fprintf(stderr, "decoded %llu samples instead of %llu\n",
+            (unsigned long long)decoded,
+            (unsigned long long)SAMPLES * ROUNDS);
+    return EXIT_FAILURE;
+  }
+
+  printf("samples:     %d\n", SAMPLES);
+  printf("csv bytes:   %zu\n", csv);
+  printf("timeline:    %zu bytes (%.2f bytes/sample, %.1fx smaller)\n", len,
+         (double)len / SAMPLES, (double)csv / (double)len);
+  printf("encode:      %.0f samples/s\n", (double)SAMPLES * ROUNDS / enc_time);
+  printf("decode:      %.0f samples/s, %.2f GB/s decoded, %.2f GB/s csv "
+         "equivalent (checksum %llu)\n",
+         (double)decoded / dec_time, (double)decoded * 16 / dec_time / 1e9,
+         (double)csv * ROUNDS / dec_time / 1e9, (unsigned long long)check);
+
+  free(t);
+  free(idle);
+  free(buf);
+  return EXIT_SUCCESS;
+}
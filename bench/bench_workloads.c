@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Benchmark of the typical workloads of xprintidle against the fake X server
+ * (see fakex.c): one-shot queries of a new and an old server (the latter
+ * with the DPMS workaround), watching one display and watching four displays.
+ * For every given build of xprintidle the median wall time and CPU time per
+ * sample are reported, and the change of every further build relative to the
+ * first one.
+ *
+ * The same workloads train the profile of the LTO+PGO build (see pgo.sh).
+ *
+ * Usage: bench-workloads FAKEX XPRINTIDLE [XPRINTIDLE]...
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "xrun.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DISPLAYS 5
+
+/* "127.0.0.1:N" names of the displays, filled in by main(). */
+static char display_names[DISPLAYS][16];
+
+/* Most builds compared. */
+#define BUILDS_MAX 4
+
+struct workload {
+  const char *label;
+  const char *args[12];
+  /* lines to read before stopping xprintidle, 0 to let it exit */
+  size_t lines;
+  /* samples per run */
+  size_t samples;
+  int runs;
+};
+
+static const struct workload workloads[] = {
+    {"one-shot", {"-d", display_names[0], NULL}, 0, 1, 200},
+    {"one-shot, DPMS", {"-d", display_names[1], NULL}, 0, 1, 200},
+    {"watch",
+     {"-d", display_names[0], "--watch=1", "--format=ndjson", NULL},
+     2000,
+     2000,
+     5},
+    {"watch, 4 displays",
+     {"-d", display_names[0], "-d", display_names[2], "-d", display_names[3],
+      "-d", display_names[4], "--watch=1", "--format=ndjson", NULL},
+     4 * 500,
+     4 * 500,
+     5},
+};
+
+struct result {
+  double time;
+  double cpu;
+};
+
+/*
+ * This function runs "prog" "w->runs" times with workload "w" and writes the
+ * median wall time and CPU time per sample to "r".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int measure(const char *prog, const struct workload *w,
+                   struct result *r) {
+  double times[200], cpus[200];
+  int i;
+
+  for (i = 0; i < w->runs; i++) {
+    times[i] = xrun_lines(prog, w->args, w->lines, &cpus[i]);
+    if (times[i] < 0) {
+      fprintf(stderr, "%s %s failed\n", prog, w->label);
+      return -1;
+    }
+  }
+
+  qsort(times, (size_t)w->runs, sizeof(*times), xrun_cmp_double);
+  qsort(cpus, (size_t)w->runs, sizeof(*cpus), xrun_cmp_double);
+  r->time = times[w->runs / 2] / (double)w->samples;
+  r->cpu = cpus[w->runs / 2] / (double)w->samples;
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  static const char *const new_args[] = {"--release=12101004", NULL};
+  static const char *const old_args[] = {"--release=11000000",
+                                         "--dpms-state=standby", NULL};
+  pid_t servers[DISPLAYS];
+  int i, b, builds = argc - 2, ret = EXIT_SUCCESS;
+  size_t w;
+
+  if (argc < 3 || builds > BUILDS_MAX) {
+    fprintf(stderr, "usage: %s FAKEX XPRINTIDLE [XPRINTIDLE]...\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  for (i = 0; i < DISPLAYS; i++) {
+    snprintf(display_names[i], sizeof(*display_names), "127.0.0.1:%d",
+             XRUN_DISPLAY_WORKLOADS + i);
+    servers[i] = xrun_start_server(argv[1], XRUN_DISPLAY_WORKLOADS + i,
+                                   i == 1 ? old_args : new_args);
+    if (servers[i] < 0) {
+      while (i--)
+        xrun_stop_server(servers[i]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  for (b = 0; b < builds; b++)
+    printf("build %d: %s\n", b + 1, argv[b + 2]);
+  printf("\n%-20s %6s %12s %12s %8s\n", "", "build", "time/sample",
+         "CPU/sample", "change");
+
+  for (w = 0; w < sizeof(workloads) / sizeof(*workloads) && !ret; w++) {
+    struct result r[BUILDS_MAX];
+
+    for (b = 0; b < builds; b++) {
+      if (measure(argv[b + 2], &workloads[w], &r[b]) < 0) {
+        ret = EXIT_FAILURE;
+        break;
+      }
+
+      printf("%-20s %6d %9.1f us %9.1f us", b ? "" : workloads[w].label,
+             b + 1, r[b].time * 1e6, r[b].cpu * 1e6);
+      if (b && r[0].cpu > 0)
+        printf(" %+7.1f%%", (r[b].cpu / r[0].cpu - 1) * 100);
+      printf("\n");
+    }
+  }
+
+  for (i = 0; i < DISPLAYS; i++)
+    xrun_stop_server(servers[i]);
+  return ret;
+}
@@ -0,0 +1,138 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Benchmark for a one-shot xprintidle run against the fake X server (see
+ * fakex.c), so the numbers don't depend on the load of a real X server. It
+ * measures the latency of a run against a local server and against one whose
+ * replies are delayed like those of a remote display, checks the printed
+ * idle time, and checks that dropped connections and partial replies make
+ * xprintidle fail instead of printing a value.
+ *
+ * Usage: bench-xquery FAKEX XPRINTIDLE
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "xrun.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#define RUNS 200
+#define REMOTE_RUNS 50
+#define REMOTE_DELAY "2000"
+
+static const char *fakex_path, *xprintidle_path;
+
+/*
+ * This function runs xprintidle "runs" times against the server started with
+ * "args", checks that it prints "expect" and reports the latency.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int latency(const char *label, int display, const char *const *args,
+                   const char *expect, int runs) {
+  double *times = malloc((size_t)runs * sizeof(*times)), sum = 0;
+  char out[64];
+  pid_t server;
+  int i, status, ret = -1;
+
+  if (times == NULL)
+    return -1;
+  server = xrun_start_server(fakex_path, display, args);
+  if (server < 0) {
+    free(times);
+    return -1;
+  }
+
+  for (i = 0; i < runs; i++) {
+    times[i] = xrun_run(xprintidle_path, display, NULL, out, sizeof(out),
+                        &status, NULL);
+    if (times[i] < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+        strcmp(out, expect)) {
+      fprintf(stderr, "%s: run %d printed '%s' instead of '%s'\n", label, i,
+              out, expect);
+      goto out;
+    }
+    sum += times[i];
+  }
+
+  qsort(times, (size_t)runs, sizeof(*times), xrun_cmp_double);
+  printf("%-16s %d runs, mean %.3f ms, p50 %.3f ms, p99 %.3f ms\n", label,
+         runs, sum * 1e3 / runs, times[runs / 2] * 1e3,
+         times[runs * 99 / 100] * 1e3);
+  ret = 0;
+
+out:
+  xrun_stop_server(server);
+  free(times);
+  return ret;
+}
+
+/*
+ * This function checks that xprintidle fails against the server started with
+ * the fault injection "args".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int fault(const char *label, int display, const char *const *args) {
+  char out[64];
+  pid_t server;
+  int status, ret = 0;
+
+  server = xrun_start_server(fakex_path, display, args);
+  if (server < 0)
+    return -1;
+
+  if (xrun_run(xprintidle_path, display, NULL, out, sizeof(out), &status,
+               NULL) < 0 ||
+      (WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+    fprintf(stderr, "%s: xprintidle succeeded and printed '%s'\n", label, out);
+    ret = -1;
+  } else {
+    printf("%-16s fails as expected\n", label);
+  }
+
+  xrun_stop_server(server);
+  return ret;
+}
+
+int main(int argc, char *argv[]) {
+  static const char *const local[] = {"-i", "1234", NULL};
+  static const char *const remote[] = {"-i", "1234", "--delay=" REMOTE_DELAY,
+                                       NULL};
+  static const char *const drop[] = {"--drop=2", NULL};
+  static const char *const partial[] = {"--partial=2", NULL};
+
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s FAKEX XPRINTIDLE\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  fakex_path = argv[1];
+  xprintidle_path = argv[2];
+  signal(SIGPIPE, SIG_IGN);
+
+  if (latency("local", XRUN_DISPLAY_XQUERY, local, "1234\n", RUNS) < 0 ||
+      latency("remote (" REMOTE_DELAY " us)", XRUN_DISPLAY_XQUERY + 1, remote,
+              "1234\n", REMOTE_RUNS) < 0 ||
+      fault("dropped", XRUN_DISPLAY_XQUERY + 2, drop) < 0 ||
+      fault("partial reply", XRUN_DISPLAY_XQUERY + 3, partial) < 0)
+    return EXIT_FAILURE;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,847 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * A tiny stand-in for an X server, used by the benchmarks of xprintidle. It
+ * speaks just enough of the X11 protocol for xprintidle: the connection setup,
+ * QueryExtension, GetProperty, GetInputFocus and the MIT-SCREEN-SAVER and DPMS
+ * requests xprintidle issues. Idle times, the vendor release and the DPMS
+ * state are scripted on the command line, and faults (slow replies, dropped
+ * connections, partial replies, a wedged server) can be injected. For the
+ * active window tracking, a script of focus changes makes windows with a
+ * class and title active at given times after a client connected, announced
+ * by PropertyNotify events of _NET_ACTIVE_WINDOW on the root window. Windows
+ * may be scripted as fullscreen. For the input counters, a number of XI2 raw
+ * key presses, button presses and motions is sent once a client selects raw
+ * events.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SCREENSAVER_OPCODE 128
+#define DPMS_OPCODE 129
+#define XI_OPCODE 130
+
+#define ROOT_WINDOW 0x100
+#define ROOT_VISUAL 0x21
+
+#define MAX_IDLE_VALUES 1024
+#define MAX_FOCUS_CHANGES 64
+#define MAX_NAME 63
+
+/* Predefined atoms. */
+#define ATOM_ATOM 4
+#define ATOM_STRING 31
+#define ATOM_WINDOW 33
+#define ATOM_WM_CLASS 67
+
+/* Atoms of interned names; all other names share the atom after them. */
+static const char *const atom_names[] = {
+    "_NET_ACTIVE_WINDOW", "_NET_WM_NAME", "UTF8_STRING", "_NET_WM_STATE",
+    "_NET_WM_STATE_FULLSCREEN"};
+#define ATOM_NET_ACTIVE_WINDOW 69
+#define ATOM_NET_WM_NAME 70
+#define ATOM_UTF8_STRING 71
+#define ATOM_NET_WM_STATE 72
+#define ATOM_NET_WM_STATE_FULLSCREEN 73
+#define ATOM_OTHER 74
+
+/* The window of the n-th focus change is FIRST_WINDOW + n. */
+#define FIRST_WINDOW 0x200
+
+#define CW_EVENT_MASK (1u << 11)
+#define PROPERTY_CHANGE_MASK (1u << 22)
+#define PROPERTY_NOTIFY 28
+
+#define GENERIC_EVENT 35
+#define XI_RAW_KEY_PRESS 13
+#define XI_RAW_BUTTON_PRESS 15
+#define XI_RAW_MOTION 17
+
+struct focus_change {
+  long ms;
+  char class[MAX_NAME + 1];
+  char title[MAX_NAME + 1];
+  int fullscreen;
+};
+
+enum fault {
+  FAULT_NONE,
+  FAULT_DROP,
+  FAULT_PARTIAL,
+  FAULT_WEDGE,
+};
+
+static struct {
+  int display;
+  uint32_t release;
+  uint32_t idle[MAX_IDLE_VALUES];
+  size_t n_idle;
+  int dpms;
+  int dpms_enabled;
+  uint16_t dpms_state;
+  uint16_t standby, suspend, off;
+  long delay_us;
+  enum fault fault;
+  unsigned long fault_after;
+  struct focus_change focus[MAX_FOCUS_CHANGES];
+  size_t n_focus;
+  /* raw events sent once they are selected */
+  unsigned long keys, clicks, motions;
+} cfg = {
+    .display = 42,
+    .release = 12101004,
+    .idle = {0},
+    .n_idle = 1,
+    .dpms = 1,
+    .dpms_enabled = 1,
+    .dpms_state = 0,
+    .standby = 600,
+    .suspend = 600,
+    .off = 600,
+};
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [OPTION]...\n"
+          "\n"
+          "  -n, --display=N         Listen on 127.0.0.1:6000+N (default 42)\n"
+          "  -r, --release=N         Vendor release number\n"
+          "  -i, --idle=MS[,MS...]   Idle times returned by successive\n"
+          "                          screen saver queries, repeating the last\n"
+          "      --no-dpms           Don't announce the DPMS extension\n"
+          "      --dpms-disabled     Report DPMS as disabled\n"
+          "      --dpms-state=STATE  on, standby, suspend or off\n"
+          "      --dpms-timeouts=S,S,S\n"
+          "                          Standby, suspend and off timeouts\n"
+          "      --delay=US          Delay every reply by US microseconds\n"
+          "      --drop=N            Close the connection at request N\n"
+          "      --partial=N         Send half of the reply to request N\n"
+          "                          and close the connection\n"
+          "      --wedge=N           Stop answering at request N\n"
+          "      --focus=MS:CLASS[:TITLE[:fullscreen]][,...]\n"
+          "                          Activate a window of CLASS with TITLE\n"
+          "                          MS milliseconds after connecting\n"
+          "      --input=KEYS,CLICKS,MOTIONS\n"
+          "                          Send that many XI2 raw events (motions\n"
+          "                          by 3,4 pixels) once they are selected\n",
+          name);
+}
+
+static int parse_idle(char *arg) {
+  char *tok, *save = NULL;
+
+  cfg.n_idle = 0;
+  for (tok = strtok_r(arg, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+    if (cfg.n_idle == MAX_IDLE_VALUES)
+      return -1;
+    cfg.idle[cfg.n_idle++] = (uint32_t)strtoul(tok, NULL, 10);
+  }
+  return cfg.n_idle ? 0 : -1;
+}
+
+static int parse_focus(char *arg) {
+  char *tok, *save = NULL;
+
+  cfg.n_focus = 0;
+  for (tok = strtok_r(arg, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+    struct focus_change *f = &cfg.focus[cfg.n_focus];
+    int len = 0;
+
+    if (cfg.n_focus == MAX_FOCUS_CHANGES)
+      return -1;
+    f->title[0] = '\0';
+    f->fullscreen = 0;
+    if (sscanf(tok, "%ld:%63[^:]%n", &f->ms, f->class, &len) != 2)
+      return -1;
+    if (tok[len] == ':') {
+      char *end = strchr(tok + len + 1, ':');
+
+      if (end && !strcmp(end, ":fullscreen")) {
+        f->fullscreen = 1;
+        *end = '\0';
+      }
+      snprintf(f->title, sizeof(f->title), "%s", tok + len + 1);
+    }
+    cfg.n_focus++;
+  }
+  return cfg.n_focus ? 0 : -1;
+}
+
+static int parse_dpms_state(const char *arg) {
+  static const char *names[] = {"on", "standby", "suspend", "off"};
+  uint16_t i;
+
+  for (i = 0; i < 4; i++) {
+    if (!strcmp(arg, names[i])) {
+      cfg.dpms_state = i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+  const char *p = buf;
+
+  while (len) {
+    ssize_t ret = write(fd, p, len);
+
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    p += ret;
+    len -= (size_t)ret;
+  }
+  return 0;
+}
+
+static int read_all(int fd, void *buf, size_t len) {
+  char *p = buf;
+
+  while (len) {
+    ssize_t ret = read(fd, p, len);
+
+    if (ret < 0 && errno == EINTR)
+      continue;
+    if (ret <= 0)
+      return -1;
+    p += ret;
+    len -= (size_t)ret;
+  }
+  return 0;
+}
+
+static void put16(unsigned char *p, uint16_t v) {
+  p[0] = (unsigned char)v;
+  p[1] = (unsigned char)(v >> 8);
+}
+
+static void put32(unsigned char *p, uint32_t v) {
+  p[0] = (unsigned char)v;
+  p[1] = (unsigned char)(v >> 8);
+  p[2] = (unsigned char)(v >> 16);
+  p[3] = (unsigned char)(v >> 24);
+}
+
+static uint16_t get16(const unsigned char *p) {
+  return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get32(const unsigned char *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+/* Answers the connection setup with a single 1024x768 screen. */
+static int setup(int fd) {
+  static const char vendor[] = "xprintidle fake X server";
+  unsigned char req[12], reply[256];
+  unsigned char skip[1024];
+  size_t vlen = sizeof(vendor) - 1, vpad = (vlen + 3) & ~(size_t)3;
+  size_t auth, len;
+  unsigned char *p;
+
+  if (read_all(fd, req, sizeof(req)) < 0)
+    return -1;
+  if (req[0] != 'l') {
+    fprintf(stderr, "fakex: only little endian clients are supported\n");
+    return -1;
+  }
+  auth = ((get16(req + 6) + 3u) & ~3u) + ((get16(req + 8) + 3u) & ~3u);
+  if (auth > sizeof(skip) || (auth && read_all(fd, skip, auth) < 0))
+    return -1;
+
+  memset(reply, 0, sizeof(reply));
+  p = reply + 8;
+  put32(p, cfg.release);         /* release-number */
+  put32(p + 4, 0x00200000);      /* resource-id-base */
+  put32(p + 8, 0x001fffff);      /* resource-id-mask */
+  put32(p + 12, 0);              /* motion-buffer-size */
+  put16(p + 16, (uint16_t)vlen); /* vendor length */
+  put16(p + 18, 0xffff);         /* maximum-request-length */
+  p[20] = 1;                     /* screens */
+  p[21] = 1;                     /* pixmap formats */
+  p[22] = 0;                     /* image-byte-order: LSBFirst */
+  p[23] = 0;                     /* bitmap-format-bit-order */
+  p[24] = 32;                    /* bitmap-format-scanline-unit */
+  p[25] = 32;                    /* bitmap-format-scanline-pad */
+  p[26] = 8;                     /* min-keycode */
+  p[27] = 255;                   /* max-keycode */
+  p += 32;
+  memcpy(p, vendor, vlen);
+  p += vpad;
+
+  /* pixmap format */
+  p[0] = 24;
+  p[1] = 32;
+  p[2] = 32;
+  p += 8;
+
+  /* screen */
+  put32(p, ROOT_WINDOW);
+  put32(p + 4, 0x20); /* default colormap */
+  put32(p + 8, 0xffffff);
+  put32(p + 12, 0);
+  put32(p + 16, 0);
+  put16(p + 20, 1024);
+  put16(p + 22, 768);
+  put16(p + 24, 270);
+  put16(p + 26, 203);
+  put16(p + 28, 1);
+  put16(p + 30, 1);
+  put32(p + 32, ROOT_VISUAL);
+  p[36] = 0;
+  p[37] = 0;
+  p[38] = 24; /* root depth */
+  p[39] = 1;  /* depths */
+  p += 40;
+
+  /* depth with one TrueColor visual */
+  p[0] = 24;
+  put16(p + 2, 1);
+  p += 8;
+  put32(p, ROOT_VISUAL);
+  p[4] = 4; /* TrueColor */
+  p[5] = 8;
+  put16(p + 6, 256);
+  put32(p + 8, 0xff0000);
+  put32(p + 12, 0x00ff00);
+  put32(p + 16, 0x0000ff);
+  p += 24;
+
+  len = (size_t)(p - reply);
+  reply[0] = 1;
+  put16(reply + 2, 11);
+  put16(reply + 4, 0);
+  put16(reply + 6, (uint16_t)((len - 8) / 4));
+
+  return write_all(fd, reply, len);
+}
+
+/* Sends a reply of 32 bytes, possibly applying the configured fault. */
+static int send_reply(int fd, unsigned char *reply, unsigned long n) {
+  if (cfg.delay_us) {
+    struct timespec ts = {cfg.delay_us / 1000000,
+                          (cfg.delay_us % 1000000) * 1000};
+    nanosleep(&ts, NULL);
+  }
+
+  if (cfg.fault == FAULT_PARTIAL && n >= cfg.fault_after) {
+    write_all(fd, reply, 16);
+    return -1;
+  }
+
+  return write_all(fd, reply, 32);
+}
+
+/* State of the focus script on one connection. */
+struct focus_state {
+  struct timespec start;
+  /* number of focus changes done */
+  size_t done;
+  /* set if the client selected PropertyNotify on the root window */
+  int selected;
+};
+
+static long elapsed_ms(const struct timespec *start) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long)(now.tv_sec - start->tv_sec) * 1000 +
+         (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+/*
+ * Does the focus changes which are due, sending their events if the client
+ * asked for them, and returns the milliseconds until the next one, or -1 if
+ * there is none. On a write error -2 is returned.
+ */
+static int advance_focus(int fd, struct focus_state *fs, uint16_t seq) {
+  while (fs->done < cfg.n_focus) {
+    long wait = cfg.focus[fs->done].ms - elapsed_ms(&fs->start);
+    unsigned char ev[32];
+
+    if (wait > 0)
+      return (int)wait;
+    fs->done++;
+    if (!fs->selected)
+      continue;
+
+    memset(ev, 0, sizeof(ev));
+    ev[0] = PROPERTY_NOTIFY;
+    put16(ev + 2, seq);
+    put32(ev + 4, ROOT_WINDOW);
+    put32(ev + 8, ATOM_NET_ACTIVE_WINDOW);
+    if (write_all(fd, ev, sizeof(ev)) < 0)
+      return -2;
+  }
+  return -1;
+}
+
+/*
+ * Answers the GetProperty request "req" with the value "data" of "len" bytes
+ * in "format" (8 or 32) of type "type", as far as it was asked for.
+ */
+static int send_property(int fd, const unsigned char *req, uint16_t seq,
+                         uint32_t type, int format, const void *data,
+                         size_t len) {
+  unsigned char reply[32 + 256];
+  size_t offset = (size_t)get32(req + 16) * 4;
+  size_t want = (size_t)get32(req + 20) * 4, n, padded;
+
+  if (offset > len)
+    offset = len;
+  n = len - offset < want ? len - offset : want;
+  if (n > sizeof(reply) - 32)
+    n = sizeof(reply) - 32;
+  padded = (n + 3) & ~(size_t)3;
+
+  memset(reply, 0, sizeof(reply));
+  reply[0] = 1;
+  reply[1] = (unsigned char)format;
+  put16(reply + 2, seq);
+  put32(reply + 4, (uint32_t)(padded / 4));
+  put32(reply + 8, type);
+  put32(reply + 12, (uint32_t)(len - offset - n));
+  put32(reply + 16, (uint32_t)(n / (size_t)(format / 8)));
+  memcpy(reply + 32, (const char *)data + offset, n);
+  return write_all(fd, reply, 32 + padded);
+}
+
+/*
+ * Answers GetProperty for the active window and the class and title of the
+ * windows of the focus script. Returns 1 if the request was answered, 0 if it
+ * wasn't about one of them and -1 on a write error.
+ */
+static int get_property(int fd, const unsigned char *req, uint16_t seq,
+                        const struct focus_state *fs) {
+  uint32_t window = get32(req + 4), property = get32(req + 8);
+  const struct focus_change *f;
+  unsigned char value[4];
+  char class[2 * MAX_NAME + 2];
+  size_t len;
+
+  if (window == ROOT_WINDOW && property == ATOM_NET_ACTIVE_WINDOW) {
+    put32(value, fs->done ? FIRST_WINDOW + (uint32_t)fs->done - 1 : 0);
+    return send_property(fd, req, seq, ATOM_WINDOW, 32, value, 4) < 0 ? -1
+                                                                      : 1;
+  }
+  if (window < FIRST_WINDOW || window - FIRST_WINDOW >= fs->done)
+    return 0;
+
+  f = &cfg.focus[window - FIRST_WINDOW];
+  if (property == ATOM_WM_CLASS) {
+    /* instance and class, both NUL terminated */
+    len = strlen(f->class) + 1;
+    memcpy(class, f->class, len);
+    memcpy(class + len, f->class, len);
+    return send_property(fd, req, seq, ATOM_STRING, 8, class, 2 * len) < 0
+               ? -1
+               : 1;
+  }
+  if (property == ATOM_NET_WM_STATE && f->fullscreen) {
+    put32(value, ATOM_NET_WM_STATE_FULLSCREEN);
+    return send_property(fd, req, seq, ATOM_ATOM, 32, value, 4) < 0 ? -1 : 1;
+  }
+  if (property == ATOM_NET_WM_NAME && f->title[0])
+    return send_property(fd, req, seq, ATOM_UTF8_STRING, 8, f->title,
+                         strlen(f->title)) < 0
+               ? -1
+               : 1;
+  return 0;
+}
+
+/* Notes whether the ChangeWindowAttributes request "req" selects
+ * PropertyNotify on the root window. */
+static void change_attributes(const unsigned char *req,
+                              struct focus_state *fs) {
+  uint32_t mask = get32(req + 8), bit;
+  size_t i = 0;
+
+  if (get32(req + 4) != ROOT_WINDOW || !(mask & CW_EVENT_MASK))
+    return;
+  for (bit = 1; bit < CW_EVENT_MASK; bit <<= 1)
+    i += (mask & bit) != 0;
+  fs->selected = (get32(req + 12 + 4 * i) & PROPERTY_CHANGE_MASK) != 0;
+}
+
+/*
+ * Sends the scripted raw events of "type" with "seq", "n" of them: key or
+ * button 1 presses, or motions by 3,4 pixels with both valuators set.
+ * On success 0 is returned.
+ * On a write error -1 is returned.
+ */
+static int send_raw_events(int fd, int type, unsigned long n, uint16_t seq) {
+  unsigned char ev[32 + 4 + 4 * 8];
+  size_t len = type == XI_RAW_MOTION ? sizeof(ev) : 32;
+  unsigned long i;
+
+  memset(ev, 0, sizeof(ev));
+  ev[0] = GENERIC_EVENT;
+  ev[1] = XI_OPCODE;
+  put16(ev + 2, seq);
+  put32(ev + 4, (uint32_t)(len - 32) / 4);
+  put16(ev + 8, (uint16_t)type);
+  put16(ev + 10, 2);
+  put32(ev + 16, type == XI_RAW_MOTION ? 0 : 1);
+  put16(ev + 20, 4);
+  if (type == XI_RAW_MOTION) {
+    put16(ev + 22, 1);
+    ev[32] = 3;
+    /* accelerated and raw values as FP3232 */
+    put32(ev + 36, 3);
+    put32(ev + 44, 4);
+    put32(ev + 52, 3);
+    put32(ev + 60, 4);
+  }
+
+  for (i = 0; i < n; i++) {
+    if (write_all(fd, ev, len) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+static uint32_t next_idle(unsigned long *queries) {
+  size_t i = *queries < cfg.n_idle ? *queries : cfg.n_idle - 1;
+
+  (*queries)++;
+  return cfg.idle[i];
+}
+
+static void serve(int fd) {
+  unsigned char req[4096], reply[32];
+  unsigned long n = 0, queries = 0;
+  struct focus_state fs = {{0, 0}, 0, 0};
+  uint16_t seq = 0;
+
+  if (setup(fd) < 0)
+    return;
+  clock_gettime(CLOCK_MONOTONIC, &fs.start);
+
+  for (;;) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    size_t len;
+    int has_reply = 1, wait;
+
+    /* do the focus changes which become due while the client is quiet */
+    while ((wait = advance_focus(fd, &fs, seq)) >= 0 &&
+           poll(&pfd, 1, wait) == 0)
+      ;
+    if (wait == -2)
+      return;
+
+    if (read_all(fd, req, 4) < 0)
+      return;
+    len = (size_t)get16(req + 2) * 4;
+    if (len < 4 || len > sizeof(req) || read_all(fd, req + 4, len - 4) < 0)
+      return;
+
+    seq++;
+    n++;
+
+    if (cfg.fault == FAULT_DROP && n >= cfg.fault_after)
+      return;
+    if (cfg.fault == FAULT_WEDGE && n >= cfg.fault_after) {
+      for (;;)
+        pause();
+    }
+
+    memset(reply, 0, sizeof(reply));
+    reply[0] = 1;
+    put16(reply + 2, seq);
+
+    switch (req[0]) {
+    case 98: { /* QueryExtension */
+      size_t nlen = get16(req + 4);
+      const char *name = (const char *)req + 8;
+
+      if (nlen == 16 && !memcmp(name, "MIT-SCREEN-SAVER", 16)) {
+        reply[8] = 1;
+        reply[9] = SCREENSAVER_OPCODE;
+        reply[10] = 90;
+      } else if (cfg.dpms && nlen == 4 && !memcmp(name, "DPMS", 4)) {
+        reply[8] = 1;
+        reply[9] = DPMS_OPCODE;
+      } else if (nlen == 15 && !memcmp(name, "XInputExtension", 15)) {
+        reply[8] = 1;
+        reply[9] = XI_OPCODE;
+      }
+      break;
+    }
+    case 2: /* ChangeWindowAttributes */
+      change_attributes(req, &fs);
+      has_reply = 0;
+      break;
+    case 16: { /* InternAtom */
+      size_t nlen = get16(req + 4), i;
+
+      put32(reply + 8, req[1] ? 0 : ATOM_OTHER);
+      for (i = 0; i < sizeof(atom_names) / sizeof(*atom_names); i++) {
+        if (nlen == strlen(atom_names[i]) &&
+            !memcmp(req + 8, atom_names[i], nlen))
+          put32(reply + 8, ATOM_NET_ACTIVE_WINDOW + (uint32_t)i);
+      }
+      break;
+    }
+    case 20: { /* GetProperty */
+      int ret = get_property(fd, req, seq, &fs);
+
+      if (ret < 0)
+        return;
+      has_reply = ret == 0;
+      break;
+    }
+    case 43: /* GetInputFocus */
+      break;
+    case SCREENSAVER_OPCODE:
+      switch (req[1]) {
+      case 0: /* QueryVersion */
+        put16(reply + 8, 1);
+        put16(reply + 10, 1);
+        break;
+      case 1: /* QueryInfo */
+        put32(reply + 8, 0);
+        put32(reply + 12, 0);
+        put32(reply + 16, next_idle(&queries));
+        break;
+      case 5: /* Suspend */
+        fprintf(stderr, "fakex: screen saver %s\n",
+                get32(req + 4) ? "suspended" : "resumed");
+        has_reply = 0;
+        break;
+      default:
+        has_reply = 0;
+        break;
+      }
+      break;
+    case DPMS_OPCODE:
+      switch (req[1]) {
+      case 0: /* GetVersion */
+        put16(reply + 8, 1);
+        put16(reply + 10, 1);
+        break;
+      case 1: /* Capable */
+        reply[8] = 1;
+        break;
+      case 2: /* GetTimeouts */
+        put16(reply + 8, cfg.standby);
+        put16(reply + 10, cfg.suspend);
+        put16(reply + 12, cfg.off);
+        break;
+      case 7: /* Info */
+        put16(reply + 8, cfg.dpms_state);
+        reply[10] = (unsigned char)cfg.dpms_enabled;
+        break;
+      case 4: /* Enable */
+      case 5: /* Disable */
+        cfg.dpms_enabled = req[1] == 4;
+        fprintf(stderr, "fakex: DPMS %s\n",
+                cfg.dpms_enabled ? "enabled" : "disabled");
+        has_reply = 0;
+        break;
+      default:
+        has_reply = 0;
+        break;
+      }
+      break;
+    case XI_OPCODE:
+      switch (req[1]) {
+      case 47: /* XIQueryVersion */
+        put16(reply + 8, 2);
+        put16(reply + 10, 0);
+        break;
+      case 46: /* XISelectEvents */
+        has_reply = 0;
+        if (send_raw_events(fd, XI_RAW_KEY_PRESS, cfg.keys, seq) < 0 ||
+            send_raw_events(fd, XI_RAW_BUTTON_PRESS, cfg.clicks, seq) < 0 ||
+            send_raw_events(fd, XI_RAW_MOTION, cfg.motions, seq) < 0)
+          return;
+        break;
+      default:
+        has_reply = 0;
+        break;
+      }
+      break;
+    default:
+      /* core requests without a reply are ignored, unknown extensions get
+       * a BadRequest error like from a real server */
+      has_reply = req[0] >= 128;
+      reply[0] = 0;
+      reply[1] = 1;
+      reply[8] = req[1];
+      reply[10] = req[0];
+      break;
+    }
+
+    if (has_reply && send_reply(fd, reply, n) < 0)
+      return;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  static const struct option long_options[] = {
+      {"display", required_argument, NULL, 'n'},
+      {"release", required_argument, NULL, 'r'},
+      {"idle", required_argument, NULL, 'i'},
+      {"no-dpms", no_argument, NULL, 'N'},
+      {"dpms-disabled", no_argument, NULL, 'D'},
+      {"dpms-state", required_argument, NULL, 'S'},
+      {"dpms-timeouts", required_argument, NULL, 'T'},
+      {"delay", required_argument, NULL, 'd'},
+      {"drop", required_argument, NULL, 'X'},
+      {"partial", required_argument, NULL, 'P'},
+      {"wedge", required_argument, NULL, 'W'},
+      {"focus", required_argument, NULL, 'F'},
+      {"input", required_argument, NULL, 'I'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0},
+  };
+  struct sockaddr_in addr;
+  int opt, lfd, one = 1;
+  unsigned s1, s2, s3;
+
+  while ((opt = getopt_long(argc, argv, "n:r:i:h", long_options, NULL)) !=
+         -1) {
+    switch (opt) {
+    case 'n':
+      cfg.display = atoi(optarg);
+      break;
+    case 'r':
+      cfg.release = (uint32_t)strtoul(optarg, NULL, 10);
+      break;
+    case 'i':
+      if (parse_idle(optarg) < 0) {
+        fprintf(stderr, "fakex: invalid idle list\n");
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'N':
+      cfg.dpms = 0;
+      break;
+    case 'D':
+      cfg.dpms_enabled = 0;
+      break;
+    case 'S':
+      if (parse_dpms_state(optarg) < 0) {
+        fprintf(stderr, "fakex: invalid DPMS state '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'T':
+      if (sscanf(optarg, "%u,%u,%u", &s1, &s2, &s3) != 3) {
+        fprintf(stderr, "fakex: invalid DPMS timeouts '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      cfg.standby = (uint16_t)s1;
+      cfg.suspend = (uint16_t)s2;
+      cfg.off = (uint16_t)s3;
+      break;
+    case 'd':
+      cfg.delay_us = atol(optarg);
+      break;
+    case 'X':
+      cfg.fault = FAULT_DROP;
+      cfg.fault_after = strtoul(optarg, NULL, 10);
+      break;
+    case 'P':
+      cfg.fault = FAULT_PARTIAL;
+      cfg.fault_after = strtoul(optarg, NULL, 10);
+      break;
+    case 'W':
+      cfg.fault = FAULT_WEDGE;
+      cfg.fault_after = strtoul(optarg, NULL, 10);
+      break;
+    case 'F':
+      if (parse_focus(optarg) < 0) {
+        fprintf(stderr, "fakex: invalid focus script\n");
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'I':
+      if (sscanf(optarg, "%lu,%lu,%lu", &cfg.keys, &cfg.clicks,
+                 &cfg.motions) != 3) {
+        fprintf(stderr, "fakex: invalid input counts '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'h':
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  signal(SIGCHLD, SIG_IGN);
+  signal(SIGPIPE, SIG_IGN);
+
+  lfd = socket(AF_INET, SOCK_STREAM, 0);
+  if (lfd < 0) {
+    perror("fakex: socket");
+    return EXIT_FAILURE;
+  }
+  setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons((uint16_t)(6000 + cfg.display));
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      listen(lfd, 64) < 0) {
+    perror("fakex: bind");
+    return EXIT_FAILURE;
+  }
+
+  /* Tell a waiting parent that we are ready. */
+  printf("127.0.0.1:%d\n", cfg.display);
+  fflush(stdout);
+
+  for (;;) {
+    int fd = accept(lfd, NULL, NULL);
+
+    if (fd < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("fakex: accept");
+      return EXIT_FAILURE;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (fork() == 0) {
+      close(lfd);
+      serve(fd);
+      _exit(EXIT_SUCCESS);
+    }
+    close(fd);
+  }
+}
@@ -0,0 +1,65 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0-only
+#
+# Builds xprintidle with link time optimization and profile guided
+# optimization and compares it to a plain release build. The profile is
+# collected by running the workloads of bench-workloads (one-shot queries,
+# watching one and four displays) with an instrumented build.
+#
+# Usage: pgo.sh SOURCE_DIR BUILD_DIR
+#
+# The plain build ends up in BUILD_DIR/plain, the optimized one in
+# BUILD_DIR/pgo.
+#
+# This file is part of xprintidle.
+#
+# xprintidle is free software; you can redistribute it and/or modify it under
+# the terms of version 2 of the GNU General Public License as published by the
+# Free Software Foundation.
+#
+# xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+# WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+# A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along with
+# xprintidle. If not, see <https://www.gnu.org/licenses/>.
+
+set -e
+
+if [ $# -ne 2 ]; then
+  echo "usage: $0 SOURCE_DIR BUILD_DIR" >&2
+  exit 1
+fi
+src=$1
+dir=$2
+
+# setup BUILD OPTION...
+setup() {
+  build=$1
+  shift
+  if [ -d "$build" ]; then
+    set -- --reconfigure "$@"
+  fi
+  meson setup "$@" "$build" "$src"
+}
+
+setup "$dir/plain" --buildtype=release -Db_lto=false -Db_pgo=off
+meson compile -C "$dir/plain" xprintidle fakex bench-workloads
+
+echo "building the instrumented xprintidle"
+setup "$dir/pgo" --buildtype=release -Db_lto=true -Db_pgo=generate
+meson compile -C "$dir/pgo" xprintidle
+find "$dir/pgo" -name '*.gcda' -exec rm -f {} +
+
+echo "collecting the profile"
+"$dir/plain/bench-workloads" "$dir/plain/fakex" "$dir/pgo/xprintidle" \
+  >/dev/null
+
+echo "building the optimized xprintidle"
+setup "$dir/pgo" -Db_pgo=use
+meson compile -C "$dir/pgo" --clean
+meson compile -C "$dir/pgo" xprintidle
+
+echo
+"$dir/plain/bench-workloads" "$dir/plain/fakex" "$dir/plain/xprintidle" \
+  "$dir/pgo/xprintidle"
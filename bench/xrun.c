@@ -0,0 +1,226 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Helpers of the benchmarks which run xprintidle against the fake X server.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "xrun.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Most arguments passed to a program. */
+#define ARGS_MAX 16
+
+double xrun_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* qsort() comparison of doubles. */
+int xrun_cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
+
+/*
+ * This function starts the program "argv" with its stdin connected to
+ * /dev/null and its stdout to a pipe, whose reading end is written to "fd".
+ * On success the pid of the program is returned.
+ * On error -1 is returned.
+ */
+static pid_t spawn(const char *const *argv, int *fd) {
+  int fds[2];
+  pid_t pid;
+
+  if (pipe(fds) < 0)
+    return -1;
+  pid = fork();
+  if (pid == 0) {
+    int null = open("/dev/null", O_RDONLY);
+
+    dup2(null, STDIN_FILENO);
+    dup2(fds[1], STDOUT_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    execv(argv[0], (char *const *)argv);
+    _exit(127);
+  }
+  close(fds[1]);
+  if (pid < 0) {
+    close(fds[0]);
+    return -1;
+  }
+
+  *fd = fds[0];
+  return pid;
+}
+
+/*
+ * This function builds the argument vector "argv" from "prog", "first" and
+ * "second" (unless "first" is NULL) and the NULL terminated "args".
+ */
+static void build_args(const char **argv, const char *prog, const char *first,
+                       const char *second, const char *const *args) {
+  size_t n = 0;
+
+  argv[n++] = prog;
+  if (first) {
+    argv[n++] = first;
+    argv[n++] = second;
+  }
+  while (args && *args && n < ARGS_MAX - 1)
+    argv[n++] = *args++;
+  argv[n] = NULL;
+}
+
+/*
+ * This function starts the fake X server "fakex" for display "display" with
+ * the options "args" (NULL terminated) and waits until it accepts
+ * connections.
+ * On success the pid of the server is returned.
+ * On error -1 is returned.
+ */
+pid_t xrun_start_server(const char *fakex, int display,
+                        const char *const *args) {
+  const char *argv[ARGS_MAX];
+  char num[16], line[64];
+  ssize_t len;
+  pid_t pid;
+  int fd;
+
+  snprintf(num, sizeof(num), "%d", display);
+  build_args(argv, fakex, "-n", num, args);
+  pid = spawn(argv, &fd);
+  if (pid < 0) {
+    fprintf(stderr, "couldn't start %s\n", fakex);
+    return -1;
+  }
+
+  /* the server prints its address once it is listening */
+  len = read(fd, line, sizeof(line));
+  close(fd);
+  if (len <= 0) {
+    fprintf(stderr, "%s didn't start\n", fakex);
+    waitpid(pid, NULL, 0);
+    return -1;
+  }
+  return pid;
+}
+
+void xrun_stop_server(pid_t pid) {
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+}
+
+/*
+ * This function runs "xprintidle" once against display "display" (none if
+ * negative) with the additional options "args" (NULL terminated, may be
+ * NULL), writes what it printed to "out" (of "size" bytes) and its exit
+ * status to "status", and its peak RSS in KiB to "maxrss" unless NULL.
+ * On success the duration of the run in seconds is returned.
+ * On error -1 is returned.
+ */
+double xrun_run(const char *xprintidle, int display, const char *const *args,
+                char *out, size_t size, int *status, long *maxrss) {
+  const char *argv[ARGS_MAX];
+  struct rusage ru;
+  char name[32];
+  size_t len = 0;
+  double start = xrun_now();
+  pid_t pid;
+  int fd;
+
+  snprintf(name, sizeof(name), "127.0.0.1:%d", display);
+  build_args(argv, xprintidle, display < 0 ? NULL : "-d", name, args);
+  pid = spawn(argv, &fd);
+  if (pid < 0)
+    return -1;
+
+  for (;;) {
+    ssize_t ret = read(fd, out + len, size - 1 - len);
+
+    if (ret <= 0)
+      break;
+    len += (size_t)ret;
+  }
+  close(fd);
+  out[len] = '\0';
+
+  if (wait4(pid, status, 0, &ru) < 0)
+    return -1;
+  if (maxrss)
+    *maxrss = ru.ru_maxrss;
+  return xrun_now() - start;
+}
+
+/*
+ * This function runs "xprintidle" with the options "args" (NULL terminated)
+ * until it has printed "lines" lines and then stops it with SIGTERM, or, if
+ * "lines" is 0, until it exits. The CPU time it used in seconds is written to
+ * "cpu".
+ * On success the duration of the run in seconds is returned.
+ * If xprintidle failed or printed fewer lines -1 is returned.
+ */
+double xrun_lines(const char *xprintidle, const char *const *args,
+                  size_t lines, double *cpu) {
+  const char *argv[ARGS_MAX];
+  struct rusage ru;
+  char buf[4096];
+  size_t seen = 0;
+  double start = xrun_now(), end;
+  pid_t pid, ret;
+  int fd, status;
+
+  build_args(argv, xprintidle, NULL, NULL, args);
+  pid = spawn(argv, &fd);
+  if (pid < 0)
+    return -1;
+
+  while (!lines || seen < lines) {
+    ssize_t len = read(fd, buf, sizeof(buf)), i;
+
+    if (len <= 0)
+      break;
+    for (i = 0; i < len; i++)
+      seen += buf[i] == '\n';
+  }
+  end = xrun_now();
+  if (lines)
+    kill(pid, SIGTERM);
+
+  /* the pipe stays open until xprintidle exits, so the lines it prints in
+   * the meantime don't fail */
+  ret = wait4(pid, &status, 0, &ru);
+  close(fd);
+  if (ret < 0)
+    return -1;
+  *cpu = (double)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) +
+         (double)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || seen < lines)
+    return -1;
+  return end - start;
+}
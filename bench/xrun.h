@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Helpers of the benchmarks which run xprintidle against the fake X server
+ * (see fakex.c).
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_BENCH_XRUN_H
+#define XPRINTIDLE_BENCH_XRUN_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* First display numbers used by the benchmarks, well away from real servers.
+ * Each benchmark counts up from its base, so the ranges must not overlap:
+ * startup uses 66-67, dpms 70-78, journald 80, workloads 81-85, xquery
+ * 87-90 and publish 92. */
+#define XRUN_DISPLAY_STARTUP 66
+#define XRUN_DISPLAY_DPMS 70
+#define XRUN_DISPLAY_JOURNALD 80
+#define XRUN_DISPLAY_WORKLOADS 81
+#define XRUN_DISPLAY_XQUERY 87
+#define XRUN_DISPLAY_PUBLISH 92
+
+/* "127.0.0.1:N" for a display number N given as a literal or a macro. */
+#define XRUN_DISPLAY_NAME(n) "127.0.0.1:" XRUN_STR(n)
+#define XRUN_STR(x) XRUN_STR_(x)
+#define XRUN_STR_(x) #x
+
+double xrun_now(void);
+int xrun_cmp_double(const void *a, const void *b);
+pid_t xrun_start_server(const char *fakex, int display,
+                        const char *const *args);
+void xrun_stop_server(pid_t pid);
+double xrun_run(const char *xprintidle, int display, const char *const *args,
+                char *out, size_t size, int *status, long *maxrss);
+double xrun_lines(const char *xprintidle, const char *const *args,
+                  size_t lines, double *cpu);
+
+#endif /* XPRINTIDLE_BENCH_XRUN_H */
@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Binary sample stream from agents (xprintidle --send) to
+ * xprintidle-collector.
+ *
+ * A stream starts with the 4 byte magic "XPIA" followed by frames. Every
+ * frame starts with a 4 byte header: the frame type (1 byte), a reserved
+ * byte and the length of the payload (16 bit). All integers are little
+ * endian.
+ *
+ *  - COLLECTOR_FRAME_SESSION binds a session number (32 bit) of the stream to
+ *    a name (the rest of the payload, at most COLLECTOR_NAME_MAX bytes),
+ *    usually "HOST DISPLAY". Sessions are what the collector keeps state for.
+ *  - COLLECTOR_FRAME_SAMPLE carries a session number (32 bit), the time of
+ *    the sample in milliseconds since the epoch and the idle time in
+ *    milliseconds (64 bit each).
+ *
+ * Frames of unknown types are skipped, so the stream can be extended.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_COLLECTOR_H
+#define XPRINTIDLE_COLLECTOR_H
+
+#include <string.h>
+
+#define COLLECTOR_MAGIC "XPIA"
+#define COLLECTOR_MAGIC_SIZE 4
+
+#define COLLECTOR_FRAME_HEADER_SIZE 4
+#define COLLECTOR_FRAME_SESSION 1
+#define COLLECTOR_FRAME_SAMPLE 2
+
+#define COLLECTOR_SAMPLE_SIZE (COLLECTOR_FRAME_HEADER_SIZE + 20)
+
+/* Longest session name. */
+#define COLLECTOR_NAME_MAX 255
+
+/* Default port of the collector. */
+#define COLLECTOR_PORT "7627"
+
+/*
+ * This function splits the address "addr" ("HOST:PORT", "HOST", or
+ * "[ADDRESS]:PORT" for IPv6) in place into the host, which is returned, and
+ * the port, which is written to "port" (COLLECTOR_PORT if none is given).
+ * If the address is invalid NULL is returned.
+ */
+static inline char *collector_split_address(char *addr, const char **port) {
+  char *colon = strrchr(addr, ':');
+
+  *port = COLLECTOR_PORT;
+  if (addr[0] == '[') {
+    char *end = strchr(addr, ']');
+
+    if (end == NULL || (end[1] != '\0' && end[1] != ':'))
+      return NULL;
+    *end = '\0';
+    if (end[1] == ':')
+      *port = end + 2;
+    return addr + 1;
+  }
+
+  if (colon) {
+    *colon = '\0';
+    *port = colon + 1;
+  }
+  return addr;
+}
+
+#endif /* XPRINTIDLE_COLLECTOR_H */
@@ -0,0 +1,199 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Output formatting helpers shared by the one-shot and filter modes of
+ * xprintidle.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "format.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * This function parses the name of an output format as given on the command
+ * line and writes it to the "format" argument.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int parse_output_format(const char *name, enum output_format *format) {
+  if (!strcmp(name, "plain"))
+    *format = FORMAT_PLAIN;
+  else if (!strcmp(name, "human"))
+    *format = FORMAT_HUMAN;
+  else if (!strcmp(name, "ndjson"))
+    *format = FORMAT_NDJSON;
+  else
+    return -1;
+
+  return 0;
+}
+
+static const char digit_pairs[] = "00010203040506070809"
+                                  "10111213141516171819"
+                                  "20212223242526272829"
+                                  "30313233343536373839"
+                                  "40414243444546474849"
+                                  "50515253545556575859"
+                                  "60616263646566676869"
+                                  "70717273747576777879"
+                                  "80818283848586878889"
+                                  "90919293949596979899";
+
+/*
+ * This function writes the decimal representation of "value" to "buf" (which
+ * must hold at least U64_STR_MAX characters) without a terminating NUL.
+ * The number of characters written is returned.
+ */
+size_t format_u64(char *buf, uint64_t value) {
+  char tmp[U64_STR_MAX];
+  char *p = tmp + sizeof(tmp);
+  size_t len;
+
+  while (value >= 100) {
+    unsigned idx = (unsigned)(value % 100) * 2;
+    value /= 100;
+    *--p = digit_pairs[idx + 1];
+    *--p = digit_pairs[idx];
+  }
+  if (value >= 10) {
+    unsigned idx = (unsigned)value * 2;
+    *--p = digit_pairs[idx + 1];
+    *--p = digit_pairs[idx];
+  } else {
+    *--p = (char)('0' + value);
+  }
+
+  len = (size_t)(tmp + sizeof(tmp) - p);
+  memcpy(buf, p, len);
+  return len;
+}
+
+static const struct {
+  uint64_t factor;
+  const char *name;
+  size_t len;
+} human_units[] = {
+    {24 * 60 * 60 * 1000, "day", 3}, {60 * 60 * 1000, "hour", 4},
+    {60 * 1000, "minute", 6},        {1000, "second", 6},
+    {1, "millisecond", 11},
+};
+
+#define HUMAN_UNITS (sizeof(human_units) / sizeof(human_units[0]))
+
+/*
+ * This function writes miliseconds in a human-readable format to "buf" (which
+ * must hold at least HUMAN_TIME_MAX characters) without a trailing newline or
+ * NUL. The number of characters written is returned.
+ */
+size_t format_human_time(char *buf, uint64_t time) {
+  char *p = buf;
+  size_t i;
+
+  for (i = 0; i < HUMAN_UNITS; i++) {
+    uint64_t unitMag = time / human_units[i].factor;
+    time %= human_units[i].factor;
+
+    if (!unitMag)
+      continue;
+
+    if (p != buf) {
+      *p++ = ',';
+      *p++ = ' ';
+    }
+    p += format_u64(p, unitMag);
+    *p++ = ' ';
+    memcpy(p, human_units[i].name, human_units[i].len);
+    p += human_units[i].len;
+    if (unitMag != 1)
+      *p++ = 's';
+  }
+
+  /* Smallest unit would be 0. */
+  if (p == buf) {
+    *p++ = '0';
+    *p++ = ' ';
+    memcpy(p, human_units[HUMAN_UNITS - 1].name,
+           human_units[HUMAN_UNITS - 1].len);
+    p += human_units[HUMAN_UNITS - 1].len;
+    *p++ = 's';
+  }
+
+  return (size_t)(p - buf);
+}
+
+/*
+ * This function writes "str" as a quoted JSON string to "buf" (which must hold
+ * at least JSON_STRING_MAX(strlen(str)) characters) without a terminating NUL.
+ * The number of characters written is returned.
+ */
+size_t format_json_string(char *buf, const char *str) {
+  static const char hex[] = "0123456789abcdef";
+  char *p = buf;
+
+  *p++ = '"';
+  for (; *str; str++) {
+    unsigned char c = (unsigned char)*str;
+
+    if (c == '"' || c == '\\') {
+      *p++ = '\\';
+      *p++ = (char)c;
+    } else if (c < 0x20) {
+      memcpy(p, "\\u00", 4);
+      p[4] = hex[c >> 4];
+      p[5] = hex[c & 0xf];
+      p += 6;
+    } else {
+      *p++ = (char)c;
+    }
+  }
+  *p++ = '"';
+
+  return (size_t)(p - buf);
+}
+
+void outbuf_init(struct outbuf *out, int fd) {
+  out->fd = fd;
+  out->error = 0;
+  out->len = 0;
+}
+
+/*
+ * This function writes all buffered data to the file descriptor of "out".
+ * On success 0 is returned.
+ * On error -1 is returned, the buffered data is dropped and "out->error" is
+ * set to the errno of the failed write.
+ */
+int outbuf_flush(struct outbuf *out) {
+  size_t off = 0;
+
+  while (off < out->len) {
+    ssize_t ret = write(out->fd, out->data + off, out->len - off);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      out->error = errno;
+      out->len = 0;
+      return -1;
+    }
+    off += (size_t)ret;
+  }
+
+  out->len = 0;
+  return out->error ? -1 : 0;
+}
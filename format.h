@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Output formatting helpers shared by the one-shot and filter modes of
+ * xprintidle.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_FORMAT_H
+#define XPRINTIDLE_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Maximum number of characters format_u64() writes. */
+#define U64_STR_MAX 20
+
+/* Maximum number of characters format_human_time() writes. Five units with a
+ * 20 digit magnitude, a name of at most 12 characters and a separator each
+ * stay well below this. */
+#define HUMAN_TIME_MAX 192
+
+/* Maximum number of characters format_json_string() writes for a string of
+ * "len" bytes, including the quotes. */
+#define JSON_STRING_MAX(len) (6 * (len) + 2)
+
+/* Size of the buffer of struct outbuf. */
+#define OUTBUF_SIZE 65536
+
+/* A simple buffered writer on top of a file descriptor. Data is collected in
+ * "data" and handed to write(2) in chunks of OUTBUF_SIZE bytes. */
+struct outbuf {
+  int fd;
+  int error;
+  size_t len;
+  char data[OUTBUF_SIZE];
+};
+
+/* Output formats of the idle time. */
+enum output_format {
+  FORMAT_PLAIN,
+  FORMAT_HUMAN,
+  FORMAT_NDJSON,
+};
+
+int parse_output_format(const char *name, enum output_format *format);
+
+size_t format_u64(char *buf, uint64_t value);
+size_t format_human_time(char *buf, uint64_t time);
+size_t format_json_string(char *buf, const char *str);
+
+void outbuf_init(struct outbuf *out, int fd);
+int outbuf_flush(struct outbuf *out);
+
+/*
+ * This function returns a pointer to at least "size" free bytes at the end of
+ * the buffer, flushing it first if necessary. "size" must not be larger than
+ * OUTBUF_SIZE. The caller commits the bytes it used with outbuf_commit().
+ */
+static inline char *outbuf_reserve(struct outbuf *out, size_t size) {
+  if (OUTBUF_SIZE - out->len < size)
+    outbuf_flush(out);
+  return out->data + out->len;
+}
+
+static inline void outbuf_commit(struct outbuf *out, size_t len) {
+  out->len += len;
+}
+
+#endif /* XPRINTIDLE_FORMAT_H */
@@ -0,0 +1,109 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Histogram of idle period lengths, see histogram.h.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "histogram.h"
+#include "format.h"
+
+#include <string.h>
+
+/* This function returns the index of the highest bit set in "v" (not 0). */
+static unsigned msb(uint64_t v) {
+  unsigned n = 0;
+
+  if (v >> 32) {
+    v >>= 32;
+    n += 32;
+  }
+  if (v >> 16) {
+    v >>= 16;
+    n += 16;
+  }
+  if (v >> 8) {
+    v >>= 8;
+    n += 8;
+  }
+  if (v >> 4) {
+    v >>= 4;
+    n += 4;
+  }
+  if (v >> 2) {
+    v >>= 2;
+    n += 2;
+  }
+  return n + (unsigned)(v >> 1);
+}
+
+/* This function returns the bucket of a period of "value" milliseconds. */
+size_t histogram_index(uint64_t value) {
+  unsigned e;
+
+  if (value < HISTOGRAM_SUB)
+    return (size_t)value;
+  e = msb(value);
+  if (e >= HISTOGRAM_MAX_BITS)
+    return HISTOGRAM_BUCKETS - 1;
+
+  return (size_t)(e - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB +
+         (size_t)((value >> (e - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB - 1));
+}
+
+/* This function returns the smallest value of bucket "i". */
+uint64_t histogram_lower_bound(size_t i) {
+  unsigned shift;
+
+  if (i < HISTOGRAM_SUB)
+    return i;
+  shift = (unsigned)(i / HISTOGRAM_SUB) - 1;
+  return (uint64_t)(HISTOGRAM_SUB + i % HISTOGRAM_SUB) << shift;
+}
+
+/*
+ * This function writes the members "periods", "sum" and "buckets" (an array
+ * of [lower bound, count] pairs of the buckets which aren't empty) of a JSON
+ * object for "h" to "buf", which must hold at least HISTOGRAM_JSON_MAX
+ * characters. The number of characters written is returned.
+ */
+size_t histogram_format_json(char *buf, const struct histogram *h) {
+  char *p = buf;
+  size_t i;
+  int first = 1;
+
+  memcpy(p, "\"periods\":", 10);
+  p += 10;
+  p += format_u64(p, h->count);
+  memcpy(p, ",\"sum\":", 7);
+  p += 7;
+  p += format_u64(p, h->sum);
+  memcpy(p, ",\"buckets\":[", 12);
+  p += 12;
+  for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    if (h->buckets[i] == 0)
+      continue;
+    if (!first)
+      *p++ = ',';
+    first = 0;
+    *p++ = '[';
+    p += format_u64(p, histogram_lower_bound(i));
+    *p++ = ',';
+    p += format_u64(p, h->buckets[i]);
+    *p++ = ']';
+  }
+  *p++ = ']';
+
+  return (size_t)(p - buf);
+}
@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Histogram of the lengths of idle periods in milliseconds, bucketed
+ * log-linearly like HdrHistogram: values below HISTOGRAM_SUB have a bucket
+ * each, and every power of two above is split into HISTOGRAM_SUB buckets of
+ * equal width, so a bucket is at most 1/HISTOGRAM_SUB of its lower bound
+ * wide. Adding a value takes a few shifts and memory is fixed; the buckets
+ * cover periods up to 2^HISTOGRAM_MAX_BITS milliseconds (about 34 years),
+ * longer ones land in the last bucket.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_HISTOGRAM_H
+#define XPRINTIDLE_HISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HISTOGRAM_SUB_BITS 3
+#define HISTOGRAM_SUB (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_BITS 40
+#define HISTOGRAM_BUCKETS                                                      \
+  ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB)
+
+/* Longest text histogram_format_json() writes: the totals and a pair of
+ * numbers for every bucket. */
+#define HISTOGRAM_JSON_MAX                                                     \
+  (40 + 2 * 20 + HISTOGRAM_BUCKETS * (2 * 20 + 4))
+
+struct histogram {
+  /* number and total length of the periods */
+  uint64_t count;
+  uint64_t sum;
+  uint32_t buckets[HISTOGRAM_BUCKETS];
+};
+
+size_t histogram_index(uint64_t value);
+uint64_t histogram_lower_bound(size_t i);
+size_t histogram_format_json(char *buf, const struct histogram *h);
+
+/* This function adds a period of "value" milliseconds to "h". */
+static inline void histogram_add(struct histogram *h, uint64_t value) {
+  h->buckets[histogram_index(value)]++;
+  h->count++;
+  h->sum += value;
+}
+
+#endif /* XPRINTIDLE_HISTOGRAM_H */
@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Inhibit mode, see inhibit.h.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* syscall() */
+#define _DEFAULT_SOURCE
+
+#include "inhibit.h"
+#include "xext.h"
+#include "xprintidle.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static volatile pid_t child;
+
+/* This function passes SIGINT, SIGTERM and SIGHUP on to the command. */
+static void forward_signal(int sig) {
+  if (child > 0)
+    kill(child, sig);
+}
+
+static void install_forward_handlers(void) {
+  struct sigaction sa;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = forward_signal;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  sigaction(SIGHUP, &sa, NULL);
+}
+
+#ifndef XPRINTIDLE_NO_DPMS
+/*
+ * This function disables DPMS on "dpy" if it is enabled. 1 is returned if it
+ * was disabled, 0 if there was nothing to do.
+ */
+static int disable_dpms(Display *dpy) {
+  int dummy;
+  CARD16 level;
+  BOOL onoff;
+
+  if (xext_load_dpms() < 0 || !DPMSQueryExtension(dpy, &dummy, &dummy) ||
+      !DPMSCapable(dpy) || !DPMSInfo(dpy, &level, &onoff) || !onoff)
+    return 0;
+
+  DPMSDisable(dpy);
+  return 1;
+}
+#endif
+
+/*
+ * This function waits for the command "pid" to exit, sleeping until its pidfd
+ * or the X connection "xfd" becomes readable; without pidfds (before Linux
+ * 5.3) it blocks in waitpid() alone. Neither involves periodic wakeups. The
+ * wait status of the command is written to "status".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int wait_command(Display *dpy, pid_t pid, int *status) {
+  int pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+
+  if (pidfd >= 0) {
+    struct pollfd fds[2] = {{pidfd, POLLIN, 0},
+                            {ConnectionNumber(dpy), POLLIN, 0}};
+
+    while (!(fds[0].revents & POLLIN)) {
+      if (poll(fds, 2, -1) < 0) {
+        if (errno == EINTR)
+          continue;
+        fprintf(stderr, "couldn't wait for the command: %s\n",
+                strerror(errno));
+        close(pidfd);
+        return -1;
+      }
+      /* nothing is expected from the server; this notices if it went away */
+      if (fds[1].revents)
+        XPending(dpy);
+    }
+    close(pidfd);
+  }
+
+  while (waitpid(pid, status, 0) < 0) {
+    if (errno != EINTR) {
+      fprintf(stderr, "couldn't wait for the command: %s\n", strerror(errno));
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * This function suspends the screen saver of the display "name" (or $DISPLAY
+ * if "name" is NULL) and, if "dpms" is set and it is enabled, disables DPMS.
+ * Then it runs the command "argv" and waits for it to exit, after which the
+ * screen saver and DPMS are restored. The server also ends the suspension
+ * when the connection is closed, so it doesn't outlive xprintidle even if it
+ * is killed; a disabled DPMS does. SIGINT, SIGTERM and SIGHUP are passed on
+ * to the command.
+ * On success the exit status of the command is returned (128 + the signal
+ * number if it was killed by a signal, 127 if it couldn't be run).
+ * On error -1 is returned.
+ */
+int inhibit_run(const char *name, char *const argv[], int dpms) {
+  struct idle_display d;
+  int major = 0, minor = 0, status = 0, err, ret = -1;
+#ifndef XPRINTIDLE_NO_DPMS
+  int dpms_disabled = 0;
+#endif
+  pid_t pid;
+
+  if (idle_display_open(&d, name, 0) < 0)
+    return -1;
+
+  /* Suspend needs version 1.1 of the extension */
+  if (!XScreenSaverQueryVersion(d.dpy, &major, &minor) ||
+      (major < 1 || (major == 1 && minor < 1))) {
+    fprintf(stderr, "screen saver suspension not supported\n");
+    goto out;
+  }
+  fcntl(ConnectionNumber(d.dpy), F_SETFD, FD_CLOEXEC);
+
+  XScreenSaverSuspend(d.dpy, True);
+#ifndef XPRINTIDLE_NO_DPMS
+  if (dpms)
+    dpms_disabled = disable_dpms(d.dpy);
+#else
+  if (dpms)
+    fprintf(stderr, "built without DPMS support, leaving it alone\n");
+#endif
+  XFlush(d.dpy);
+
+  err = posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ);
+  if (err) {
+    fprintf(stderr, "couldn't run '%s': %s\n", argv[0], strerror(err));
+    ret = 127;
+  } else {
+    child = pid;
+    install_forward_handlers();
+    if (wait_command(d.dpy, pid, &status) == 0) {
+      if (WIFSIGNALED(status))
+        ret = 128 + WTERMSIG(status);
+      else
+        ret = WEXITSTATUS(status);
+    }
+    child = 0;
+  }
+
+  XScreenSaverSuspend(d.dpy, False);
+#ifndef XPRINTIDLE_NO_DPMS
+  if (dpms_disabled)
+    DPMSEnable(d.dpy);
+#endif
+  XSync(d.dpy, False);
+
+out:
+  idle_display_close(&d);
+  return ret;
+}
@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Inhibit mode of xprintidle (--inhibit -- CMD): keeps the screen saver of a
+ * display suspended, and optionally DPMS disabled, while a command runs,
+ * instead of resetting the screen saver periodically.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_INHIBIT_H
+#define XPRINTIDLE_INHIBIT_H
+
+#ifdef XPRINTIDLE_NO_INHIBIT
+
+/* Built without the "inhibit" feature, --inhibit isn't accepted. */
+static inline int inhibit_run(const char *name, char *const argv[],
+                              int dpms) {
+  (void)name;
+  (void)argv;
+  (void)dpms;
+  return -1;
+}
+
+#else
+
+int inhibit_run(const char *name, char *const argv[], int dpms);
+
+#endif /* XPRINTIDLE_NO_INHIBIT */
+
+#endif /* XPRINTIDLE_INHIBIT_H */
@@ -0,0 +1,256 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Input event counters from XI2 raw events, see input.h.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "input.h"
+
+#include <X11/Xlibint.h>
+#include <X11/extensions/XI2.h>
+#include <X11/extensions/XI2proto.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MINUTE 60000
+
+/* Longest span of motion events coalesced, in server milliseconds. */
+#define COALESCE_MS 16
+
+/* Counters with a handler installed, to find the one of a display. */
+static struct input_counter *counters;
+
+static int failed;
+
+static int record_error(Display *dpy, XErrorEvent *ev) {
+  (void)dpy;
+  (void)ev;
+  failed = 1;
+  return 0;
+}
+
+/* This function adds the motion coalesced so far to "ic". */
+static void end_motion(struct input_counter *ic) {
+  if (ic->dx != 0 || ic->dy != 0)
+    ic->motion += sqrt(ic->dx * ic->dx + ic->dy * ic->dy);
+  ic->dx = ic->dy = 0;
+}
+
+/*
+ * This function adds the motion of the raw event "ev" with "len" bytes of
+ * valuator data after the header to the deltas being coalesced: the
+ * (accelerated) values of valuators 0 and 1, which follow the valuator mask.
+ * Events of another device or more than COALESCE_MS after the first one
+ * coalesced start anew, so motion back and forth doesn't cancel out.
+ */
+static void add_motion(struct input_counter *ic, const xXIRawEvent *ev,
+                       size_t len) {
+  const unsigned char *mask = (const unsigned char *)(ev + 1);
+  size_t mask_len = (size_t)ev->valuators_len * 4, bits = mask_len * 8, i;
+  const unsigned char *values = mask + mask_len;
+  double d[2] = {0, 0};
+  size_t n = 0;
+
+  if (ev->sourceid != ic->device || ev->time - ic->since > COALESCE_MS) {
+    end_motion(ic);
+    ic->device = ev->sourceid;
+    ic->since = ev->time;
+  }
+
+  for (i = 0; i < bits && i < 2; i++) {
+    FP3232 v;
+
+    if (!(mask[i / 8] & (1 << (i % 8))))
+      continue;
+    if (mask_len + (n + 1) * sizeof(v) > len)
+      return;
+    memcpy(&v, values + n * sizeof(v), sizeof(v));
+    d[i] = v.integral + v.frac / 4294967296.0;
+    n++;
+  }
+
+  ic->dx += d[0];
+  ic->dy += d[1];
+}
+
+/*
+ * This function is the wire-to-event handler of generic events. It counts the
+ * raw events of the counter of "dpy" and drops all events, so none of them is
+ * queued.
+ */
+static Bool count_event(Display *dpy, XEvent *event, xEvent *wire) {
+  const xXIRawEvent *ev = (const xXIRawEvent *)wire;
+  struct input_counter *ic;
+
+  (void)event;
+  for (ic = counters; ic && ic->dpy != dpy; ic = ic->next)
+    ;
+  if (ic == NULL || ev->extension != ic->opcode)
+    return False;
+
+  switch (ev->evtype) {
+  case XI_RawKeyPress:
+    if (!(ev->flags & XIKeyRepeat))
+      ic->current.keys++;
+    break;
+  case XI_RawButtonPress:
+    if (ev->detail < 4 || ev->detail > 7)
+      ic->current.clicks++;
+    break;
+  case XI_RawMotion:
+    add_motion(ic, ev, (size_t)ev->length * 4);
+    break;
+  default:
+    break;
+  }
+
+  return False;
+}
+
+/*
+ * This function announces version 2.0 of the X Input extension with
+ * "opcode" to the server of "dpy" and selects the raw events of the master
+ * devices on the root window.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int select_raw_events(Display *dpy, int opcode) {
+  XErrorHandler old = XSetErrorHandler(record_error);
+  xXIQueryVersionReq *vreq;
+  xXIQueryVersionReply vrep;
+  xXISelectEventsReq *sreq;
+  struct {
+    xXIEventMask head;
+    uint32_t bits;
+  } mask;
+  int ok;
+
+  failed = 0;
+  LockDisplay(dpy);
+  GetReq(XIQueryVersion, vreq);
+  vreq->reqType = (CARD8)opcode;
+  vreq->ReqType = X_XIQueryVersion;
+  vreq->major_version = 2;
+  vreq->minor_version = 0;
+  ok = _XReply(dpy, (xReply *)&vrep, 0, xTrue) && !failed &&
+       vrep.major_version >= 2;
+
+  if (ok) {
+    GetReq(XISelectEvents, sreq);
+    sreq->reqType = (CARD8)opcode;
+    sreq->ReqType = X_XISelectEvents;
+    sreq->win = DefaultRootWindow(dpy);
+    sreq->num_masks = 1;
+    sreq->length += sizeof(mask) / 4;
+    mask.head.deviceid = XIAllMasterDevices;
+    mask.head.mask_len = 1;
+    mask.bits = XI_RawKeyPressMask | XI_RawButtonPressMask | XI_RawMotionMask;
+    Data(dpy, (const char *)&mask, sizeof(mask));
+  }
+  UnlockDisplay(dpy);
+  SyncHandle();
+
+  if (ok) {
+    XSync(dpy, False);
+    ok = !failed;
+  }
+  XSetErrorHandler(old);
+
+  return ok ? 0 : -1;
+}
+
+/*
+ * This function starts counting the input events of the display "dpy" in
+ * "ic", with the current minute being the one of "now" (milliseconds since
+ * the epoch).
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int input_open(struct input_counter *ic, Display *dpy, uint64_t now) {
+  int event, error;
+
+  memset(ic, 0, sizeof(*ic));
+  ic->dpy = dpy;
+  ic->device = -1;
+  ic->current.time = now - now % MINUTE;
+
+  if (!XQueryExtension(dpy, "XInputExtension", &ic->opcode, &event,
+                       &error)) {
+    fprintf(stderr, "X input extension not supported\n");
+    return -1;
+  }
+
+  ic->next = counters;
+  counters = ic;
+  ic->old = XESetWireToEvent(dpy, GenericEvent, count_event);
+
+  if (select_raw_events(dpy, ic->opcode) < 0) {
+    fprintf(stderr, "couldn't select raw input events\n");
+    input_close(ic);
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * This function reads the events which have arrived on the connection of
+ * "ic" without blocking, which counts them, and ends the motion being
+ * coalesced.
+ */
+void input_read(struct input_counter *ic) {
+  XEventsQueued(ic->dpy, QueuedAfterReading);
+  end_motion(ic);
+}
+
+/*
+ * This function moves the counts of the current minute of "ic" to the past
+ * minutes if the minute is over at "now". If it did 1 is returned, otherwise
+ * 0.
+ */
+int input_tick(struct input_counter *ic, uint64_t now) {
+  uint64_t minute = now - now % MINUTE;
+
+  if (minute == ic->current.time)
+    return 0;
+
+  end_motion(ic);
+  ic->current.motion = (uint64_t)(ic->motion + 0.5);
+  ic->ring[ic->head] = ic->current;
+  ic->head = (ic->head + 1) % INPUT_MINUTES;
+  if (ic->n < INPUT_MINUTES)
+    ic->n++;
+
+  memset(&ic->current, 0, sizeof(ic->current));
+  ic->current.time = minute;
+  ic->motion = 0;
+  return 1;
+}
+
+/* This function stops counting the input events of "ic". */
+void input_close(struct input_counter *ic) {
+  struct input_counter **p;
+
+  XESetWireToEvent(ic->dpy, GenericEvent, ic->old);
+  for (p = &counters; *p; p = &(*p)->next) {
+    if (*p == ic) {
+      *p = ic->next;
+      break;
+    }
+  }
+}
@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Input event counters of the watch mode (--input): keystrokes, clicks and
+ * pointer motion distance per minute, from the raw events of the X Input
+ * extension 2 (XI_RawKeyPress, XI_RawButtonPress and XI_RawMotion of the
+ * master devices, selected on the root window).
+ *
+ * Like the probe cache, this speaks the protocol directly instead of going
+ * through libXi: the raw events are counted by a wire-to-event handler for
+ * generic events, which Xlib calls while it reads the connection and which
+ * drops them afterwards, so they are never allocated or queued. The
+ * connection isn't watched for them; they are read along with the reply of
+ * the next idle time query, so counting costs no wakeups. Generic events of
+ * other extensions are dropped as well; xprintidle doesn't select any.
+ * Auto-repeated keys and the wheel buttons (4 to 7) aren't counted. The raw
+ * motion deltas of consecutive events of the same device within a few
+ * milliseconds are summed up and only then turned into a distance (in pixels,
+ * after acceleration); relative pointer devices are assumed.
+ *
+ * The counts are collected in the current minute of the wall clock, and
+ * moved to a ring of the last INPUT_MINUTES minutes by input_tick() once the
+ * minute is over. Events read after the end of a minute but before the tick,
+ * i.e. at most one watch interval late, still count towards it.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_INPUT_H
+#define XPRINTIDLE_INPUT_H
+
+#include <X11/Xlib.h>
+#include <X11/Xproto.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Number of past minutes kept. */
+#define INPUT_MINUTES 60
+
+/* The counts of one minute. */
+struct input_minute {
+  /* start of the minute in milliseconds since the epoch */
+  uint64_t time;
+  uint32_t keys;
+  uint32_t clicks;
+  /* pointer motion in pixels */
+  uint64_t motion;
+};
+
+struct input_counter {
+  Display *dpy;
+  int opcode;
+  /* wire-to-event handler of generic events before input_open() */
+  Bool (*old)(Display *, XEvent *, xEvent *);
+  struct input_minute current;
+  /* motion not yet added to "current" */
+  double motion;
+  /* deltas of the motion events being coalesced, their device and the
+   * server time of the first one */
+  double dx, dy;
+  int device;
+  uint32_t since;
+  /* the past minutes are ring[(head - n + i) % INPUT_MINUTES] */
+  struct input_minute ring[INPUT_MINUTES];
+  size_t head, n;
+  /* next counter with a handler installed */
+  struct input_counter *next;
+};
+
+#ifdef XPRINTIDLE_NO_XI2
+
+/* Built without the "xi2" feature, --input isn't accepted. */
+static inline int input_open(struct input_counter *ic, Display *dpy,
+                             uint64_t now) {
+  (void)ic;
+  (void)dpy;
+  (void)now;
+  return -1;
+}
+static inline void input_read(struct input_counter *ic) { (void)ic; }
+static inline int input_tick(struct input_counter *ic, uint64_t now) {
+  (void)ic;
+  (void)now;
+  return 0;
+}
+static inline void input_close(struct input_counter *ic) { (void)ic; }
+
+#else
+
+int input_open(struct input_counter *ic, Display *dpy, uint64_t now);
+void input_read(struct input_counter *ic);
+int input_tick(struct input_counter *ic, uint64_t now);
+void input_close(struct input_counter *ic);
+
+#endif /* XPRINTIDLE_NO_XI2 */
+
+/* This function returns the latest past minute of "ic". */
+static inline const struct input_minute *
+input_last(const struct input_counter *ic) {
+  return &ic->ring[(ic->head + INPUT_MINUTES - 1) % INPUT_MINUTES];
+}
+
+#endif /* XPRINTIDLE_INPUT_H */
@@ -0,0 +1,217 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Write-ahead journal with group commit for the samples of the timeline
+ * recorder. Samples are collected in memory and written and fdatasync()ed
+ * together by journal_commit(). When to commit is up to the caller; only a
+ * full buffer is committed right away.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "journal.h"
+#include "timeline.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void put32(unsigned char *p, uint32_t v) {
+  p[0] = (unsigned char)v;
+  p[1] = (unsigned char)(v >> 8);
+  p[2] = (unsigned char)(v >> 16);
+  p[3] = (unsigned char)(v >> 24);
+}
+
+static void put64(unsigned char *p, uint64_t v) {
+  put32(p, (uint32_t)v);
+  put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint32_t get32(const unsigned char *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+static uint64_t get64(const unsigned char *p) {
+  return (uint64_t)get32(p) | (uint64_t)get32(p + 4) << 32;
+}
+
+/*
+ * This function opens the journal "path" for appending, creating it if it
+ * doesn't exist yet. Existing records must have been recovered with
+ * journal_recover() before.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int journal_open(struct journal *j, const char *path) {
+  j->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (j->fd < 0) {
+    fprintf(stderr, "couldn't open journal '%s': %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  j->pending = 0;
+
+  return 0;
+}
+
+/*
+ * This function adds "rec" to the pending records of "j" and commits them if
+ * the buffer is full.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int journal_append(struct journal *j, const struct journal_record *rec) {
+  unsigned char *p = j->buf + j->pending * JOURNAL_RECORD_SIZE;
+
+  put32(p, rec->series);
+  put64(p + 4, rec->time);
+  put64(p + 12, rec->idle);
+  put32(p + 20, tl_crc32(0, p, 20));
+
+  if (++j->pending == JOURNAL_BUFFER_RECORDS)
+    return journal_commit(j);
+
+  return 0;
+}
+
+/*
+ * This function writes all pending records of "j" and waits until they are
+ * on disk.
+ * On success 0 is returned.
+ * On error -1 is returned. The part of the records which was written is cut
+ * off again, so they are written whole by the next commit; if that fails,
+ * they are dropped instead of being written after a torn record.
+ */
+int journal_commit(struct journal *j) {
+  size_t len = j->pending * JOURNAL_RECORD_SIZE, off = 0;
+  off_t start;
+
+  if (len == 0)
+    return 0;
+  start = lseek(j->fd, 0, SEEK_END);
+  if (start < 0) {
+    fprintf(stderr, "couldn't seek journal: %s\n", strerror(errno));
+    return -1;
+  }
+
+  while (off < len) {
+    ssize_t ret = write(j->fd, j->buf + off, len - off);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      fprintf(stderr, "couldn't write journal: %s\n", strerror(errno));
+      if (off && ftruncate(j->fd, start) < 0) {
+        fprintf(stderr, "couldn't truncate journal: %s\n", strerror(errno));
+        j->pending = 0;
+      }
+      return -1;
+    }
+    off += (size_t)ret;
+  }
+  j->pending = 0;
+
+  if (fdatasync(j->fd) < 0) {
+    fprintf(stderr, "couldn't sync journal: %s\n", strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * This function drops all records of "j", pending or not. It is called once
+ * all journaled samples are safely stored elsewhere.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int journal_reset(struct journal *j) {
+  j->pending = 0;
+
+  if (ftruncate(j->fd, 0) < 0) {
+    fprintf(stderr, "couldn't truncate journal: %s\n", strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+void journal_close(struct journal *j) {
+  journal_commit(j);
+  close(j->fd);
+}
+
+/*
+ * This function reads all valid records of the journal "path" into a newly
+ * allocated array which is written to "recs", the number of records to "n".
+ * Reading stops at the first record with a bad checksum, which is what a
+ * write torn by a crash looks like. A missing journal has no records.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int journal_recover(const char *path, struct journal_record **recs,
+                    size_t *n) {
+  unsigned char rec[JOURNAL_RECORD_SIZE];
+  struct stat st;
+  size_t cap, off = 0;
+  int fd;
+
+  *recs = NULL;
+  *n = 0;
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    if (errno == ENOENT)
+      return 0;
+    fprintf(stderr, "couldn't open journal '%s': %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  if (fstat(fd, &st) < 0) {
+    fprintf(stderr, "couldn't stat journal '%s': %s\n", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  cap = (size_t)st.st_size / JOURNAL_RECORD_SIZE;
+  if (cap && (*recs = malloc(cap * sizeof(**recs))) == NULL) {
+    fprintf(stderr, "couldn't allocate journal records\n");
+    close(fd);
+    return -1;
+  }
+
+  while (*n < cap && pread(fd, rec, sizeof(rec), (off_t)off) ==
+                         (ssize_t)sizeof(rec)) {
+    if (tl_crc32(0, rec, 20) != get32(rec + 20))
+      break;
+    (*recs)[*n].series = get32(rec);
+    (*recs)[*n].time = get64(rec + 4);
+    (*recs)[*n].idle = get64(rec + 12);
+    (*n)++;
+    off += sizeof(rec);
+  }
+
+  if (off < (size_t)st.st_size)
+    fprintf(stderr, "journal '%s': dropping %zu bytes of torn records\n", path,
+            (size_t)st.st_size - off);
+
+  close(fd);
+  return 0;
+}
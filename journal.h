@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Write-ahead journal with group commit for the samples of the timeline
+ * recorder.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_JOURNAL_H
+#define XPRINTIDLE_JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A record is the series (u32), the time (u64), the idle time (u64) and a
+ * CRC-32 of those 20 bytes, all little endian. */
+#define JOURNAL_RECORD_SIZE 24
+
+/* Maximum number of records committed at once. */
+#define JOURNAL_BUFFER_RECORDS 1024
+
+struct journal_record {
+  uint32_t series;
+  uint64_t time;
+  uint64_t idle;
+};
+
+struct journal {
+  int fd;
+  size_t pending;
+  unsigned char buf[JOURNAL_BUFFER_RECORDS * JOURNAL_RECORD_SIZE];
+};
+
+int journal_open(struct journal *j, const char *path);
+int journal_append(struct journal *j, const struct journal_record *rec);
+int journal_commit(struct journal *j);
+int journal_reset(struct journal *j);
+void journal_close(struct journal *j);
+
+int journal_recover(const char *path, struct journal_record **recs,
+                    size_t *n);
+
+#endif /* XPRINTIDLE_JOURNAL_H */
@@ -0,0 +1,254 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Journal sink of the watch mode, see journald.h.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "journald.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The fields which are the same for all entries. */
+static const char constant_fields[] =
+    "SYSLOG_IDENTIFIER=xprintidle\nPRIORITY=6\n";
+
+/* A field which is written as is. */
+struct field {
+  const char *text;
+  size_t len;
+};
+
+#define FIELD(text) {text, sizeof(text) - 1}
+
+/* The DPMS_STATE field of every power level. */
+static const struct field dpms_fields[] = {
+    FIELD("DPMS_STATE=on\n"),
+    FIELD("DPMS_STATE=standby\n"),
+    FIELD("DPMS_STATE=suspend\n"),
+    FIELD("DPMS_STATE=off\n"),
+};
+
+/* The TRANSITION field of SAMPLE_TO_IDLE and SAMPLE_TO_ACTIVE. */
+static const struct field transition_fields[] = {
+    FIELD("TRANSITION=idle\n"),
+    FIELD("TRANSITION=active\n"),
+};
+
+static void put64(unsigned char *p, uint64_t v) {
+  int i;
+
+  for (i = 0; i < 8; i++)
+    p[i] = (unsigned char)(v >> (8 * i));
+}
+
+/*
+ * This function writes the field "name" with the value "value" of "len" bytes
+ * to "buf" in the binary format of the native protocol, which allows any
+ * bytes in the value: the name and a newline, the length of the value as 64
+ * bit little endian number, the value and a newline. The number of bytes
+ * written is returned.
+ */
+static size_t put_field(char *buf, const char *name, const char *value,
+                        size_t len) {
+  size_t name_len = strlen(name);
+
+  memcpy(buf, name, name_len);
+  buf[name_len] = '\n';
+  put64((unsigned char *)buf + name_len + 1, len);
+  memcpy(buf + name_len + 9, value, len);
+  buf[name_len + 9 + len] = '\n';
+  return name_len + 10 + len;
+}
+
+/*
+ * This function prepares "j" to write the samples of the displays "names" to
+ * the journal socket "path".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int journald_open(struct journald *j, const char *path, const char **names,
+                  size_t n) {
+  size_t i, size = 0;
+  char *p;
+
+  if (strlen(path) >= sizeof(j->addr.sun_path)) {
+    fprintf(stderr, "socket path '%s' too long\n", path);
+    return -1;
+  }
+  memset(&j->addr, 0, sizeof(j->addr));
+  j->addr.sun_family = AF_UNIX;
+  strcpy(j->addr.sun_path, path);
+
+  for (i = 0; i < n; i++)
+    size += sizeof("DISPLAY\n") + 8 + strlen(names[i]);
+  j->display = malloc(n * sizeof(*j->display));
+  j->fields = malloc(size);
+  j->msgs = calloc(JOURNALD_BATCH_MAX, sizeof(*j->msgs));
+  if (j->display == NULL || j->fields == NULL || j->msgs == NULL) {
+    fprintf(stderr, "couldn't allocate journal entries\n");
+    free(j->display);
+    free(j->fields);
+    free(j->msgs);
+    return -1;
+  }
+
+  p = j->fields;
+  for (i = 0; i < n; i++) {
+    j->display[i].iov_base = p;
+    j->display[i].iov_len = put_field(p, "DISPLAY", names[i], strlen(names[i]));
+    p += j->display[i].iov_len;
+  }
+
+  for (i = 0; i < JOURNALD_BATCH_MAX; i++) {
+    struct journald_entry *e = &j->entries[i];
+    struct msghdr *msg = &j->msgs[i].msg_hdr;
+
+    e->iov[0].iov_base = (void *)constant_fields;
+    e->iov[0].iov_len = sizeof(constant_fields) - 1;
+    msg->msg_name = &j->addr;
+    msg->msg_namelen = sizeof(j->addr);
+    msg->msg_iov = e->iov;
+    msg->msg_iovlen = JOURNALD_IOVS;
+  }
+
+  j->fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (j->fd < 0) {
+    fprintf(stderr, "couldn't create socket: %s\n", strerror(errno));
+    free(j->display);
+    free(j->fields);
+    free(j->msgs);
+    return -1;
+  }
+
+  j->names = names;
+  j->n = n;
+  j->dropped = 0;
+  j->pending = 0;
+  return 0;
+}
+
+/*
+ * This function queues the sample "s" as a journal entry of the sink "ctx"
+ * (a struct journald). Its iovecs are the constant fields, the DISPLAY field
+ * of the display, the head of the binary MESSAGE field, the display name and
+ * the rest formatted into the slot of the entry. If all slots are taken, the
+ * pending entries are sent first.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int journald_write(void *ctx, const struct sample *s) {
+  struct journald *j = ctx;
+  const char *name = j->names[s->display];
+  size_t name_len = strlen(name);
+  struct journald_entry *e;
+  char *tail, *p;
+
+  if (j->pending == JOURNALD_BATCH_MAX && journald_flush(j) < 0)
+    return -1;
+  e = &j->entries[j->pending++];
+
+  /* the message after the display name */
+  tail = p = e->slot + 16;
+  memcpy(p, " idle ", 6);
+  p += 6;
+  p += format_u64(p, s->idle);
+  memcpy(p, " ms", 3);
+  p += 3;
+  if (s->transition == SAMPLE_TO_IDLE) {
+    memcpy(p, ", now idle", 10);
+    p += 10;
+  } else if (s->transition == SAMPLE_TO_ACTIVE) {
+    memcpy(p, ", now active", 12);
+    p += 12;
+  }
+  memcpy(e->slot, "MESSAGE\n", 8);
+  put64((unsigned char *)e->slot + 8, name_len + (size_t)(p - tail));
+  *p++ = '\n';
+
+  memcpy(p, "IDLE_MS=", 8);
+  p += 8;
+  p += format_u64(p, s->idle);
+  *p++ = '\n';
+  if (s->dpms >= 0 && s->dpms < 4) {
+    memcpy(p, dpms_fields[s->dpms].text, dpms_fields[s->dpms].len);
+    p += dpms_fields[s->dpms].len;
+  }
+  if (s->transition != SAMPLE_STEADY) {
+    const struct field *f =
+        &transition_fields[s->transition == SAMPLE_TO_IDLE ? 0 : 1];
+
+    memcpy(p, f->text, f->len);
+    p += f->len;
+  }
+
+  e->iov[1] = j->display[s->display];
+  e->iov[2].iov_base = e->slot;
+  e->iov[2].iov_len = 16;
+  e->iov[3].iov_base = (void *)name;
+  e->iov[3].iov_len = name_len;
+  e->iov[4].iov_base = tail;
+  e->iov[4].iov_len = (size_t)(p - tail);
+  return 0;
+}
+
+/*
+ * This function sends the pending entries of the sink "ctx" (a struct
+ * journald) to the journal, as many per system call as possible. If journald
+ * doesn't keep up, the entries which don't fit are dropped.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int journald_flush(void *ctx) {
+  struct journald *j = ctx;
+  size_t sent = 0;
+
+  while (sent < j->pending) {
+    int ret = sendmmsg(j->fd, j->msgs + sent, (unsigned)(j->pending - sent),
+                       MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+        j->dropped += j->pending - sent;
+        break;
+      }
+      fprintf(stderr, "couldn't write to journal socket '%s': %s\n",
+              j->addr.sun_path, strerror(errno));
+      j->pending = 0;
+      return -1;
+    }
+    sent += (size_t)ret;
+  }
+
+  j->pending = 0;
+  return 0;
+}
+
+void journald_close(struct journald *j) {
+  if (j->dropped)
+    fprintf(stderr, "%llu journal entries dropped\n",
+            (unsigned long long)j->dropped);
+  close(j->fd);
+  free(j->display);
+  free(j->fields);
+  free(j->msgs);
+}
@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Journal sink of the watch mode (--journal): writes every sample as a
+ * structured entry to the native socket of systemd-journald, without a logger
+ * process in between. An entry has the fields
+ *
+ *   MESSAGE      "DISPLAY idle MS ms", plus ", now idle" or ", now active"
+ *   DISPLAY      the display name
+ *   IDLE_MS      the idle time in milliseconds
+ *   DPMS_STATE   on, standby, suspend or off, if known
+ *   TRANSITION   idle or active, if the display just changed between them
+ *
+ * and SYSLOG_IDENTIFIER=xprintidle and PRIORITY=6. Each entry is one datagram
+ * gathered from iovecs: a constant part, the DISPLAY field prepared for every
+ * display by journald_open(), the display name and the numbers formatted into
+ * the preallocated slot of the entry. The pending entries are sent with a
+ * single sendmmsg() per flush. Entries which don't fit into the socket buffer
+ * of journald are dropped; other errors fail the sink.
+ *
+ * The socket path can be given, e.g. to point it at a datagram socket of a
+ * test instead of journald.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_JOURNALD_H
+#define XPRINTIDLE_JOURNALD_H
+
+#include "format.h"
+#include "sink.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+/* Socket of journald. */
+#define JOURNALD_SOCKET "/run/systemd/journal/socket"
+
+/* Most entries sent with one sendmmsg(); more pending ones are sent early. */
+#define JOURNALD_BATCH_MAX 64
+
+/* Size of the formatted part of an entry: the length of the message in the
+ * binary field format, the rest of the message and the other fields. */
+#define JOURNALD_SLOT_SIZE                                                     \
+  (16 + sizeof(" idle  ms, now active\n") + U64_STR_MAX +                      \
+   sizeof("IDLE_MS=\n") + U64_STR_MAX + sizeof("DPMS_STATE=standby\n") +       \
+   sizeof("TRANSITION=active\n"))
+
+/* Number of iovecs of an entry. */
+#define JOURNALD_IOVS 5
+
+struct journald_entry {
+  struct iovec iov[JOURNALD_IOVS];
+  char slot[JOURNALD_SLOT_SIZE];
+};
+
+struct journald {
+  int fd;
+  struct sockaddr_un addr;
+  const char **names;
+  size_t n;
+  /* the binary DISPLAY field of every display */
+  struct iovec *display;
+  char *fields;
+  /* entries dropped because journald didn't keep up */
+  uint64_t dropped;
+  size_t pending;
+  /* JOURNALD_BATCH_MAX messages, one per entry */
+  struct mmsghdr *msgs;
+  struct journald_entry entries[JOURNALD_BATCH_MAX];
+};
+
+#ifdef XPRINTIDLE_NO_JOURNALD
+
+/* Built without the "journald" feature, --journal isn't accepted. */
+static inline int journald_open(struct journald *j, const char *path,
+                                const char **names, size_t n) {
+  (void)j;
+  (void)path;
+  (void)names;
+  (void)n;
+  return -1;
+}
+static inline int journald_write(void *ctx, const struct sample *s) {
+  (void)ctx;
+  (void)s;
+  return -1;
+}
+static inline int journald_flush(void *ctx) {
+  (void)ctx;
+  return -1;
+}
+static inline void journald_close(struct journald *j) { (void)j; }
+
+#else
+
+int journald_open(struct journald *j, const char *path, const char **names,
+                  size_t n);
+int journald_write(void *ctx, const struct sample *s);
+int journald_flush(void *ctx);
+void journald_close(struct journald *j);
+
+#endif /* XPRINTIDLE_NO_JOURNALD */
+
+#endif /* XPRINTIDLE_JOURNALD_H */
@@ -0,0 +1,154 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Interned names, see names.h.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "names.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* FNV-1a, folded to 32 bit. */
+static uint32_t hash_name(const char *name, size_t len) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    h ^= (unsigned char)name[i];
+    h *= 0x100000001b3ULL;
+  }
+  return (uint32_t)(h ^ h >> 32);
+}
+
+/*
+ * This function doubles the number of slots of "t" and reinserts all names.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int grow_slots(struct names *t) {
+  size_t size = t->slots ? (t->mask + 1) * 2 : 64;
+  struct names_slot *slots = calloc(size, sizeof(*slots));
+  size_t i;
+
+  if (slots == NULL)
+    return -1;
+
+  for (i = 0; i <= t->mask && t->slots; i++) {
+    size_t j;
+
+    if (t->slots[i].index == 0)
+      continue;
+    for (j = t->slots[i].hash & (size - 1); slots[j].index;
+         j = (j + 1) & (size - 1))
+      ;
+    slots[j] = t->slots[i];
+  }
+
+  free(t->slots);
+  t->slots = slots;
+  t->mask = size - 1;
+  return 0;
+}
+
+/*
+ * This function returns the index of the name "name" of length "len" in "t",
+ * or -1 if it isn't there.
+ */
+long names_find(const struct names *t, const char *name, size_t len) {
+  uint32_t hash = hash_name(name, len);
+  size_t i;
+
+  if (t->slots == NULL)
+    return -1;
+  for (i = hash & t->mask; t->slots[i].index; i = (i + 1) & t->mask) {
+    const char *other;
+
+    if (t->slots[i].hash != hash)
+      continue;
+    other = names_get(t, t->slots[i].index - 1);
+    if (strncmp(other, name, len) == 0 && other[len] == '\0')
+      return (long)t->slots[i].index - 1;
+  }
+  return -1;
+}
+
+/*
+ * This function makes room in "t" for one more name of length "len".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int names_reserve(struct names *t, size_t len) {
+  if ((t->n + 1) * 10 > (t->mask + 1) * 7 && grow_slots(t) < 0)
+    goto fail;
+
+  if (t->n == t->cap) {
+    size_t cap = t->cap ? t->cap * 2 : 32;
+    uint32_t *offset = realloc(t->offset, cap * sizeof(*offset));
+
+    if (offset == NULL)
+      goto fail;
+    t->offset = offset;
+    t->cap = cap;
+  }
+
+  if (t->pool_cap - t->pool_len < len + 1) {
+    size_t cap = t->pool_cap ? t->pool_cap * 2 : 4096;
+    char *pool;
+
+    while (cap - t->pool_len < len + 1)
+      cap *= 2;
+    pool = realloc(t->pool, cap);
+    if (pool == NULL)
+      goto fail;
+    t->pool = pool;
+    t->pool_cap = cap;
+  }
+
+  return 0;
+
+fail:
+  fprintf(stderr, "couldn't allocate names\n");
+  return -1;
+}
+
+/*
+ * This function adds the name "name" of length "len", which isn't in "t"
+ * yet, after room was made for it with names_reserve(). The index of the name
+ * is returned.
+ */
+size_t names_add(struct names *t, const char *name, size_t len) {
+  uint32_t hash = hash_name(name, len);
+  size_t i;
+
+  for (i = hash & t->mask; t->slots[i].index; i = (i + 1) & t->mask)
+    ;
+  t->slots[i].hash = hash;
+  t->slots[i].index = (uint32_t)t->n + 1;
+
+  t->offset[t->n] = (uint32_t)t->pool_len;
+  memcpy(t->pool + t->pool_len, name, len);
+  t->pool[t->pool_len + len] = '\0';
+  t->pool_len += len + 1;
+  return t->n++;
+}
+
+void names_free(struct names *t) {
+  free(t->slots);
+  free(t->offset);
+  free(t->pool);
+  memset(t, 0, sizeof(*t));
+}
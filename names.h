@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Interned names (the applications of --apps, the hosts of the collector),
+ * numbered densely in the order they were added, so their users keep the
+ * rest of their state in columns indexed by that number. The names are
+ * stored one after the other in a string pool and found through an open
+ * addressing hash table of (hash, index) slots with linear probing, so a
+ * lookup touches a few cache lines.
+ *
+ * Adding a name is split into names_reserve(), which can fail, and
+ * names_add(), which can't, so a user can grow its own columns in between
+ * and never ends up with a name without state or the other way round.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_NAMES_H
+#define XPRINTIDLE_NAMES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A slot of the hash table; index is the name index + 1, 0 if empty. */
+struct names_slot {
+  uint32_t hash;
+  uint32_t index;
+};
+
+/* An empty table is all zeros. */
+struct names {
+  struct names_slot *slots;
+  size_t mask;
+  size_t n, cap;
+  /* offset of every name in "pool" */
+  uint32_t *offset;
+  char *pool;
+  size_t pool_len, pool_cap;
+};
+
+long names_find(const struct names *t, const char *name, size_t len);
+int names_reserve(struct names *t, size_t len);
+size_t names_add(struct names *t, const char *name, size_t len);
+void names_free(struct names *t);
+
+/* This function returns name "i" of "t". */
+static inline const char *names_get(const struct names *t, size_t i) {
+  return t->pool + t->offset[i];
+}
+
+#endif /* XPRINTIDLE_NAMES_H */
@@ -0,0 +1,299 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Probe cache of the one-shot mode and the requests issued with the cached
+ * opcodes, see probe.h.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "probe.h"
+
+#include <X11/Xlibint.h>
+#include <X11/extensions/dpmsconst.h>
+#include <X11/extensions/dpmsproto.h>
+#include <X11/extensions/saver.h>
+#include <X11/extensions/saverproto.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Longest key of a cache entry. */
+#define KEY_MAX 1024
+
+/* Largest cache file read. */
+#define CACHE_MAX (PROBE_CACHE_ENTRIES * (KEY_MAX + 32))
+
+static int failed;
+
+static int record_error(Display *dpy, XErrorEvent *ev) {
+  (void)dpy;
+  (void)ev;
+  failed = 1;
+  return 0;
+}
+
+/*
+ * This function writes the path of the cache file to "buf" of "size" bytes.
+ * On success 0 is returned.
+ * If there is no $XDG_RUNTIME_DIR or the path is too long -1 is returned.
+ */
+static int cache_path(char *buf, size_t size) {
+  const char *dir = getenv("XDG_RUNTIME_DIR");
+  int len;
+
+  if (dir == NULL || *dir == '\0')
+    return -1;
+  len = snprintf(buf, size, "%s/" PROBE_CACHE_NAME, dir);
+  return len < 0 || (size_t)len >= size ? -1 : 0;
+}
+
+/* This function appends "str" to "p" with tabs and newlines replaced. */
+static char *append_field(char *p, char *end, const char *str) {
+  for (; *str && p < end - 1; str++)
+    *p++ = *str == '\t' || *str == '\n' ? ' ' : *str;
+  *p++ = '\t';
+  return p;
+}
+
+/*
+ * This function writes the key of the display "dpy" to "key": its name,
+ * vendor, release and root window, each followed by a tab.
+ * The length of the key is returned.
+ */
+static size_t make_key(Display *dpy, char *key) {
+  char num[64], *p = key, *end = key + KEY_MAX;
+
+  p = append_field(p, end - 64, DisplayString(dpy));
+  p = append_field(p, end - 64, ServerVendor(dpy));
+  snprintf(num, sizeof(num), "%d\t%lu\t", VendorRelease(dpy),
+           (unsigned long)DefaultRootWindow(dpy));
+  memcpy(p, num, strlen(num) + 1);
+  return (size_t)(p - key) + strlen(num);
+}
+
+/*
+ * This function reads the cache file at "path" into "buf" of CACHE_MAX + 1
+ * bytes, NUL terminated.
+ * On success the length is returned.
+ * On error -1 is returned.
+ */
+static long read_cache(const char *path, char *buf) {
+  size_t len = 0;
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0)
+    return -1;
+  while (len < CACHE_MAX) {
+    ssize_t ret = read(fd, buf + len, CACHE_MAX - len);
+
+    if (ret <= 0)
+      break;
+    len += (size_t)ret;
+  }
+  close(fd);
+  buf[len] = '\0';
+  return (long)len;
+}
+
+/*
+ * This function looks up the probe results of the display "dpy" in the cache
+ * and writes them to "p".
+ * On a hit 0 is returned.
+ * On a miss -1 is returned.
+ */
+int probe_load(Display *dpy, struct probe *p) {
+  static char buf[CACHE_MAX + 1];
+  char path[4096], key[KEY_MAX];
+  size_t key_len = make_key(dpy, key);
+  char *line, *next;
+
+  if (cache_path(path, sizeof(path)) < 0 || read_cache(path, buf) < 0)
+    return -1;
+
+  for (line = buf; *line; line = next) {
+    next = strchr(line, '\n');
+    if (next == NULL)
+      break;
+    *next++ = '\0';
+    if (strncmp(line, key, key_len) == 0 &&
+        sscanf(line + key_len, "%d\t%d", &p->screensaver, &p->dpms) == 2 &&
+        p->screensaver > 0) {
+      p->cached = 1;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/*
+ * This function stores the probe results "p" of the display "dpy" in the
+ * cache, replacing an older entry of the display and dropping the oldest
+ * entries beyond PROBE_CACHE_ENTRIES. Failing to write the cache isn't an
+ * error; the display is just probed again next time.
+ */
+void probe_store(Display *dpy, const struct probe *p) {
+  static char buf[CACHE_MAX + 1], out[CACHE_MAX + KEY_MAX + 32];
+  char path[4096], tmp[4096 + 16], key[KEY_MAX];
+  size_t key_len = make_key(dpy, key), len = 0, lines = 0;
+  char *line, *next;
+  int fd, ok;
+
+  if (cache_path(path, sizeof(path)) < 0)
+    return;
+
+  /* keep the newest other entries, which are at the end */
+  if (read_cache(path, buf) > 0) {
+    for (line = buf; (next = strchr(line, '\n')); line = next + 1)
+      lines++;
+    for (line = buf; (next = strchr(line, '\n')); line = next + 1) {
+      if (lines-- >= PROBE_CACHE_ENTRIES ||
+          strncmp(line, key, key_len) == 0)
+        continue;
+      memcpy(out + len, line, (size_t)(next - line) + 1);
+      len += (size_t)(next - line) + 1;
+    }
+  }
+  len += (size_t)sprintf(out + len, "%s%d\t%d\n", key, p->screensaver,
+                         p->dpms);
+
+  snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid());
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0)
+    return;
+  ok = write(fd, out, len) == (ssize_t)len;
+  if (close(fd) < 0 || !ok || rename(tmp, path) < 0)
+    unlink(tmp);
+}
+
+/*
+ * This function checks whether the server of "dpy" is DPMS capable, with
+ * "opcode" being the major opcode of DPMS.
+ */
+static int dpms_capable(Display *dpy, int opcode) {
+  XErrorHandler old = XSetErrorHandler(record_error);
+  xDPMSCapableReq *req;
+  xDPMSCapableReply rep;
+  int ok;
+
+  failed = 0;
+  LockDisplay(dpy);
+  GetReq(DPMSCapable, req);
+  req->reqType = (CARD8)opcode;
+  req->dpmsReqType = X_DPMSCapable;
+  ok = _XReply(dpy, (xReply *)&rep, 0, xTrue) && !failed;
+  UnlockDisplay(dpy);
+  SyncHandle();
+  XSetErrorHandler(old);
+
+  return ok && rep.capable;
+}
+
+/*
+ * This function probes the server of "dpy" for the screen saver extension
+ * and, if "dpms" is set, for DPMS, and writes the results to "p".
+ * On success 0 is returned.
+ * If the screen saver extension isn't supported -1 is returned.
+ */
+int probe_run(Display *dpy, struct probe *p, int dpms) {
+  int event, error, opcode;
+
+  if (!XQueryExtension(dpy, ScreenSaverName, &p->screensaver, &event, &error))
+    return -1;
+
+  p->dpms = PROBE_DPMS_UNKNOWN;
+  if (dpms) {
+    p->dpms = 0;
+    if (XQueryExtension(dpy, DPMSExtensionName, &opcode, &event, &error) &&
+        dpms_capable(dpy, opcode))
+      p->dpms = opcode;
+  }
+
+  p->cached = 0;
+  return 0;
+}
+
+/*
+ * This function queries the idle time of the display "dpy" with the screen
+ * saver opcode of "p" and writes it to "idle".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int probe_query_idle(Display *dpy, const struct probe *p, uint64_t *idle) {
+  XErrorHandler old = XSetErrorHandler(record_error);
+  xScreenSaverQueryInfoReq *req;
+  xScreenSaverQueryInfoReply rep;
+  int ok;
+
+  failed = 0;
+  LockDisplay(dpy);
+  GetReq(ScreenSaverQueryInfo, req);
+  req->reqType = (CARD8)p->screensaver;
+  req->saverReqType = X_ScreenSaverQueryInfo;
+  req->drawable = DefaultRootWindow(dpy);
+  ok = _XReply(dpy, (xReply *)&rep, 0, xTrue) && !failed;
+  UnlockDisplay(dpy);
+  SyncHandle();
+  XSetErrorHandler(old);
+
+  if (!ok)
+    return -1;
+  *idle = rep.idle;
+  return 0;
+}
+
+/*
+ * This function queries the DPMS timeouts and state of the display "dpy"
+ * with the DPMS opcode of "p", which must be capable.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int probe_query_dpms(Display *dpy, const struct probe *p, CARD16 *standby,
+                     CARD16 *suspend, CARD16 *off, CARD16 *state,
+                     BOOL *onoff) {
+  XErrorHandler old = XSetErrorHandler(record_error);
+  xDPMSGetTimeoutsReq *treq;
+  xDPMSGetTimeoutsReply trep;
+  xDPMSInfoReq *ireq;
+  xDPMSInfoReply irep;
+  int ok;
+
+  failed = 0;
+  LockDisplay(dpy);
+  GetReq(DPMSGetTimeouts, treq);
+  treq->reqType = (CARD8)p->dpms;
+  treq->dpmsReqType = X_DPMSGetTimeouts;
+  ok = _XReply(dpy, (xReply *)&trep, 0, xTrue) && !failed;
+  if (ok) {
+    GetReq(DPMSInfo, ireq);
+    ireq->reqType = (CARD8)p->dpms;
+    ireq->dpmsReqType = X_DPMSInfo;
+    ok = _XReply(dpy, (xReply *)&irep, 0, xTrue) && !failed;
+  }
+  UnlockDisplay(dpy);
+  SyncHandle();
+  XSetErrorHandler(old);
+
+  if (!ok)
+    return -1;
+  *standby = trep.standby;
+  *suspend = trep.suspend;
+  *off = trep.off;
+  *state = irep.power_level;
+  *onoff = irep.state;
+  return 0;
+}
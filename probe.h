@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Probe cache of the one-shot mode. Opening a display normally costs a
+ * QueryExtension round trip for MIT-SCREEN-SAVER (plus one for the Generic
+ * Event Extension libXext initializes with it), and the DPMS workaround of
+ * old servers adds QueryExtension and DPMSCapable. The results only depend on
+ * the server, so they are kept in a small file in $XDG_RUNTIME_DIR, keyed by
+ * the display name and the identity of the server (vendor, release and root
+ * window). With cached major opcodes the requests are issued directly,
+ * without initializing the extension libraries.
+ *
+ * An entry of a server which has changed doesn't match its key any more and
+ * is probed again. Should a server with the same identity have assigned
+ * other opcodes, the requests fail; the caller then probes again.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_PROBE_H
+#define XPRINTIDLE_PROBE_H
+
+#include <X11/Xlib.h>
+#include <X11/Xmd.h>
+#include <stdint.h>
+
+/* Name of the cache file in $XDG_RUNTIME_DIR. */
+#define PROBE_CACHE_NAME "xprintidle-probe"
+
+/* Most displays kept in the cache file. */
+#define PROBE_CACHE_ENTRIES 32
+
+/* Value of "dpms" before it is probed. */
+#define PROBE_DPMS_UNKNOWN -1
+
+struct probe {
+  /* major opcode of MIT-SCREEN-SAVER */
+  int screensaver;
+  /* major opcode of DPMS if the server is DPMS capable, 0 if it isn't,
+   * PROBE_DPMS_UNKNOWN if not probed */
+  int dpms;
+  /* set if the results came from the cache */
+  int cached;
+};
+
+#ifdef XPRINTIDLE_NO_PROBE_CACHE
+
+/* Built without the "probe_cache" feature, --probe-cache isn't accepted. */
+static inline int probe_load(Display *dpy, struct probe *p) {
+  (void)dpy;
+  (void)p;
+  return -1;
+}
+static inline int probe_run(Display *dpy, struct probe *p, int dpms) {
+  (void)dpy;
+  (void)p;
+  (void)dpms;
+  return -1;
+}
+static inline void probe_store(Display *dpy, const struct probe *p) {
+  (void)dpy;
+  (void)p;
+}
+static inline int probe_query_idle(Display *dpy, const struct probe *p,
+                                   uint64_t *idle) {
+  (void)dpy;
+  (void)p;
+  (void)idle;
+  return -1;
+}
+static inline int probe_query_dpms(Display *dpy, const struct probe *p,
+                                   CARD16 *standby, CARD16 *suspend,
+                                   CARD16 *off, CARD16 *state, BOOL *onoff) {
+  (void)dpy;
+  (void)p;
+  (void)standby;
+  (void)suspend;
+  (void)off;
+  (void)state;
+  (void)onoff;
+  return -1;
+}
+
+#else
+
+int probe_load(Display *dpy, struct probe *p);
+int probe_run(Display *dpy, struct probe *p, int dpms);
+void probe_store(Display *dpy, const struct probe *p);
+int probe_query_idle(Display *dpy, const struct probe *p, uint64_t *idle);
+int probe_query_dpms(Display *dpy, const struct probe *p, CARD16 *standby,
+                     CARD16 *suspend, CARD16 *off, CARD16 *state, BOOL *onoff);
+
+#endif /* XPRINTIDLE_NO_PROBE_CACHE */
+
+#endif /* XPRINTIDLE_PROBE_H */
@@ -0,0 +1,290 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Publication of the latest idle state in a shared memory segment. See
+ * publish.h for a description of the layout and the reader protocol.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "publish.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * This function creates the segment "path" for the displays "names" and maps
+ * it. Displays count as idle from "threshold" milliseconds of idle time on.
+ * The segment is set up under a temporary name and renamed to "path", so
+ * readers never see a partial segment and readers of a previous one keep
+ * their mapping.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int publish_open(struct publisher *pub, const char *path, const char **names,
+                 size_t n, uint64_t threshold) {
+  char tmp[PATH_MAX];
+  void *data;
+  size_t i;
+
+  if (snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid()) >=
+      (int)sizeof(tmp)) {
+    fprintf(stderr, "segment path '%s' too long\n", path);
+    return -1;
+  }
+
+  pub->size =
+      sizeof(struct publish_header) + n * sizeof(struct publish_display);
+  pub->fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (pub->fd < 0) {
+    fprintf(stderr, "couldn't open segment '%s': %s\n", tmp, strerror(errno));
+    return -1;
+  }
+
+  if (ftruncate(pub->fd, (off_t)pub->size) < 0) {
+    fprintf(stderr, "couldn't resize segment '%s': %s\n", tmp,
+            strerror(errno));
+    goto err;
+  }
+
+  data = mmap(NULL, pub->size, PROT_READ | PROT_WRITE, MAP_SHARED, pub->fd, 0);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "couldn't map segment '%s': %s\n", tmp, strerror(errno));
+    goto err;
+  }
+  pub->hdr = data;
+  pub->displays = (struct publish_display *)(pub->hdr + 1);
+
+  pub->hdr->version = PUBLISH_VERSION;
+  pub->hdr->n_displays = (uint32_t)n;
+  pub->hdr->pid = (uint32_t)getpid();
+  pub->hdr->threshold = threshold;
+  for (i = 0; i < n; i++) {
+    size_t len = strlen(names[i]);
+
+    if (len > PUBLISH_NAME_MAX)
+      len = PUBLISH_NAME_MAX;
+    memcpy(pub->displays[i].name, names[i], len);
+  }
+  memcpy(pub->hdr->magic, PUBLISH_MAGIC, sizeof(pub->hdr->magic));
+
+  if (rename(tmp, path) < 0) {
+    fprintf(stderr, "couldn't rename segment to '%s': %s\n", path,
+            strerror(errno));
+    munmap(pub->hdr, pub->size);
+    goto err;
+  }
+
+  return 0;
+
+err:
+  close(pub->fd);
+  unlink(tmp);
+  return -1;
+}
+
+/* This function starts an update of the display entries of "pub". */
+void publish_begin(struct publisher *pub) {
+  __atomic_store_n(&pub->hdr->seq, pub->hdr->seq + 1, __ATOMIC_RELAXED);
+  /* keep the entry updates from becoming visible before the odd "seq" */
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/*
+ * This function updates the entry of display "i" of "pub" with the state of
+ * session "i" of "s", whose threshold is the one of the segment.
+ */
+void publish_display(struct publisher *pub, const struct session_store *s,
+                     size_t i) {
+  struct publish_display *d = &pub->displays[i];
+
+  __atomic_store_n(&d->time, s->time[i], __ATOMIC_RELAXED);
+  __atomic_store_n(&d->idle, s->idle[i], __ATOMIC_RELAXED);
+  __atomic_store_n(&d->idle_state, s->state[i], __ATOMIC_RELAXED);
+  __atomic_store_n(&d->transitions, s->transitions[i], __ATOMIC_RELAXED);
+}
+
+static void wake(struct publisher *pub) {
+  __atomic_add_fetch(&pub->hdr->generation, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&pub->hdr->waiters, __ATOMIC_SEQ_CST))
+    syscall(SYS_futex, &pub->hdr->generation, FUTEX_WAKE, INT_MAX, NULL, NULL,
+            0);
+}
+
+/*
+ * This function ends an update of the display entries of "pub" and wakes up
+ * the waiting readers if "changed" is set.
+ */
+void publish_end(struct publisher *pub, int changed) {
+  __atomic_store_n(&pub->hdr->seq, pub->hdr->seq + 1, __ATOMIC_RELEASE);
+  if (changed)
+    wake(pub);
+}
+
+/*
+ * This function marks the segment of "pub" as abandoned, wakes up the waiting
+ * readers and unmaps it. The file is left in place for readers to notice.
+ */
+void publish_close(struct publisher *pub) {
+  /* an update interrupted by an error */
+  if (pub->hdr->seq & 1)
+    publish_end(pub, 0);
+  __atomic_store_n(&pub->hdr->pid, 0, __ATOMIC_RELEASE);
+  wake(pub);
+  munmap(pub->hdr, pub->size);
+  close(pub->fd);
+}
+
+/*
+ * This function maps the segment "path" of a publisher for reading. It is
+ * mapped writable as well, since waiting counts in its "waiters".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int publish_map(struct publish_reader *rd, const char *path) {
+  const struct publish_header *hdr;
+  struct stat st;
+  void *data;
+  int fd;
+
+  fd = open(path, O_RDWR | O_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "couldn't open segment '%s': %s\n", path, strerror(errno));
+    return -1;
+  }
+  if (fstat(fd, &st) < 0 ||
+      (size_t)st.st_size < sizeof(struct publish_header)) {
+    fprintf(stderr, "segment '%s' is too short\n", path);
+    close(fd);
+    return -1;
+  }
+
+  rd->size = (size_t)st.st_size;
+  data = mmap(NULL, rd->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "couldn't map segment '%s': %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  hdr = data;
+  if (memcmp(hdr->magic, PUBLISH_MAGIC, sizeof(hdr->magic)) ||
+      hdr->version != PUBLISH_VERSION ||
+      (rd->size - sizeof(*hdr)) / sizeof(struct publish_display) <
+          hdr->n_displays) {
+    fprintf(stderr, "'%s' isn't a segment of this version\n", path);
+    munmap(data, rd->size);
+    return -1;
+  }
+  rd->hdr = data;
+  rd->displays = (const struct publish_display *)(rd->hdr + 1);
+  return 0;
+}
+
+/*
+ * This function copies the entry of display "i" of "rd" to "d", retrying
+ * while the publisher updates the entries.
+ */
+void publish_read(const struct publish_reader *rd, size_t i,
+                  struct publish_display *d) {
+  const struct publish_display *src = &rd->displays[i];
+  uint32_t seq;
+
+  /* the name is only written before the segment is renamed into place */
+  memcpy(d->name, src->name, sizeof(d->name));
+  do {
+    seq = __atomic_load_n(&rd->hdr->seq, __ATOMIC_ACQUIRE);
+    d->time = __atomic_load_n(&src->time, __ATOMIC_RELAXED);
+    d->idle = __atomic_load_n(&src->idle, __ATOMIC_RELAXED);
+    d->idle_state = __atomic_load_n(&src->idle_state, __ATOMIC_RELAXED);
+    d->transitions = __atomic_load_n(&src->transitions, __ATOMIC_RELAXED);
+    /* keep the copies from being read after the second "seq" */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while ((seq & 1) ||
+           __atomic_load_n(&rd->hdr->seq, __ATOMIC_RELAXED) != seq);
+}
+
+/*
+ * This function waits at most "timeout" milliseconds (forever if negative)
+ * for the generation of "rd" to differ from "*generation", and writes the
+ * new one there.
+ * If the generation changed 0 is returned.
+ * If the wait timed out 1 is returned.
+ * On error -1 is returned.
+ */
+int publish_wait(struct publish_reader *rd, uint32_t *generation,
+                 int timeout) {
+  struct timespec deadline, left, *ts = NULL;
+  uint32_t gen;
+  int ret = 1;
+
+  if (timeout >= 0) {
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += timeout % 1000 * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    ts = &left;
+  }
+
+  /* pairs with the increment of "generation" and the load of "waiters" by
+   * the publisher: either it sees the waiter or the waiter sees the new
+   * generation */
+  __atomic_add_fetch(&rd->hdr->waiters, 1, __ATOMIC_SEQ_CST);
+  while ((gen = __atomic_load_n(&rd->hdr->generation, __ATOMIC_SEQ_CST)) ==
+         *generation) {
+    if (ts) {
+      struct timespec now;
+
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      left.tv_sec = deadline.tv_sec - now.tv_sec;
+      left.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+      if (left.tv_nsec < 0) {
+        left.tv_sec--;
+        left.tv_nsec += 1000000000L;
+      }
+      if (left.tv_sec < 0)
+        break;
+    }
+    if (syscall(SYS_futex, &rd->hdr->generation, FUTEX_WAIT, *generation, ts,
+                NULL, 0) < 0 &&
+        errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT) {
+      fprintf(stderr, "couldn't wait for the segment: %s\n", strerror(errno));
+      ret = -1;
+      break;
+    }
+  }
+  __atomic_sub_fetch(&rd->hdr->waiters, 1, __ATOMIC_SEQ_CST);
+
+  if (gen != *generation) {
+    *generation = gen;
+    ret = 0;
+  }
+  return ret;
+}
+
+/* This function unmaps the segment of "rd". */
+void publish_unmap(struct publish_reader *rd) { munmap(rd->hdr, rd->size); }
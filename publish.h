@@ -0,0 +1,155 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Publication of the latest idle state of the watched displays in a shared
+ * memory segment (a file mapped by the publisher and any number of local
+ * readers, usually placed in $XDG_RUNTIME_DIR or /dev/shm).
+ *
+ * The segment is a struct publish_header followed by "n_displays" struct
+ * publish_display. All fields are in native byte order and are accessed with
+ * atomic operations:
+ *
+ *  - "seq" is a sequence lock around the display entries. The publisher makes
+ *    it odd before and even after updating them, so a reader copies the
+ *    entries while "seq" is even and unchanged.
+ *  - "generation" is bumped whenever a display changes between active and
+ *    idle (see "threshold") and when the publisher exits ("pid" is 0 then).
+ *    It is a futex word: a reader remembers the generation it has seen,
+ *    increments "waiters", checks "generation" again and blocks with
+ *    FUTEX_WAIT on it. The publisher only issues a FUTEX_WAKE when "waiters"
+ *    is not 0, so publishing costs no system call while nobody waits.
+ *
+ * A publisher sets the segment up under a temporary name and renames it into
+ * place. When it exits, "pid" is set to 0 and "generation" is bumped, so
+ * readers know to open the path again; after a crash, readers notice the
+ * process is gone, so they should wait with a timeout.
+ *
+ * publish_map(), publish_read() and publish_wait() implement the reader side
+ * of the protocol.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_PUBLISH_H
+#define XPRINTIDLE_PUBLISH_H
+
+#include "sessions.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PUBLISH_MAGIC "XPIPUB01"
+#define PUBLISH_VERSION 1
+
+/* Longest display name in a segment. */
+#define PUBLISH_NAME_MAX 255
+
+struct publish_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t n_displays;
+  uint32_t generation;
+  uint32_t waiters;
+  uint32_t seq;
+  uint32_t pid;
+  uint64_t threshold;
+  uint64_t reserved[3];
+};
+
+struct publish_display {
+  char name[PUBLISH_NAME_MAX + 1];
+  /* time of the last sample in milliseconds since the epoch */
+  uint64_t time;
+  uint64_t idle;
+  /* 1 if "idle" is at or above the threshold of the segment, 0 otherwise */
+  uint32_t idle_state;
+  uint32_t transitions;
+};
+
+struct publisher {
+  int fd;
+  size_t size;
+  struct publish_header *hdr;
+  struct publish_display *displays;
+};
+
+/* A segment mapped by a reader. */
+struct publish_reader {
+  size_t size;
+  struct publish_header *hdr;
+  const struct publish_display *displays;
+};
+
+#ifdef XPRINTIDLE_NO_PUBLISH
+
+/* Built without the "publish" feature, --publish isn't accepted. */
+static inline int publish_open(struct publisher *pub, const char *path,
+                               const char **names, size_t n,
+                               uint64_t threshold) {
+  (void)pub;
+  (void)path;
+  (void)names;
+  (void)n;
+  (void)threshold;
+  return -1;
+}
+static inline void publish_begin(struct publisher *pub) { (void)pub; }
+static inline void publish_display(struct publisher *pub,
+                                   const struct session_store *s, size_t i) {
+  (void)pub;
+  (void)s;
+  (void)i;
+}
+static inline void publish_end(struct publisher *pub, int changed) {
+  (void)pub;
+  (void)changed;
+}
+static inline void publish_close(struct publisher *pub) { (void)pub; }
+static inline int publish_map(struct publish_reader *rd, const char *path) {
+  (void)rd;
+  (void)path;
+  return -1;
+}
+static inline void publish_read(const struct publish_reader *rd, size_t i,
+                                struct publish_display *d) {
+  (void)rd;
+  (void)i;
+  (void)d;
+}
+static inline int publish_wait(struct publish_reader *rd, uint32_t *generation,
+                               int timeout) {
+  (void)rd;
+  (void)generation;
+  (void)timeout;
+  return -1;
+}
+static inline void publish_unmap(struct publish_reader *rd) { (void)rd; }
+
+#else
+
+int publish_open(struct publisher *pub, const char *path, const char **names,
+                 size_t n, uint64_t threshold);
+void publish_begin(struct publisher *pub);
+void publish_display(struct publisher *pub, const struct session_store *s,
+                     size_t i);
+void publish_end(struct publisher *pub, int changed);
+void publish_close(struct publisher *pub);
+int publish_map(struct publish_reader *rd, const char *path);
+void publish_read(const struct publish_reader *rd, size_t i,
+                  struct publish_display *d);
+int publish_wait(struct publish_reader *rd, uint32_t *generation, int timeout);
+void publish_unmap(struct publish_reader *rd);
+
+#endif /* XPRINTIDLE_NO_PUBLISH */
+
+#endif /* XPRINTIDLE_PUBLISH_H */
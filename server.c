@@ -0,0 +1,630 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Unix stream socket server of the watch mode. See server.h for the
+ * protocol.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "server.h"
+#include "format.h"
+#include "watch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define RING_MASK (SERVER_RING_SIZE - 1)
+
+/* Longest suffix appended to a sample record for a threshold event. */
+#define EVENT_SUFFIX_MAX                                                       \
+  (sizeof(",\"threshold\":,\"state\":\"active\"}\n") + U64_STR_MAX)
+
+/* Longest histogram record. */
+#define HISTOGRAM_RECORD_MAX                                                   \
+  (sizeof("{\"display\":,}\n") + JSON_STRING_MAX(WATCH_DISPLAY_NAME_MAX) +     \
+   HISTOGRAM_JSON_MAX)
+
+/* Longest activity record. */
+#define ACTIVITY_RECORD_MAX                                                    \
+  (sizeof("{\"display\":,\"window\":,\"activity\":}\n") +                      \
+   JSON_STRING_MAX(WATCH_DISPLAY_NAME_MAX) + U64_STR_MAX + ACTIVITY_STR_MAX)
+
+/* Longest input record. */
+#define INPUT_RECORD_MAX                                                       \
+  (sizeof("{\"display\":,\"minutes\":[]}\n") +                                 \
+   JSON_STRING_MAX(WATCH_DISPLAY_NAME_MAX) +                                   \
+   (INPUT_MINUTES + 1) * (sizeof("[,,,],") + 4 * U64_STR_MAX))
+
+/*
+ * This function binds a listening socket to "path". A stale socket left by a
+ * crashed server is replaced, a socket with a live server is not.
+ * On success the socket is returned.
+ * On error -1 is returned.
+ */
+static int listen_unix(const char *path) {
+  struct sockaddr_un addr;
+  int fd;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "socket path '%s' too long\n", path);
+    return -1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    fprintf(stderr, "couldn't create socket: %s\n", strerror(errno));
+    return -1;
+  }
+
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    int probe = errno == EADDRINUSE
+                    ? socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)
+                    : -1;
+
+    if (probe >= 0) {
+      if (connect(probe, (struct sockaddr *)&addr, sizeof(addr)) < 0 &&
+          errno == ECONNREFUSED)
+        unlink(path);
+      close(probe);
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      fprintf(stderr, "couldn't bind socket '%s': %s\n", path,
+              strerror(errno));
+      close(fd);
+      return -1;
+    }
+  }
+
+  if (listen(fd, 64) < 0) {
+    fprintf(stderr, "couldn't listen on '%s': %s\n", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/*
+ * This function starts a server on the socket "path" for the displays
+ * "names", whose idle period histograms are "histograms", activity windows
+ * "activity" and input counters "input" (both NULL if not kept).
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int server_open(struct server *srv, const char *path, const char **names,
+                const struct histogram *histograms,
+                const struct activity *activity,
+                const struct input_counter *input, size_t n_displays) {
+  srv->path = strdup(path);
+  if (srv->path == NULL) {
+    fprintf(stderr, "couldn't allocate socket path\n");
+    return -1;
+  }
+
+  srv->fd = listen_unix(path);
+  if (srv->fd < 0) {
+    free(srv->path);
+    return -1;
+  }
+
+  srv->names = names;
+  srv->histograms = histograms;
+  srv->activity = activity;
+  srv->input = input;
+  srv->n_displays = n_displays;
+  srv->n_clients = 0;
+  return 0;
+}
+
+static void drop_client(struct server *srv, size_t i) {
+  struct server_client *c = srv->clients[i];
+
+  close(c->fd);
+  free(c->wanted);
+  free(c->last_idle);
+  free(c->last_sent);
+  free(c);
+  srv->clients[i] = srv->clients[--srv->n_clients];
+}
+
+static void accept_clients(struct server *srv) {
+  for (;;) {
+    struct server_client *c;
+    int fd = accept4(srv->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (fd < 0)
+      return;
+    if (srv->n_clients == SERVER_CLIENTS_MAX) {
+      close(fd);
+      continue;
+    }
+
+    c = calloc(1, sizeof(*c));
+    if (c)
+      c->wanted = calloc(srv->n_displays, 1);
+    if (c && c->wanted)
+      c->last_idle = malloc(srv->n_displays * sizeof(*c->last_idle));
+    if (c && c->last_idle)
+      c->last_sent = malloc(srv->n_displays * sizeof(*c->last_sent));
+    if (c == NULL || c->last_sent == NULL) {
+      if (c) {
+        free(c->wanted);
+        free(c->last_idle);
+        free(c);
+      }
+      close(fd);
+      continue;
+    }
+
+    c->fd = fd;
+    srv->clients[srv->n_clients++] = c;
+  }
+}
+
+/*
+ * This function queues "len" bytes of "data" for the client "c".
+ * On success 0 is returned.
+ * If the queue of the client is full -1 is returned.
+ */
+static int enqueue(struct server_client *c, const char *data, size_t len) {
+  uint32_t pos = c->tail & RING_MASK;
+  size_t first = SERVER_RING_SIZE - pos;
+
+  if (len > SERVER_RING_SIZE - (c->tail - c->head))
+    return -1;
+
+  if (first > len)
+    first = len;
+  memcpy(c->ring + pos, data, first);
+  memcpy(c->ring, data + first, len - first);
+  c->tail += (uint32_t)len;
+  return 0;
+}
+
+/*
+ * This function writes as much of the queue of "c" as the socket takes.
+ * On success 0 is returned.
+ * If the client is gone -1 is returned.
+ */
+static int flush_client(struct server_client *c) {
+  while (c->tail != c->head) {
+    uint32_t pos = c->head & RING_MASK;
+    size_t pending = c->tail - c->head;
+    struct iovec iov[2];
+    struct msghdr msg;
+    ssize_t ret;
+
+    iov[0].iov_base = c->ring + pos;
+    iov[0].iov_len = pending;
+    iov[1].iov_base = c->ring;
+    iov[1].iov_len = 0;
+    if (pos + pending > SERVER_RING_SIZE) {
+      iov[0].iov_len = SERVER_RING_SIZE - pos;
+      iov[1].iov_len = pending - iov[0].iov_len;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iov[1].iov_len ? 2 : 1;
+    ret = sendmsg(c->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    c->head += (uint32_t)ret;
+  }
+
+  return 0;
+}
+
+/*
+ * This function parses a comma separated list of numbers into "vals", which
+ * holds up to "max" values.
+ * On success the number of values is returned.
+ * On error -1 is returned.
+ */
+static int parse_list(char *str, uint64_t *vals, size_t max) {
+  size_t n = 0;
+  char *tok, *save, *end;
+
+  for (tok = strtok_r(str, ",", &save); tok;
+       tok = strtok_r(NULL, ",", &save)) {
+    if (n == max || *tok < '0' || *tok > '9')
+      return -1;
+    vals[n++] = strtoull(tok, &end, 10);
+    if (*end)
+      return -1;
+  }
+
+  return (int)n;
+}
+
+/*
+ * This function applies the subscription "args" (the request line after
+ * "subscribe") to the client "c" of "srv".
+ * On success 0 is returned.
+ * On error -1 is returned and "c" is unchanged.
+ */
+static int subscribe(struct server *srv, struct server_client *c,
+                     char *args) {
+  uint64_t thresholds[SERVER_THRESHOLDS_MAX], granularity = 0;
+  int n_thresholds = 0, samples = -1;
+  char *displays = NULL, *tok, *save;
+  size_t i;
+
+  for (tok = strtok_r(args, " ", &save); tok;
+       tok = strtok_r(NULL, " ", &save)) {
+    char *val = strchr(tok, '=');
+
+    if (val == NULL)
+      return -1;
+    *val++ = '\0';
+    if (!strcmp(tok, "displays")) {
+      displays = val;
+    } else if (!strcmp(tok, "thresholds")) {
+      n_thresholds = parse_list(val, thresholds, SERVER_THRESHOLDS_MAX);
+      if (n_thresholds < 0)
+        return -1;
+    } else if (!strcmp(tok, "granularity")) {
+      if (parse_list(val, &granularity, 1) != 1)
+        return -1;
+      samples = 1;
+    } else {
+      return -1;
+    }
+  }
+
+  if (displays) {
+    /* check all names before changing anything */
+    char *copy = strdup(displays), *name;
+
+    if (copy == NULL)
+      return -1;
+    for (name = strtok_r(copy, ",", &save); name;
+         name = strtok_r(NULL, ",", &save)) {
+      for (i = 0; i < srv->n_displays && strcmp(srv->names[i], name); i++)
+        ;
+      if (i == srv->n_displays) {
+        free(copy);
+        return -1;
+      }
+    }
+    free(copy);
+  }
+
+  for (i = 0; i < srv->n_displays; i++) {
+    c->wanted[i] = displays == NULL;
+    c->last_idle[i] = UINT64_MAX;
+    c->last_sent[i] = UINT64_MAX;
+  }
+  if (displays) {
+    char *name;
+
+    for (name = strtok_r(displays, ",", &save); name;
+         name = strtok_r(NULL, ",", &save)) {
+      for (i = 0; i < srv->n_displays; i++) {
+        if (!strcmp(srv->names[i], name))
+          c->wanted[i] = 1;
+      }
+    }
+  }
+
+  c->n_thresholds = (size_t)n_thresholds;
+  memcpy(c->thresholds, thresholds, (size_t)n_thresholds * sizeof(uint64_t));
+  c->samples = samples < 0 ? n_thresholds == 0 : samples;
+  c->granularity = granularity;
+  c->subscribed = 1;
+  return 0;
+}
+
+/*
+ * This function queues the histograms of all displays of "srv" for the client
+ * "c".
+ * On success 0 is returned.
+ * If the queue of the client overflows -1 is returned.
+ */
+static int send_histograms(struct server *srv, struct server_client *c) {
+  static char rec[HISTOGRAM_RECORD_MAX];
+  size_t i;
+
+  for (i = 0; i < srv->n_displays; i++) {
+    char *p = rec;
+
+    memcpy(p, "{\"display\":", 11);
+    p += 11;
+    p += format_json_string(p, srv->names[i]);
+    *p++ = ',';
+    p += histogram_format_json(p, &srv->histograms[i]);
+    *p++ = '}';
+    *p++ = '\n';
+    if (enqueue(c, rec, (size_t)(p - rec)) < 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * This function queues the active fraction of the window of all displays of
+ * "srv" for the client "c".
+ * On success 0 is returned.
+ * If the queue of the client overflows -1 is returned.
+ */
+static int send_activity(struct server *srv, struct server_client *c) {
+  char rec[ACTIVITY_RECORD_MAX];
+  size_t i;
+
+  for (i = 0; i < srv->n_displays; i++) {
+    const struct activity *a = &srv->activity[i];
+    char *p = rec;
+
+    memcpy(p, "{\"display\":", 11);
+    p += 11;
+    p += format_json_string(p, srv->names[i]);
+    memcpy(p, ",\"window\":", 10);
+    p += 10;
+    p += format_u64(p, (uint64_t)a->seconds * 1000);
+    memcpy(p, ",\"activity\":", 12);
+    p += 12;
+    p += activity_format(p, activity_permille(a));
+    *p++ = '}';
+    *p++ = '\n';
+    if (enqueue(c, rec, (size_t)(p - rec)) < 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * This function queues the input counts of the past minutes and of the
+ * current one so far of all displays of "srv" for the client "c".
+ * On success 0 is returned.
+ * If the queue of the client overflows -1 is returned.
+ */
+static int send_input(struct server *srv, struct server_client *c) {
+  static char rec[INPUT_RECORD_MAX];
+  size_t i, j;
+
+  for (i = 0; i < srv->n_displays; i++) {
+    const struct input_counter *ic = &srv->input[i];
+    struct input_minute current = ic->current;
+    char *p = rec;
+
+    memcpy(p, "{\"display\":", 11);
+    p += 11;
+    p += format_json_string(p, srv->names[i]);
+    memcpy(p, ",\"minutes\":[", 12);
+    p += 12;
+    current.motion = (uint64_t)(ic->motion + 0.5);
+    for (j = 0; j <= ic->n; j++) {
+      const struct input_minute *m =
+          j == ic->n ? &current
+                     : &ic->ring[(ic->head + INPUT_MINUTES - ic->n + j) %
+                                 INPUT_MINUTES];
+
+      if (j)
+        *p++ = ',';
+      *p++ = '[';
+      p += format_u64(p, m->time);
+      *p++ = ',';
+      p += format_u64(p, m->keys);
+      *p++ = ',';
+      p += format_u64(p, m->clicks);
+      *p++ = ',';
+      p += format_u64(p, m->motion);
+      *p++ = ']';
+    }
+    *p++ = ']';
+    *p++ = '}';
+    *p++ = '\n';
+    if (enqueue(c, rec, (size_t)(p - rec)) < 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * This function handles the complete request lines received from the client
+ * "c" of "srv".
+ * On success 0 is returned.
+ * If the client has to be disconnected -1 is returned.
+ */
+static int handle_requests(struct server *srv, struct server_client *c) {
+  static const char ok[] = "{\"subscribed\":true}\n";
+  static const char bad[] = "{\"error\":\"invalid request\"}\n";
+  char *start = c->in, *nl;
+
+  while ((nl = memchr(start, '\n', c->in_len - (size_t)(start - c->in)))) {
+    *nl = '\0';
+    if (nl > start && nl[-1] == '\r')
+      nl[-1] = '\0';
+
+    if (!strncmp(start, "subscribe", 9) &&
+        (start[9] == '\0' || start[9] == ' ') &&
+        subscribe(srv, c, start + 9) == 0) {
+      if (enqueue(c, ok, sizeof(ok) - 1) < 0)
+        return -1;
+    } else if (!strcmp(start, "histogram")) {
+      if (send_histograms(srv, c) < 0)
+        return -1;
+    } else if (!strcmp(start, "activity") && srv->activity) {
+      if (send_activity(srv, c) < 0)
+        return -1;
+    } else if (!strcmp(start, "input") && srv->input) {
+      if (send_input(srv, c) < 0)
+        return -1;
+    } else if (enqueue(c, bad, sizeof(bad) - 1) < 0) {
+      return -1;
+    }
+    start = nl + 1;
+  }
+
+  c->in_len -= (size_t)(start - c->in);
+  memmove(c->in, start, c->in_len);
+  return c->in_len == sizeof(c->in) ? -1 : 0;
+}
+
+/*
+ * This function reads the requests of the client "c" of "srv".
+ * On success 0 is returned.
+ * If the client is gone or misbehaves -1 is returned.
+ */
+static int read_client(struct server *srv, struct server_client *c) {
+  for (;;) {
+    ssize_t ret = read(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len);
+
+    if (ret == 0)
+      return -1;
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    c->in_len += (size_t)ret;
+    if (handle_requests(srv, c) < 0)
+      return -1;
+  }
+}
+
+/*
+ * This function writes the pollfds of the listening socket and all clients of
+ * "srv" to "fds", which must hold SERVER_POLLFDS_MAX entries. The number of
+ * pollfds written is returned.
+ */
+size_t server_pollfds(const struct server *srv, struct pollfd *fds) {
+  size_t i;
+
+  fds[0].fd = srv->fd;
+  fds[0].events = POLLIN;
+  for (i = 0; i < srv->n_clients; i++) {
+    const struct server_client *c = srv->clients[i];
+
+    fds[i + 1].fd = c->fd;
+    fds[i + 1].events = POLLIN;
+    if (c->tail != c->head)
+      fds[i + 1].events |= POLLOUT;
+  }
+
+  return srv->n_clients + 1;
+}
+
+/*
+ * This function handles the events polled for "fds", as written by
+ * server_pollfds(): new connections, requests and queues clients can take
+ * more of.
+ */
+void server_handle(struct server *srv, const struct pollfd *fds, size_t nfds) {
+  size_t i;
+
+  /* backwards, dropping a client moves the last one in its place */
+  for (i = nfds - 1; i > 0; i--) {
+    struct server_client *c = srv->clients[i - 1];
+    short revents = fds[i].revents;
+
+    if (((revents & (POLLIN | POLLHUP | POLLERR)) && read_client(srv, c) < 0) ||
+        flush_client(c) < 0)
+      drop_client(srv, i - 1);
+  }
+
+  if (fds[0].revents & POLLIN)
+    accept_clients(srv);
+}
+
+/*
+ * This function pushes the sample "rec" (a NDJSON record of "len" bytes,
+ * ending with "}\n") with the idle time "idle" of display "display" to all
+ * clients subscribed to it, as sample and threshold events according to
+ * their subscriptions. Clients whose queue overflows are disconnected.
+ */
+void server_sample(struct server *srv, size_t display, uint64_t idle,
+                   const char *rec, size_t len) {
+  char suffix[EVENT_SUFFIX_MAX];
+  size_t i = srv->n_clients;
+
+  while (i-- > 0) {
+    struct server_client *c = srv->clients[i];
+    uint64_t prev = c->last_idle[display];
+    int overflow = 0;
+    size_t j;
+
+    if (!c->subscribed || !c->wanted[display])
+      continue;
+    c->last_idle[display] = idle;
+
+    if (c->samples &&
+        (c->last_sent[display] == UINT64_MAX ||
+         (idle > c->last_sent[display] ? idle - c->last_sent[display]
+                                       : c->last_sent[display] - idle) >=
+             c->granularity)) {
+      c->last_sent[display] = idle;
+      overflow |= enqueue(c, rec, len);
+    }
+
+    for (j = 0; j < c->n_thresholds && prev != UINT64_MAX; j++) {
+      uint64_t t = c->thresholds[j];
+      char *p = suffix;
+
+      if ((prev < t) == (idle < t))
+        continue;
+      memcpy(p, ",\"threshold\":", 13);
+      p += 13;
+      p += format_u64(p, t);
+      if (idle >= t) {
+        memcpy(p, ",\"state\":\"idle\"}\n", 17);
+        p += 17;
+      } else {
+        memcpy(p, ",\"state\":\"active\"}\n", 19);
+        p += 19;
+      }
+      overflow |= enqueue(c, rec, len - 2) |
+                  enqueue(c, suffix, (size_t)(p - suffix));
+    }
+
+    if (overflow)
+      drop_client(srv, i);
+  }
+}
+
+/* This function writes the queued events of all clients of "srv". */
+void server_flush(struct server *srv) {
+  size_t i = srv->n_clients;
+
+  while (i-- > 0) {
+    if (flush_client(srv->clients[i]) < 0)
+      drop_client(srv, i);
+  }
+}
+
+void server_close(struct server *srv) {
+  while (srv->n_clients)
+    drop_client(srv, srv->n_clients - 1);
+  close(srv->fd);
+  unlink(srv->path);
+  free(srv->path);
+}
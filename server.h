@@ -0,0 +1,168 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Unix stream socket server of the watch mode. Clients subscribe with a line
+ *
+ *   subscribe [displays=NAME,...] [thresholds=MS,...] [granularity=MS]
+ *
+ * and are then pushed NDJSON events of the displays they are interested in
+ * (all by default):
+ *
+ *  - a sample record (as printed by --format=ndjson) whenever the idle time
+ *    changed by at least "granularity" milliseconds since the last sample sent
+ *    to the client; without "granularity" samples are only sent if no
+ *    thresholds are given, and then every round,
+ *  - a sample record with the additional fields "threshold" and "state"
+ *    ("idle" or "active") whenever the idle time crosses one of the
+ *    "thresholds".
+ *
+ * A subscription is answered with {"subscribed":true} or {"error":"..."} and
+ * can be replaced by sending another one. A line "histogram" is answered with
+ * one record per display with the histogram of its idle periods (see
+ * histogram.h):
+ *
+ *   {"display":NAME,"periods":N,"sum":MS,"buckets":[[MS,N],...]}
+ *
+ * and with --activity a line "activity" with one record per display with the
+ * active fraction of the window (see activity.h):
+ *
+ *   {"display":NAME,"window":MS,"activity":0.734}
+ *
+ * and with --input a line "input" with one record per display with the input
+ * counts of the past minutes, oldest first, and of the current one so far (see
+ * input.h):
+ *
+ *   {"display":NAME,"minutes":[[TIME,KEYS,CLICKS,MOTION],...]}
+ *
+ * Events are queued in a ring buffer per client; a client too slow to drain it
+ * is disconnected, so it can't hold up the sampling loop or the other clients.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_SERVER_H
+#define XPRINTIDLE_SERVER_H
+
+#include "activity.h"
+#include "histogram.h"
+#include "input.h"
+
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Maximum number of connected clients. */
+#define SERVER_CLIENTS_MAX 1024
+
+/* Number of pollfds server_pollfds() fills at most. */
+#define SERVER_POLLFDS_MAX (SERVER_CLIENTS_MAX + 1)
+
+/* Size of the event queue of a client, a power of 2. */
+#define SERVER_RING_SIZE 16384
+
+/* Longest request line. */
+#define SERVER_LINE_MAX 1024
+
+/* Maximum number of thresholds of a subscription. */
+#define SERVER_THRESHOLDS_MAX 16
+
+struct server_client {
+  int fd;
+  int subscribed;
+  int samples;
+  uint64_t granularity;
+  size_t n_thresholds;
+  uint64_t thresholds[SERVER_THRESHOLDS_MAX];
+  /* per display: whether it is subscribed, the last idle time seen and the
+   * idle time of the last sample sent (UINT64_MAX for none) */
+  unsigned char *wanted;
+  uint64_t *last_idle;
+  uint64_t *last_sent;
+  /* queued events are ring[head..tail) (modulo SERVER_RING_SIZE) */
+  uint32_t head, tail;
+  size_t in_len;
+  char in[SERVER_LINE_MAX];
+  char ring[SERVER_RING_SIZE];
+};
+
+struct server {
+  int fd;
+  char *path;
+  const char **names;
+  const struct histogram *histograms;
+  /* NULL without --activity */
+  const struct activity *activity;
+  /* NULL without --input */
+  const struct input_counter *input;
+  size_t n_displays;
+  size_t n_clients;
+  struct server_client *clients[SERVER_CLIENTS_MAX];
+};
+
+#ifdef XPRINTIDLE_NO_LISTEN
+
+/* Built without the "listen" feature, --listen isn't accepted. */
+static inline int server_open(struct server *srv, const char *path,
+                              const char **names,
+                              const struct histogram *histograms,
+                              const struct activity *activity,
+                              const struct input_counter *input,
+                              size_t n_displays) {
+  (void)srv;
+  (void)path;
+  (void)names;
+  (void)histograms;
+  (void)activity;
+  (void)input;
+  (void)n_displays;
+  return -1;
+}
+static inline size_t server_pollfds(const struct server *srv,
+                                    struct pollfd *fds) {
+  (void)srv;
+  (void)fds;
+  return 0;
+}
+static inline void server_handle(struct server *srv, const struct pollfd *fds,
+                                 size_t nfds) {
+  (void)srv;
+  (void)fds;
+  (void)nfds;
+}
+static inline void server_sample(struct server *srv, size_t display,
+                                 uint64_t idle, const char *rec, size_t len) {
+  (void)srv;
+  (void)display;
+  (void)idle;
+  (void)rec;
+  (void)len;
+}
+static inline void server_flush(struct server *srv) { (void)srv; }
+static inline void server_close(struct server *srv) { (void)srv; }
+
+#else
+
+int server_open(struct server *srv, const char *path, const char **names,
+                const struct histogram *histograms,
+                const struct activity *activity,
+                const struct input_counter *input, size_t n_displays);
+size_t server_pollfds(const struct server *srv, struct pollfd *fds);
+void server_handle(struct server *srv, const struct pollfd *fds, size_t nfds);
+void server_sample(struct server *srv, size_t display, uint64_t idle,
+                   const char *rec, size_t len);
+void server_flush(struct server *srv);
+void server_close(struct server *srv);
+
+#endif /* XPRINTIDLE_NO_LISTEN */
+
+#endif /* XPRINTIDLE_SERVER_H */
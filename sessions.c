@@ -0,0 +1,156 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Struct-of-arrays store of the session state, see sessions.h.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "sessions.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * This function resizes the column "*col" of "elem" byte entries to "cap"
+ * entries.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int grow_column(void *col, size_t elem, size_t cap) {
+  void *p = realloc(*(void **)col, cap * elem);
+
+  if (p == NULL)
+    return -1;
+  *(void **)col = p;
+  return 0;
+}
+
+/*
+ * This function makes room for "cap" sessions in "s". The columns are
+ * resized one by one, so after an error the ones already resized are just
+ * larger than needed.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int reserve(struct session_store *s, size_t cap) {
+  if (grow_column(&s->time, sizeof(*s->time), cap) < 0 ||
+      grow_column(&s->idle, sizeof(*s->idle), cap) < 0 ||
+      grow_column(&s->transitions, sizeof(*s->transitions), cap) < 0 ||
+      grow_column(&s->dpms, sizeof(*s->dpms), cap) < 0 ||
+      grow_column(&s->state, sizeof(*s->state), cap) < 0 ||
+      grow_column(&s->live, sizeof(*s->live), cap) < 0) {
+    fprintf(stderr, "couldn't allocate session state\n");
+    return -1;
+  }
+
+  s->cap = cap;
+  return 0;
+}
+
+/*
+ * This function initializes "s" as an empty store with room for "cap"
+ * sessions. Sessions count as idle from "threshold" milliseconds on.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int session_store_init(struct session_store *s, size_t cap,
+                       uint64_t threshold) {
+  memset(s, 0, sizeof(*s));
+  s->threshold = threshold;
+  if (reserve(s, cap ? cap : 16) < 0) {
+    session_store_free(s);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * This function adds a session without samples to "s".
+ * On success the index of the session is returned.
+ * On error -1 is returned.
+ */
+long session_store_add(struct session_store *s) {
+  size_t i = s->n;
+
+  if (i == s->cap && reserve(s, s->cap * 2) < 0)
+    return -1;
+
+  s->time[i] = 0;
+  s->idle[i] = 0;
+  s->transitions[i] = 0;
+  s->dpms[i] = SESSION_DPMS_UNKNOWN;
+  s->state[i] = 0;
+  s->live[i] = 0;
+  s->n++;
+  return (long)i;
+}
+
+/*
+ * This function records a sample of session "i" of "s", which makes it live.
+ * If the session changed between active and idle 1 is returned, otherwise 0.
+ */
+int session_store_update(struct session_store *s, size_t i, uint64_t time,
+                         uint64_t idle) {
+  unsigned char state = idle >= s->threshold;
+  int changed = s->time[i] && state != s->state[i];
+
+  s->time[i] = time;
+  s->idle[i] = idle;
+  s->state[i] = state;
+  s->live[i] = 1;
+  s->transitions[i] += (uint32_t)changed;
+  return changed;
+}
+
+/*
+ * This function marks session "i" of "s" as no longer reported, so sweeps
+ * skip it until its next sample. Its last state is kept.
+ */
+void session_store_drop(struct session_store *s, size_t i) { s->live[i] = 0; }
+
+/*
+ * This function returns the number of live sessions of "s" which are idle for
+ * more ("above" set) or less than "ms" milliseconds at "now", extrapolating
+ * from their last sample. "now" is on the clock of the sample times.
+ */
+size_t session_store_count_idle(const struct session_store *s, uint64_t now,
+                                uint64_t ms, int above) {
+  const uint64_t *time = s->time, *idle = s->idle;
+  const unsigned char *live = s->live;
+  size_t i, count = 0;
+
+  /* the idle time at "now" is computed modulo 2^64 and compared signed, so a
+   * sample slightly in the future of "now" doesn't wrap around */
+  if (above) {
+    for (i = 0; i < s->n; i++)
+      count += live[i] & ((int64_t)(idle[i] + now - time[i]) > (int64_t)ms);
+  } else {
+    for (i = 0; i < s->n; i++)
+      count += live[i] & ((int64_t)(idle[i] + now - time[i]) < (int64_t)ms);
+  }
+  return count;
+}
+
+void session_store_free(struct session_store *s) {
+  free(s->time);
+  free(s->idle);
+  free(s->transitions);
+  free(s->dpms);
+  free(s->state);
+  free(s->live);
+  memset(s, 0, sizeof(*s));
+}
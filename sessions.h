@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * State of the tracked sessions (the displays of the watch mode, the hosts of
+ * the collector), kept as one contiguous column per field and addressed by a
+ * dense session index. Sweeps over all sessions, like counting the idle ones,
+ * are linear scans over two or three columns which the compiler can
+ * vectorize.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_SESSIONS_H
+#define XPRINTIDLE_SESSIONS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Value of the "dpms" column while the power level of a session is unknown. */
+#define SESSION_DPMS_UNKNOWN 0xff
+
+struct session_store {
+  size_t n, cap;
+  /* idle time from which on a session counts as idle */
+  uint64_t threshold;
+  /* time of the last sample (0 for none) and its idle time in milliseconds */
+  uint64_t *time;
+  uint64_t *idle;
+  /* number of changes between active and idle */
+  uint32_t *transitions;
+  /* DPMS power level, SESSION_DPMS_UNKNOWN if not known */
+  unsigned char *dpms;
+  /* 1 if the last idle time is at or above "threshold", 0 otherwise */
+  unsigned char *state;
+  /* 1 while the session is reported, 0 after session_store_drop() */
+  unsigned char *live;
+};
+
+int session_store_init(struct session_store *s, size_t cap,
+                       uint64_t threshold);
+long session_store_add(struct session_store *s);
+int session_store_update(struct session_store *s, size_t i, uint64_t time,
+                         uint64_t idle);
+void session_store_drop(struct session_store *s, size_t i);
+size_t session_store_count_idle(const struct session_store *s, uint64_t now,
+                                uint64_t ms, int above);
+void session_store_free(struct session_store *s);
+
+#endif /* XPRINTIDLE_SESSIONS_H */
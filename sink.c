@@ -0,0 +1,300 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Sinks of the watch mode, see sink.h.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "sink.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* This function sets "ts" to "ms" milliseconds from now on CLOCK_MONOTONIC. */
+static void deadline(struct timespec *ts, uint64_t ms) {
+  clock_gettime(CLOCK_MONOTONIC, ts);
+  ts->tv_sec += (time_t)(ms / 1000);
+  ts->tv_nsec += (long)(ms % 1000) * 1000000;
+  if (ts->tv_nsec >= 1000000000) {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000;
+  }
+}
+
+/* This function drops the queue of the sink "s" after an error. */
+static void fail(struct sink *s) {
+  fprintf(stderr, "giving up on the %s output\n", s->name);
+  pthread_mutex_lock(&s->lock);
+  s->failed = 1;
+  for (; s->len; s->len--) {
+    free(s->queue[s->head].text);
+    s->head = (s->head + 1) % SINK_QUEUE_MAX;
+  }
+  pthread_mutex_unlock(&s->lock);
+}
+
+/*
+ * This function is the thread of the sink "arg": it writes the queued samples
+ * and texts, flushes the sink according to its batch and, once stopped,
+ * after the queue is empty.
+ */
+static void *run(void *arg) {
+  struct sink *s = arg;
+  struct timespec due;
+  size_t pending = 0;
+
+  for (;;) {
+    struct sink_item item;
+    int got, stopped;
+
+    pthread_mutex_lock(&s->lock);
+    while (s->len == 0 && !s->stop) {
+      if (pending && s->batch.interval) {
+        if (pthread_cond_timedwait(&s->wake, &s->lock, &due) == ETIMEDOUT)
+          break;
+      } else {
+        pthread_cond_wait(&s->wake, &s->lock);
+      }
+    }
+    got = s->len > 0;
+    if (got) {
+      item = s->queue[s->head];
+      s->head = (s->head + 1) % SINK_QUEUE_MAX;
+      s->len--;
+    }
+    stopped = s->stop;
+    pthread_mutex_unlock(&s->lock);
+
+    if (!got) {
+      /* the interval has passed, or the queue is drained */
+      if (pending && s->flush(s->ctx) < 0)
+        break;
+      pending = 0;
+      if (stopped)
+        return NULL;
+      continue;
+    }
+
+    if (item.text) {
+      int ret = s->write_text(s->ctx, item.text, item.len);
+
+      free(item.text);
+      if (ret < 0 || (item.last && s->flush(s->ctx) < 0))
+        break;
+      if (item.last)
+        pending = 0;
+      continue;
+    }
+
+    if (s->write(s->ctx, &item.sample) < 0)
+      break;
+    if (pending++ == 0)
+      deadline(&due, s->batch.interval);
+    if (item.last && pending >= s->batch.records) {
+      if (s->flush(s->ctx) < 0)
+        break;
+      pending = 0;
+    }
+  }
+
+  fail(s);
+  return NULL;
+}
+
+void sink_set_init(struct sink_set *set) {
+  memset(set, 0, sizeof(*set));
+}
+
+/*
+ * This function adds the sink "name" to "set", which queues samples with
+ * "write" and text with "write_text" (which may be NULL) and delivers them
+ * with "flush", all called with "ctx" on a thread of the sink, and is flushed
+ * according to "batch". The thread blocks all signals, so they keep going to
+ * the sampling thread.
+ * On success the sink is returned.
+ * On error NULL is returned.
+ */
+struct sink *sink_add(struct sink_set *set, const char *name,
+                      int (*write)(void *ctx, const struct sample *s),
+                      int (*write_text)(void *ctx, const char *text,
+                                        size_t len),
+                      int (*flush)(void *ctx), void *ctx,
+                      const struct sink_batch *batch) {
+  pthread_condattr_t attr;
+  sigset_t all, old;
+  struct sink *s;
+  int err;
+
+  if (set->n == SINKS_MAX) {
+    fprintf(stderr, "too many outputs\n");
+    return NULL;
+  }
+
+  s = &set->sinks[set->n];
+  memset(s, 0, sizeof(*s));
+  s->name = name;
+  s->write = write;
+  s->write_text = write_text;
+  s->flush = flush;
+  s->ctx = ctx;
+  s->batch = *batch;
+  s->queue = malloc(SINK_QUEUE_MAX * sizeof(*s->queue));
+  if (s->queue == NULL) {
+    fprintf(stderr, "couldn't allocate the %s output\n", name);
+    return NULL;
+  }
+
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&s->wake, &attr);
+  pthread_condattr_destroy(&attr);
+
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  err = pthread_create(&s->thread, NULL, run, s);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (err) {
+    fprintf(stderr, "couldn't start the %s output: %s\n", name, strerror(err));
+    pthread_cond_destroy(&s->wake);
+    pthread_mutex_destroy(&s->lock);
+    free(s->queue);
+    return NULL;
+  }
+
+  set->n++;
+  return s;
+}
+
+/*
+ * This function queues "item" for the sink "s", which must be locked, and
+ * returns it, or returns NULL and counts it as dropped if the queue is full.
+ */
+static struct sink_item *enqueue(struct sink *s, const struct sink_item *item) {
+  struct sink_item *slot;
+
+  if (s->len == SINK_QUEUE_MAX) {
+    s->dropped++;
+    return NULL;
+  }
+  slot = &s->queue[(s->head + s->len++) % SINK_QUEUE_MAX];
+  *slot = *item;
+  return slot;
+}
+
+/*
+ * This function queues the "n" samples "samples" of a round for every sink of
+ * "set" which hasn't failed. It never waits for a sink to write them.
+ */
+void sink_deliver(struct sink_set *set, const struct sample *samples,
+                  size_t n) {
+  struct sink_item item;
+  size_t i, j;
+
+  memset(&item, 0, sizeof(item));
+  for (i = 0; i < set->n; i++) {
+    struct sink *s = &set->sinks[i];
+    struct sink_item *last = NULL;
+
+    pthread_mutex_lock(&s->lock);
+    for (j = 0; j < n && !s->failed; j++) {
+      struct sink_item *slot;
+
+      item.sample = samples[j];
+      slot = enqueue(s, &item);
+      if (slot)
+        last = slot;
+    }
+    if (last) {
+      last->last = 1;
+      pthread_cond_signal(&s->wake);
+    }
+    pthread_mutex_unlock(&s->lock);
+  }
+}
+
+/*
+ * This function queues the "len" characters "text", allocated with malloc(),
+ * for the sink "s", which takes it over, after the samples queued so far. If
+ * "flush" is set, the sink is flushed right after writing it.
+ */
+void sink_write_text(struct sink *s, char *text, size_t len, int flush) {
+  struct sink_item item;
+
+  memset(&item, 0, sizeof(item));
+  item.text = text;
+  item.len = len;
+  item.last = flush;
+
+  pthread_mutex_lock(&s->lock);
+  if (s->failed || enqueue(s, &item) == NULL)
+    free(text);
+  else
+    pthread_cond_signal(&s->wake);
+  pthread_mutex_unlock(&s->lock);
+}
+
+/* This function returns the number of sinks of "set" which haven't failed. */
+size_t sink_alive(struct sink_set *set) {
+  size_t alive = 0, i;
+
+  for (i = 0; i < set->n; i++) {
+    pthread_mutex_lock(&set->sinks[i].lock);
+    alive += !set->sinks[i].failed;
+    pthread_mutex_unlock(&set->sinks[i].lock);
+  }
+
+  return alive;
+}
+
+/*
+ * This function stops all sinks of "set" once they have written and flushed
+ * their queue, and removes them. How much a sink dropped is reported.
+ * If no sink has failed 0 is returned.
+ * Otherwise -1 is returned.
+ */
+int sink_close_all(struct sink_set *set) {
+  int ret = 0;
+  size_t i;
+
+  for (i = 0; i < set->n; i++) {
+    pthread_mutex_lock(&set->sinks[i].lock);
+    set->sinks[i].stop = 1;
+    pthread_cond_signal(&set->sinks[i].wake);
+    pthread_mutex_unlock(&set->sinks[i].lock);
+  }
+
+  for (i = 0; i < set->n; i++) {
+    struct sink *s = &set->sinks[i];
+
+    pthread_join(s->thread, NULL);
+    if (s->dropped)
+      fprintf(stderr, "the %s output fell behind, %llu records dropped\n",
+              s->name, s->dropped);
+    if (s->failed)
+      ret = -1;
+    pthread_cond_destroy(&s->wake);
+    pthread_mutex_destroy(&s->lock);
+    free(s->queue);
+  }
+  set->n = 0;
+
+  return ret;
+}
@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Sinks of the watch mode: the outputs the samples are delivered to (stdout,
+ * the timeline file, the collector and the journal). Every round produces one
+ * struct sample per display, after all displays were queried, and the samples
+ * are queued for every sink in turn. Each sink writes its queue on a thread
+ * of its own and is flushed on its own schedule: at the end of a round once
+ * "records" samples are pending, and "interval" milliseconds after the oldest
+ * pending one. The sampling never waits for a sink; one which falls behind by
+ * SINK_QUEUE_MAX samples drops the new ones. A sink which fails is reported
+ * and dropped, the others carry on; the watch mode ends once all sinks have
+ * failed.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_SINK_H
+#define XPRINTIDLE_SINK_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Maximum number of sinks. */
+#define SINKS_MAX 8
+
+/* Number of samples a sink can fall behind by. */
+#define SINK_QUEUE_MAX 1024
+
+/* Value of "activity" of struct sample if no activity window is kept. */
+#define SAMPLE_NO_ACTIVITY (-2)
+
+/* Changes between active and idle, see struct sample. */
+enum sample_transition {
+  SAMPLE_STEADY,
+  SAMPLE_TO_IDLE,
+  SAMPLE_TO_ACTIVE,
+};
+
+/* A sample of one display. */
+struct sample {
+  size_t display;
+  /* wall clock time in milliseconds since the epoch */
+  uint64_t time;
+  uint64_t idle;
+  /* whether the active window is fullscreen, -1 if not followed */
+  int fullscreen;
+  /* active fraction of the activity window of the display (see
+   * activity_permille()), or SAMPLE_NO_ACTIVITY */
+  int activity;
+  /* whether the display just changed between active and idle */
+  enum sample_transition transition;
+  /* DPMS power level (0 for on to 3 for off), -1 if not known */
+  int dpms;
+};
+
+/* When a sink is flushed: once "records" samples are pending (0 for every
+ * round) or "interval" milliseconds after the oldest one (0 for never). */
+struct sink_batch {
+  size_t records;
+  uint64_t interval;
+};
+
+/* A queued sample, or text which is written as is. */
+struct sink_item {
+  struct sample sample;
+  /* text allocated with malloc(), NULL for a sample */
+  char *text;
+  size_t len;
+  /* whether the sample is the last of its round, or the sink is flushed
+   * after the text */
+  int last;
+};
+
+struct sink {
+  const char *name;
+  /* queues a sample; returns -1 on error */
+  int (*write)(void *ctx, const struct sample *s);
+  /* queues text, NULL if the sink takes none; returns -1 on error */
+  int (*write_text)(void *ctx, const char *text, size_t len);
+  /* delivers the queued samples; returns -1 on error */
+  int (*flush)(void *ctx);
+  void *ctx;
+  struct sink_batch batch;
+  pthread_t thread;
+  /* guards the fields below; "wake" is signalled when they change */
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  struct sink_item *queue;
+  size_t head, len;
+  /* number of samples and texts dropped because the queue was full */
+  unsigned long long dropped;
+  int stop, failed;
+};
+
+struct sink_set {
+  size_t n;
+  struct sink sinks[SINKS_MAX];
+};
+
+void sink_set_init(struct sink_set *set);
+struct sink *sink_add(struct sink_set *set, const char *name,
+                      int (*write)(void *ctx, const struct sample *s),
+                      int (*write_text)(void *ctx, const char *text,
+                                        size_t len),
+                      int (*flush)(void *ctx), void *ctx,
+                      const struct sink_batch *batch);
+void sink_deliver(struct sink_set *set, const struct sample *samples,
+                  size_t n);
+void sink_write_text(struct sink *s, char *text, size_t len, int flush);
+size_t sink_alive(struct sink_set *set);
+int sink_close_all(struct sink_set *set);
+
+#endif /* XPRINTIDLE_SINK_H */
@@ -0,0 +1,1574 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Compressed columnar timeline files of recorded idle time samples. See
+ * timeline.h for a description of the format.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "timeline.h"
+#include "journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void put16(unsigned char *p, uint16_t v) {
+  p[0] = (unsigned char)v;
+  p[1] = (unsigned char)(v >> 8);
+}
+
+static void put32(unsigned char *p, uint32_t v) {
+  put16(p, (uint16_t)v);
+  put16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void put64(unsigned char *p, uint64_t v) {
+  put32(p, (uint32_t)v);
+  put32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint16_t get16(const unsigned char *p) {
+  return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get32(const unsigned char *p) {
+  return (uint32_t)get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+static uint64_t get64(const unsigned char *p) {
+  return (uint64_t)get32(p) | (uint64_t)get32(p + 4) << 32;
+}
+
+static uint64_t zigzag(uint64_t v) {
+  return (v << 1) ^ (0 - (v >> 63));
+}
+
+static uint64_t unzigzag(uint64_t v) {
+  return (v >> 1) ^ (0 - (v & 1));
+}
+
+static size_t put_varint(unsigned char *p, uint64_t v) {
+  size_t len = 0;
+
+  while (v >= 0x80) {
+    p[len++] = (unsigned char)(v | 0x80);
+    v >>= 7;
+  }
+  p[len++] = (unsigned char)v;
+
+  return len;
+}
+
+/*
+ * This function decodes a varint at "*p", which must be before "end", and
+ * advances "*p" behind it.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static inline int get_varint(const unsigned char **p, const unsigned char *end,
+                             uint64_t *v) {
+  const unsigned char *q = *p;
+  uint64_t val = 0;
+  unsigned shift;
+
+  if (q < end && *q < 0x80) {
+    *v = *q;
+    *p = q + 1;
+    return 0;
+  }
+
+  for (shift = 0; q < end && shift < 64; shift += 7) {
+    unsigned char b = *q++;
+
+    val |= (uint64_t)(b & 0x7f) << shift;
+    if (b < 0x80) {
+      *v = val;
+      *p = q;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+  const char *p = buf;
+
+  while (len) {
+    ssize_t ret = write(fd, p, len);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    p += ret;
+    len -= (size_t)ret;
+  }
+
+  return 0;
+}
+
+/*
+ * This function updates the CRC-32 (IEEE 802.3) "crc" with "len" bytes of
+ * "buf". Start with a "crc" of 0.
+ */
+uint32_t tl_crc32(uint32_t crc, const void *buf, size_t len) {
+  static uint32_t table[256];
+  const unsigned char *p = buf;
+
+  if (table[1] == 0) {
+    uint32_t i, j, c;
+
+    for (i = 0; i < 256; i++) {
+      for (c = i, j = 0; j < 8; j++)
+        c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      table[i] = c;
+    }
+  }
+
+  crc = ~crc;
+  while (len--)
+    crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+
+  return ~crc;
+}
+
+/* This function writes the header of "blk" to "buf". */
+static void put_block_header(unsigned char *buf, const struct tl_block *blk) {
+  put32(buf, TL_BLOCK_MAGIC);
+  put16(buf + 4, blk->type);
+  put16(buf + 6, blk->series);
+  put32(buf + 8, blk->count);
+  put32(buf + 12, blk->time_len);
+  put32(buf + 16, blk->payload_len);
+  put32(buf + 20, blk->crc);
+  put64(buf + 24, blk->t_min);
+  put64(buf + 32, blk->t_max);
+}
+
+void tl_encoder_init(struct tl_encoder *enc, uint16_t series) {
+  enc->series = series;
+  enc->count = 0;
+  enc->time_len = 0;
+  enc->idle_len = 0;
+}
+
+/*
+ * This function appends a sample to the block of "enc", which must hold less
+ * than TL_BLOCK_SAMPLES_MAX samples.
+ */
+void tl_encoder_append(struct tl_encoder *enc, uint64_t time, uint64_t idle) {
+  if (enc->count == 0) {
+    enc->t_min = enc->t_max = time;
+    enc->prev_delta = 0;
+    /* the first timestamp relative to t_min, so always 0 here */
+    enc->time_len += put_varint(enc->time_col + enc->time_len, 0);
+    enc->idle_len += put_varint(enc->idle_col + enc->idle_len, idle);
+  } else {
+    int64_t delta = (int64_t)(time - enc->prev_time);
+
+    enc->time_len += put_varint(
+        enc->time_col + enc->time_len,
+        zigzag((uint64_t)delta - (uint64_t)enc->prev_delta));
+    enc->idle_len += put_varint(
+        enc->idle_col + enc->idle_len,
+        zigzag(idle - (enc->prev_idle + (uint64_t)delta)));
+    enc->prev_delta = delta;
+
+    if (time < enc->t_min) {
+      /* Clock went backwards. Rebase the first timestamp so the time column
+       * stays relative to t_min. */
+      unsigned char first[TL_VARINT_MAX];
+      const unsigned char *p = enc->time_col;
+      uint64_t off = 0;
+      size_t old_len, new_len;
+
+      get_varint(&p, enc->time_col + enc->time_len, &off);
+      old_len = (size_t)(p - enc->time_col);
+      new_len = put_varint(first, off + (enc->t_min - time));
+      memmove(enc->time_col + new_len, p, enc->time_len - old_len);
+      memcpy(enc->time_col, first, new_len);
+      enc->time_len = enc->time_len - old_len + new_len;
+      enc->t_min = time;
+    }
+    if (time > enc->t_max)
+      enc->t_max = time;
+  }
+
+  enc->prev_time = time;
+  enc->prev_idle = idle;
+  enc->count++;
+}
+
+/*
+ * This function writes the block of "enc" (header and payload) to "buf",
+ * which must hold at least TL_BLOCK_MAX bytes, and resets "enc" for the next
+ * block. The number of bytes written is returned.
+ */
+size_t tl_encoder_finish(struct tl_encoder *enc, unsigned char *buf) {
+  struct tl_block blk;
+  unsigned char *payload = buf + TL_BLOCK_HEADER_SIZE;
+
+  memcpy(payload, enc->time_col, enc->time_len);
+  memcpy(payload + enc->time_len, enc->idle_col, enc->idle_len);
+
+  blk.type = TL_BLOCK_SAMPLES;
+  blk.series = enc->series;
+  blk.count = enc->count;
+  blk.time_len = (uint32_t)enc->time_len;
+  blk.payload_len = (uint32_t)(enc->time_len + enc->idle_len);
+  blk.crc = tl_crc32(0, payload, blk.payload_len);
+  blk.t_min = enc->t_min;
+  blk.t_max = enc->t_max;
+  put_block_header(buf, &blk);
+
+  tl_encoder_init(enc, enc->series);
+
+  return TL_BLOCK_HEADER_SIZE + blk.payload_len;
+}
+
+/*
+ * This function returns a newly allocated string with "suffix" appended to
+ * "path", or NULL if out of memory.
+ */
+static char *suffixed_path(const char *path, const char *suffix) {
+  size_t len = strlen(path), suffix_len = strlen(suffix);
+  char *spath = malloc(len + suffix_len + 1);
+
+  if (spath) {
+    memcpy(spath, path, len);
+    memcpy(spath + len, suffix, suffix_len + 1);
+  }
+
+  return spath;
+}
+
+/* This function returns the path of the index of the timeline "path". */
+static char *index_path(const char *path) {
+  return suffixed_path(path, ".idx");
+}
+
+/* This function returns the path of the journal of the timeline "path". */
+static char *journal_path(const char *path) {
+  return suffixed_path(path, ".journal");
+}
+
+static void put_index_header(unsigned char *buf, uint64_t max_span,
+                             uint64_t covered) {
+  memset(buf, 0, TL_INDEX_HEADER_SIZE);
+  memcpy(buf, TL_INDEX_MAGIC, 8);
+  put32(buf + 8, TL_INDEX_VERSION);
+  put64(buf + 16, max_span);
+  put64(buf + 24, covered);
+}
+
+static void put_index_entry(unsigned char *buf,
+                            const struct tl_index_entry *e) {
+  put64(buf, e->t_min);
+  put64(buf + 8, e->t_max);
+  put64(buf + 16, e->offset);
+  put16(buf + 24, e->type);
+  put16(buf + 26, e->series);
+  put32(buf + 28, e->count);
+}
+
+/*
+ * This function appends the entry "e" to the index "fd" and updates the
+ * header to cover the timeline up to "covered" bytes.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int append_index(int fd, const struct tl_index_entry *e,
+                        uint64_t *max_span, uint64_t covered) {
+  unsigned char buf[TL_INDEX_ENTRY_SIZE];
+  unsigned char hdr[TL_INDEX_HEADER_SIZE];
+
+  if (e->t_max - e->t_min > *max_span)
+    *max_span = e->t_max - e->t_min;
+
+  put_index_entry(buf, e);
+  put_index_header(hdr, *max_span, covered);
+  if (write_all(fd, buf, sizeof(buf)) < 0 ||
+      pwrite(fd, hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr))
+    return -1;
+
+  return 0;
+}
+
+/*
+ * This function opens the index of the timeline "path", which is "size" bytes
+ * long, for appending. If the index is missing or doesn't cover the whole
+ * timeline it is rebuilt first. The index isn't opened with O_APPEND, which
+ * would make the header updates with pwrite() append as well; the file offset
+ * is left at its end instead. The longest block time span found in the
+ * index is written to "max_span", the t_max of the last entry to
+ * "last_time" and the size of the valid part of the timeline to "covered".
+ * On success the file descriptor of the index is returned.
+ * On error -1 is returned.
+ */
+static int open_index(const char *path, uint64_t size, uint64_t *max_span,
+                      uint64_t *last_time, uint64_t *covered) {
+  unsigned char hdr[TL_INDEX_HEADER_SIZE];
+  unsigned char buf[TL_INDEX_ENTRY_SIZE];
+  char *ipath = index_path(path);
+  off_t end;
+  int fd;
+
+  if (ipath == NULL) {
+    fprintf(stderr, "couldn't allocate index path\n");
+    return -1;
+  }
+
+  fd = open(ipath, O_RDWR | O_CLOEXEC);
+  if (fd >= 0 && (pread(fd, hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+                  memcmp(hdr, TL_INDEX_MAGIC, 8) ||
+                  get32(hdr + 8) != TL_INDEX_VERSION ||
+                  get64(hdr + 24) != size)) {
+    close(fd);
+    fd = -1;
+  }
+
+  if (fd < 0) {
+    if (tl_index_rebuild(path) < 0) {
+      free(ipath);
+      return -1;
+    }
+    fd = open(ipath, O_RDWR | O_CLOEXEC);
+    if (fd < 0 || pread(fd, hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+      fprintf(stderr, "couldn't open index '%s': %s\n", ipath,
+              strerror(errno));
+      if (fd >= 0)
+        close(fd);
+      free(ipath);
+      return -1;
+    }
+  }
+
+  *max_span = get64(hdr + 16);
+  *covered = get64(hdr + 24);
+  *last_time = 0;
+  end = lseek(fd, 0, SEEK_END);
+  if (end >= TL_INDEX_HEADER_SIZE + TL_INDEX_ENTRY_SIZE &&
+      pread(fd, buf, sizeof(buf), end - TL_INDEX_ENTRY_SIZE) ==
+          (ssize_t)sizeof(buf))
+    *last_time = get64(buf + 8);
+
+  free(ipath);
+  return fd;
+}
+
+/*
+ * This function locks the timeline "path", which is open as "*fd", for
+ * writing. If the timeline was replaced by a compaction before the lock was
+ * taken, "*fd" is closed and the new file is opened and locked instead.
+ * If "path" was replaced 1 is returned, otherwise 0.
+ * On error -1 is returned.
+ */
+static int lock_file(const char *path, int *fd) {
+  struct stat st, cur;
+  int replaced = 0;
+
+  for (;;) {
+    int new_fd;
+
+    while (flock(*fd, LOCK_EX) < 0) {
+      if (errno != EINTR)
+        return -1;
+    }
+    if (fstat(*fd, &cur) < 0 || stat(path, &st) < 0) {
+      flock(*fd, LOCK_UN);
+      return -1;
+    }
+    if (st.st_dev == cur.st_dev && st.st_ino == cur.st_ino)
+      return replaced;
+
+    new_fd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (new_fd < 0) {
+      flock(*fd, LOCK_UN);
+      return -1;
+    }
+    close(*fd);
+    *fd = new_fd;
+    replaced = 1;
+  }
+}
+
+/*
+ * This function locks the timeline of "w" for writing a block. If it was
+ * replaced by a compaction meanwhile, the writer switches to the new file and
+ * its index.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int lock_timeline(struct tl_writer *w) {
+  uint64_t covered;
+  struct stat st;
+  int ret = lock_file(w->path, &w->fd);
+
+  if (ret < 0) {
+    fprintf(stderr, "couldn't lock timeline '%s': %s\n", w->path,
+            strerror(errno));
+    return -1;
+  }
+  if (ret == 0)
+    return 0;
+
+  close(w->idx_fd);
+  w->idx_fd = -1;
+  if (fstat(w->fd, &st) < 0) {
+    fprintf(stderr, "couldn't stat timeline '%s': %s\n", w->path,
+            strerror(errno));
+    flock(w->fd, LOCK_UN);
+    return -1;
+  }
+  w->size = (uint64_t)st.st_size;
+  w->idx_fd =
+      open_index(w->path, w->size, &w->max_span, &w->last_time, &covered);
+  if (w->idx_fd < 0) {
+    flock(w->fd, LOCK_UN);
+    return -1;
+  }
+
+  return 0;
+}
+
+static int recover(struct tl_writer *w, const char *path, const char *jpath);
+
+/*
+ * This function opens the timeline file "path" for appending, creating it if
+ * it doesn't exist yet. A torn block at the end of the timeline is dropped and
+ * samples left in the journal by a crash are replayed into the timeline. If
+ * "journal" is set, new samples are journaled until they are part of a
+ * written block; the journal is committed with tl_writer_commit(). Blocks are
+ * written with the timeline locked, so it can be compacted while it is being
+ * recorded.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int tl_writer_open(struct tl_writer *w, const char *path, int journal) {
+  unsigned char hdr[TL_FILE_HEADER_SIZE];
+  char *jpath = NULL;
+  uint64_t covered;
+  struct stat st;
+
+  w->n_series = 0;
+  w->max_span = 0;
+  w->journal = NULL;
+  w->path = strdup(path);
+  if (w->path == NULL) {
+    fprintf(stderr, "couldn't allocate timeline path\n");
+    return -1;
+  }
+  w->fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (w->fd < 0) {
+    fprintf(stderr, "couldn't open timeline '%s': %s\n", path,
+            strerror(errno));
+    free(w->path);
+    return -1;
+  }
+
+  if (lock_file(path, &w->fd) < 0 || fstat(w->fd, &st) < 0) {
+    fprintf(stderr, "couldn't lock timeline '%s': %s\n", path,
+            strerror(errno));
+    close(w->fd);
+    free(w->path);
+    return -1;
+  }
+
+  if (st.st_size == 0) {
+    memset(hdr, 0, sizeof(hdr));
+    memcpy(hdr, TL_FILE_MAGIC, 8);
+    put32(hdr + 8, TL_FILE_VERSION);
+    if (write_all(w->fd, hdr, sizeof(hdr)) < 0) {
+      fprintf(stderr, "couldn't write timeline '%s': %s\n", path,
+              strerror(errno));
+      close(w->fd);
+      free(w->path);
+      return -1;
+    }
+    st.st_size = TL_FILE_HEADER_SIZE;
+  }
+  w->size = (uint64_t)st.st_size;
+
+  w->idx_fd = open_index(path, w->size, &w->max_span, &w->last_time, &covered);
+  if (w->idx_fd < 0) {
+    close(w->fd);
+    free(w->path);
+    return -1;
+  }
+
+  /* A block torn by a crash, drop it so new blocks are readable again. */
+  if (covered < w->size) {
+    fprintf(stderr, "timeline '%s': dropping %llu bytes of a torn block\n",
+            path, (unsigned long long)(w->size - covered));
+    if (ftruncate(w->fd, (off_t)covered) < 0) {
+      fprintf(stderr, "couldn't truncate timeline '%s': %s\n", path,
+              strerror(errno));
+      goto err;
+    }
+    w->size = covered;
+  }
+  flock(w->fd, LOCK_UN);
+
+  jpath = journal_path(path);
+  if (jpath == NULL) {
+    fprintf(stderr, "couldn't allocate journal path\n");
+    goto err;
+  }
+  if (recover(w, path, jpath) < 0)
+    goto err;
+
+  if (journal) {
+    w->journal = malloc(sizeof(*w->journal));
+    if (w->journal == NULL) {
+      fprintf(stderr, "couldn't allocate journal\n");
+      goto err;
+    }
+    if (journal_open(w->journal, jpath) < 0) {
+      free(w->journal);
+      w->journal = NULL;
+      goto err;
+    }
+  }
+
+  free(jpath);
+  return 0;
+
+err:
+  free(jpath);
+  close(w->idx_fd);
+  close(w->fd);
+  free(w->path);
+  return -1;
+}
+
+/*
+ * This function writes the encoded block "buf" of "len" bytes, whose header
+ * is "blk", to the timeline of "w" and adds it to the index.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int write_block_data(struct tl_writer *w, const struct tl_block *blk,
+                            const unsigned char *buf, size_t len) {
+  struct tl_index_entry e;
+  int ret = 0;
+
+  if (lock_timeline(w) < 0)
+    return -1;
+
+  if (write_all(w->fd, buf, len) < 0) {
+    fprintf(stderr, "couldn't write timeline: %s\n", strerror(errno));
+    flock(w->fd, LOCK_UN);
+    return -1;
+  }
+
+  if (blk->type == TL_BLOCK_SERIES) {
+    e.t_min = e.t_max = w->last_time;
+  } else {
+    e.t_min = blk->t_min;
+    e.t_max = blk->t_max;
+  }
+  e.offset = w->size;
+  e.type = blk->type;
+  e.series = blk->series;
+  e.count = blk->count;
+  w->size += len;
+  w->last_time = e.t_max;
+
+  if (append_index(w->idx_fd, &e, &w->max_span, w->size) < 0) {
+    fprintf(stderr, "couldn't write timeline index: %s\n", strerror(errno));
+    ret = -1;
+  }
+
+  flock(w->fd, LOCK_UN);
+  return ret;
+}
+
+/*
+ * This function starts a new series called "name" in the timeline of "w".
+ * Series are numbered in the order they are added, starting at 0.
+ * On success the number of the new series is returned.
+ * On error -1 is returned.
+ */
+int tl_writer_add_series(struct tl_writer *w, const char *name) {
+  unsigned char buf[TL_BLOCK_HEADER_SIZE + TL_SERIES_NAME_MAX];
+  struct tl_block blk;
+  size_t len = strlen(name);
+
+  if (w->n_series == TL_SERIES_MAX || len > TL_SERIES_NAME_MAX) {
+    fprintf(stderr, "too many or too long timeline series\n");
+    return -1;
+  }
+
+  w->enc[w->n_series] = malloc(sizeof(struct tl_encoder));
+  if (w->enc[w->n_series] == NULL) {
+    fprintf(stderr, "couldn't allocate timeline encoder\n");
+    return -1;
+  }
+  tl_encoder_init(w->enc[w->n_series], (uint16_t)w->n_series);
+
+  memset(&blk, 0, sizeof(blk));
+  blk.type = TL_BLOCK_SERIES;
+  blk.series = (uint16_t)w->n_series;
+  blk.payload_len = (uint32_t)len;
+  blk.crc = tl_crc32(0, name, len);
+  put_block_header(buf, &blk);
+  memcpy(buf + TL_BLOCK_HEADER_SIZE, name, len);
+
+  if (write_block_data(w, &blk, buf, TL_BLOCK_HEADER_SIZE + len) < 0) {
+    free(w->enc[w->n_series]);
+    return -1;
+  }
+
+  return (int)w->n_series++;
+}
+
+/*
+ * This function writes the pending block of "enc" to the timeline of "w".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int write_block(struct tl_writer *w, struct tl_encoder *enc) {
+  static unsigned char buf[TL_BLOCK_MAX];
+  struct tl_block blk;
+  size_t len;
+
+  if (enc->count == 0)
+    return 0;
+
+  len = tl_encoder_finish(enc, buf);
+  tl_block_parse(buf, len, &blk);
+
+  return write_block_data(w, &blk, buf, len);
+}
+
+/*
+ * This function replays the samples of the journal "jpath" which are not in
+ * the timeline "path" of "w" yet and empties the journal. The journal belongs
+ * to the last recording session of the timeline, whose series are the ones
+ * defined by the last series blocks.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int recover(struct tl_writer *w, const char *path, const char *jpath) {
+  static struct tl_encoder *enc[TL_SERIES_MAX];
+  static uint64_t last[TL_SERIES_MAX];
+  static int known[TL_SERIES_MAX], written[TL_SERIES_MAX];
+  struct journal_record *recs;
+  struct tl_index idx;
+  size_t n, i, replayed = 0;
+  int ret = 0;
+
+  if (journal_recover(jpath, &recs, &n) < 0)
+    return -1;
+  if (n == 0) {
+    free(recs);
+    return 0;
+  }
+
+  memset(known, 0, sizeof(known));
+  memset(written, 0, sizeof(written));
+  if (tl_index_open(&idx, path, w->size) == 0) {
+    for (i = idx.n; i-- > 0;) {
+      struct tl_index_entry e;
+
+      tl_index_get(&idx, i, &e);
+      if (e.series >= TL_SERIES_MAX)
+        continue;
+      if (e.type == TL_BLOCK_SAMPLES && !written[e.series]) {
+        last[e.series] = e.t_max;
+        written[e.series] = 1;
+      } else if (e.type == TL_BLOCK_SERIES) {
+        known[e.series] = 1;
+        if (e.series == 0)
+          break;
+      }
+    }
+    tl_index_close(&idx);
+  }
+
+  for (i = 0; i < n && ret == 0; i++) {
+    uint32_t series = recs[i].series;
+
+    if (series >= TL_SERIES_MAX || !known[series] ||
+        (written[series] && recs[i].time <= last[series]))
+      continue;
+
+    if (enc[series] == NULL) {
+      enc[series] = malloc(sizeof(struct tl_encoder));
+      if (enc[series] == NULL) {
+        fprintf(stderr, "couldn't allocate timeline encoder\n");
+        ret = -1;
+        break;
+      }
+      tl_encoder_init(enc[series], (uint16_t)series);
+    }
+
+    tl_encoder_append(enc[series], recs[i].time, recs[i].idle);
+    replayed++;
+    if (enc[series]->count == TL_BLOCK_SAMPLES_MAX)
+      ret = write_block(w, enc[series]);
+  }
+
+  for (i = 0; i < TL_SERIES_MAX; i++) {
+    if (enc[i] == NULL)
+      continue;
+    if (ret == 0)
+      ret = write_block(w, enc[i]);
+    free(enc[i]);
+    enc[i] = NULL;
+  }
+  free(recs);
+
+  if (ret == 0 && fdatasync(w->fd) < 0) {
+    fprintf(stderr, "couldn't sync timeline '%s': %s\n", path,
+            strerror(errno));
+    ret = -1;
+  }
+  if (ret == 0 && truncate(jpath, 0) < 0) {
+    fprintf(stderr, "couldn't truncate journal '%s': %s\n", jpath,
+            strerror(errno));
+    ret = -1;
+  }
+
+  if (ret == 0 && replayed)
+    fprintf(stderr, "timeline '%s': recovered %zu samples from the journal\n",
+            path, replayed);
+
+  return ret;
+}
+
+/*
+ * This function syncs the timeline of "w" and empties its journal if no
+ * samples are waiting for their block to be written anymore.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int checkpoint(struct tl_writer *w) {
+  size_t i;
+
+  if (w->journal == NULL)
+    return 0;
+  for (i = 0; i < w->n_series; i++) {
+    if (w->enc[i]->count)
+      return 0;
+  }
+
+  if (fdatasync(w->fd) < 0) {
+    fprintf(stderr, "couldn't sync timeline: %s\n", strerror(errno));
+    return -1;
+  }
+
+  return journal_reset(w->journal);
+}
+
+/*
+ * This function appends a sample to "series" of the timeline of "w". The
+ * sample is journaled first if "w" has a journal. Full blocks are written to
+ * the file right away.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int tl_writer_append(struct tl_writer *w, uint16_t series, uint64_t time,
+                     uint64_t idle) {
+  struct tl_encoder *enc = w->enc[series];
+
+  if (w->journal) {
+    struct journal_record rec;
+
+    rec.series = series;
+    rec.time = time;
+    rec.idle = idle;
+    if (journal_append(w->journal, &rec) < 0)
+      return -1;
+  }
+
+  tl_encoder_append(enc, time, idle);
+  if (enc->count == TL_BLOCK_SAMPLES_MAX) {
+    if (write_block(w, enc) < 0)
+      return -1;
+    return checkpoint(w);
+  }
+
+  return 0;
+}
+
+/*
+ * This function commits the pending journal records of "w" right away.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int tl_writer_commit(struct tl_writer *w) {
+  return w->journal ? journal_commit(w->journal) : 0;
+}
+
+/*
+ * This function writes the pending blocks of all series of "w" to the file,
+ * even if they are not full yet.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int tl_writer_flush(struct tl_writer *w) {
+  size_t i;
+
+  for (i = 0; i < w->n_series; i++) {
+    if (write_block(w, w->enc[i]) < 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * This function flushes and closes the timeline of "w".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int tl_writer_close(struct tl_writer *w) {
+  int ret = tl_writer_flush(w);
+  size_t i;
+
+  if (ret == 0)
+    ret = checkpoint(w);
+  if (w->journal) {
+    journal_close(w->journal);
+    free(w->journal);
+    w->journal = NULL;
+  }
+
+  for (i = 0; i < w->n_series; i++)
+    free(w->enc[i]);
+  w->n_series = 0;
+
+  if (close(w->fd) < 0 && ret == 0) {
+    fprintf(stderr, "couldn't close timeline: %s\n", strerror(errno));
+    ret = -1;
+  }
+  close(w->idx_fd);
+  free(w->path);
+
+  return ret;
+}
+
+/*
+ * This function maps the timeline file "path" for reading.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int tl_reader_open(struct tl_reader *r, const char *path) {
+  struct stat st;
+  void *data;
+  int fd;
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "couldn't open timeline '%s': %s\n", path,
+            strerror(errno));
+    return -1;
+  }
+
+  if (fstat(fd, &st) < 0) {
+    fprintf(stderr, "couldn't stat timeline '%s': %s\n", path,
+            strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  if (st.st_size < TL_FILE_HEADER_SIZE) {
+    fprintf(stderr, "'%s' is not a timeline file\n", path);
+    close(fd);
+    return -1;
+  }
+
+  data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "couldn't map timeline '%s': %s\n", path,
+            strerror(errno));
+    return -1;
+  }
+
+  r->data = data;
+  r->size = (size_t)st.st_size;
+  r->off = TL_FILE_HEADER_SIZE;
+
+  if (memcmp(r->data, TL_FILE_MAGIC, 8) ||
+      get32(r->data + 8) != TL_FILE_VERSION) {
+    fprintf(stderr, "'%s' is not a timeline file\n", path);
+    tl_reader_close(r);
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * This function parses the block at the start of "buf" (which holds "size"
+ * bytes) into "blk" and verifies its checksum.
+ * On success the size of the block is returned.
+ * If "buf" doesn't hold a complete and valid block -1 is returned.
+ */
+int tl_block_parse(const unsigned char *buf, size_t size,
+                   struct tl_block *blk) {
+  if (size < TL_BLOCK_HEADER_SIZE || get32(buf) != TL_BLOCK_MAGIC)
+    return -1;
+
+  blk->type = get16(buf + 4);
+  blk->series = get16(buf + 6);
+  blk->count = get32(buf + 8);
+  blk->time_len = get32(buf + 12);
+  blk->payload_len = get32(buf + 16);
+  blk->crc = get32(buf + 20);
+  blk->t_min = get64(buf + 24);
+  blk->t_max = get64(buf + 32);
+  blk->payload = buf + TL_BLOCK_HEADER_SIZE;
+
+  if (blk->payload_len > size - TL_BLOCK_HEADER_SIZE ||
+      blk->time_len > blk->payload_len || blk->count > TL_BLOCK_SAMPLES_MAX ||
+      tl_crc32(0, blk->payload, blk->payload_len) != blk->crc)
+    return -1;
+
+  return (int)(TL_BLOCK_HEADER_SIZE + blk->payload_len);
+}
+
+/*
+ * This function reads the next block of the timeline of "r" into "blk".
+ * If a block was read 1 is returned.
+ * At the end of the file 0 is returned.
+ * If the next block is truncated or corrupt -1 is returned.
+ */
+int tl_reader_next(struct tl_reader *r, struct tl_block *blk) {
+  int len;
+
+  if (r->off == r->size)
+    return 0;
+
+  len = tl_block_parse(r->data + r->off, r->size - r->off, blk);
+  if (len < 0)
+    return -1;
+
+  r->off += (size_t)len;
+  return 1;
+}
+
+void tl_reader_close(struct tl_reader *r) {
+  munmap((void *)r->data, r->size);
+}
+
+/*
+ * This function decodes the samples of "blk" into "times" and "idles", which
+ * must hold at least "blk->count" values each.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int tl_block_decode(const struct tl_block *blk, uint64_t *times,
+                    uint64_t *idles) {
+  const unsigned char *p = blk->payload;
+  const unsigned char *time_end = p + blk->time_len;
+  const unsigned char *end = p + blk->payload_len;
+  uint64_t v, t, delta = 0, idle;
+  uint32_t i;
+
+  if (blk->type != TL_BLOCK_SAMPLES || blk->count == 0)
+    return -1;
+
+  if (get_varint(&p, time_end, &v) < 0)
+    return -1;
+  t = blk->t_min + v;
+  times[0] = t;
+  for (i = 1; i < blk->count; i++) {
+    if (get_varint(&p, time_end, &v) < 0)
+      return -1;
+    delta += unzigzag(v);
+    t += delta;
+    times[i] = t;
+  }
+  if (p != time_end)
+    return -1;
+
+  if (get_varint(&p, end, &idle) < 0)
+    return -1;
+  idles[0] = idle;
+  for (i = 1; i < blk->count; i++) {
+    if (get_varint(&p, end, &v) < 0)
+      return -1;
+    idle += (times[i] - times[i - 1]) + unzigzag(v);
+    idles[i] = idle;
+  }
+  if (p != end)
+    return -1;
+
+  return 0;
+}
+
+/*
+ * This function maps the index of the timeline "path" for reading. "size" is
+ * the current size of the timeline; an index which doesn't cover exactly that
+ * many bytes is considered stale.
+ * On success 0 is returned.
+ * If the index is missing, stale or invalid -1 is returned.
+ */
+int tl_index_open(struct tl_index *idx, const char *path, uint64_t size) {
+  char *ipath = index_path(path);
+  struct stat st;
+  void *data;
+  int fd;
+
+  if (ipath == NULL)
+    return -1;
+  fd = open(ipath, O_RDONLY | O_CLOEXEC);
+  free(ipath);
+  if (fd < 0)
+    return -1;
+
+  if (fstat(fd, &st) < 0 || st.st_size < TL_INDEX_HEADER_SIZE) {
+    close(fd);
+    return -1;
+  }
+
+  data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return -1;
+
+  idx->data = data;
+  idx->size = (size_t)st.st_size;
+  idx->n = (idx->size - TL_INDEX_HEADER_SIZE) / TL_INDEX_ENTRY_SIZE;
+  idx->max_span = get64(idx->data + 16);
+
+  if (memcmp(idx->data, TL_INDEX_MAGIC, 8) ||
+      get32(idx->data + 8) != TL_INDEX_VERSION ||
+      get64(idx->data + 24) != size) {
+    tl_index_close(idx);
+    return -1;
+  }
+
+  return 0;
+}
+
+/* This function reads entry "i" of the index "idx" into "e". */
+void tl_index_get(const struct tl_index *idx, size_t i,
+                  struct tl_index_entry *e) {
+  const unsigned char *p =
+      idx->data + TL_INDEX_HEADER_SIZE + i * TL_INDEX_ENTRY_SIZE;
+
+  e->t_min = get64(p);
+  e->t_max = get64(p + 8);
+  e->offset = get64(p + 16);
+  e->type = get16(p + 24);
+  e->series = get16(p + 26);
+  e->count = get32(p + 28);
+}
+
+/*
+ * This function binary searches the index "idx" for the first entry with a
+ * t_max at or after "time". Entries are ordered by t_max, so all blocks before
+ * the returned entry end before "time". If all blocks end before "time" the
+ * number of entries is returned.
+ */
+size_t tl_index_seek(const struct tl_index *idx, uint64_t time) {
+  size_t lo = 0, hi = idx->n;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    struct tl_index_entry e;
+
+    tl_index_get(idx, mid, &e);
+    if (e.t_max < time)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+void tl_index_close(struct tl_index *idx) {
+  munmap((void *)idx->data, idx->size);
+}
+
+/*
+ * This function (re)creates the index of the timeline "path" from the blocks
+ * of the timeline. Blocks after the first truncated or corrupt one are not
+ * indexed.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int tl_index_rebuild(const char *path) {
+  unsigned char hdr[TL_INDEX_HEADER_SIZE];
+  unsigned char buf[TL_INDEX_ENTRY_SIZE];
+  struct tl_reader r;
+  struct tl_block blk;
+  uint64_t max_span = 0, last_time = 0;
+  char *ipath, *tmp;
+  size_t off;
+  int fd;
+
+  if (tl_reader_open(&r, path) < 0)
+    return -1;
+
+  ipath = index_path(path);
+  tmp = ipath ? malloc(strlen(ipath) + sizeof(".tmp")) : NULL;
+  if (tmp == NULL) {
+    fprintf(stderr, "couldn't allocate index path\n");
+    free(ipath);
+    tl_reader_close(&r);
+    return -1;
+  }
+  strcpy(tmp, ipath);
+  strcat(tmp, ".tmp");
+
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    goto err;
+
+  put_index_header(hdr, 0, 0);
+  if (write_all(fd, hdr, sizeof(hdr)) < 0)
+    goto err;
+
+  for (off = r.off; tl_reader_next(&r, &blk) > 0; off = r.off) {
+    struct tl_index_entry e;
+
+    if (blk.type == TL_BLOCK_SERIES) {
+      e.t_min = e.t_max = last_time;
+    } else {
+      e.t_min = blk.t_min;
+      e.t_max = blk.t_max;
+    }
+    last_time = e.t_max;
+    e.offset = off;
+    e.type = blk.type;
+    e.series = blk.series;
+    e.count = blk.count;
+    if (e.t_max - e.t_min > max_span)
+      max_span = e.t_max - e.t_min;
+
+    put_index_entry(buf, &e);
+    if (write_all(fd, buf, sizeof(buf)) < 0)
+      goto err;
+  }
+
+  put_index_header(hdr, max_span, r.off);
+  if (pwrite(fd, hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+      close(fd) < 0) {
+    fd = -1;
+    goto err;
+  }
+  fd = -1;
+  if (rename(tmp, ipath) < 0)
+    goto err;
+
+  free(tmp);
+  free(ipath);
+  tl_reader_close(&r);
+  return 0;
+
+err:
+  fprintf(stderr, "couldn't write index '%s': %s\n", ipath, strerror(errno));
+  if (fd >= 0)
+    close(fd);
+  unlink(tmp);
+  free(tmp);
+  free(ipath);
+  tl_reader_close(&r);
+  return -1;
+}
+
+/* A series of a timeline being compacted. Series are merged by name. */
+struct compact_series {
+  char name[TL_SERIES_NAME_MAX + 1];
+  int out;
+  int pending;
+  uint64_t time, idle;
+};
+
+struct compaction {
+  const struct tl_retention *ret;
+  uint64_t drop_before;
+  struct tl_writer w;
+  size_t n;
+  struct compact_series series[TL_SERIES_MAX];
+  int map[TL_SERIES_MAX];
+};
+
+/*
+ * This function returns the series of "c" called "name" (of "len" bytes),
+ * adding it if it doesn't exist yet, or NULL if there are too many series.
+ */
+static struct compact_series *find_series(struct compaction *c,
+                                          const unsigned char *name,
+                                          size_t len) {
+  struct compact_series *cs;
+  size_t i;
+
+  for (i = 0; i < c->n; i++) {
+    if (strlen(c->series[i].name) == len &&
+        !memcmp(c->series[i].name, name, len))
+      return &c->series[i];
+  }
+  if (c->n == TL_SERIES_MAX) {
+    fprintf(stderr, "too many timeline series\n");
+    return NULL;
+  }
+
+  cs = &c->series[c->n++];
+  memcpy(cs->name, name, len);
+  cs->name[len] = '\0';
+  cs->out = -1;
+  cs->pending = 0;
+  return cs;
+}
+
+/*
+ * This function appends a sample to the series "cs" of the compacted
+ * timeline, starting the series on its first sample.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int compact_emit(struct compaction *c, struct compact_series *cs,
+                        uint64_t time, uint64_t idle) {
+  if (cs->out < 0) {
+    cs->out = tl_writer_add_series(&c->w, cs->name);
+    if (cs->out < 0)
+      return -1;
+  }
+
+  return tl_writer_append(&c->w, (uint16_t)cs->out, time, idle);
+}
+
+/*
+ * This function applies the retention settings of "c" to a sample of "cs":
+ * samples before "drop_before" are dropped, and of the samples before
+ * "raw_before" only the last one of every "resolution" milliseconds is kept.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int compact_sample(struct compaction *c, struct compact_series *cs,
+                          uint64_t time, uint64_t idle) {
+  uint64_t resolution = c->ret->resolution;
+
+  if (time < c->drop_before)
+    return 0;
+
+  if (resolution && time < c->ret->raw_before) {
+    if (cs->pending && cs->time / resolution != time / resolution &&
+        compact_emit(c, cs, cs->time, cs->idle) < 0)
+      return -1;
+    cs->pending = 1;
+    cs->time = time;
+    cs->idle = idle;
+    return 0;
+  }
+
+  if (cs->pending) {
+    cs->pending = 0;
+    if (compact_emit(c, cs, cs->time, cs->idle) < 0)
+      return -1;
+  }
+
+  return compact_emit(c, cs, time, idle);
+}
+
+/*
+ * This function writes the blocks of "r" compacted to the new timeline "tmp".
+ * The series of the last recording session keep their numbers, so a running
+ * recorder can continue in the compacted timeline.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int compact_pass(struct compaction *c, struct tl_reader *r,
+                        const char *tmp) {
+  static uint64_t times[TL_BLOCK_SAMPLES_MAX], idles[TL_BLOCK_SAMPLES_MAX];
+  struct tl_block blk;
+  char *ipath = index_path(tmp);
+  size_t i, n_session = 0;
+  int ret;
+
+  if (ipath == NULL) {
+    fprintf(stderr, "couldn't allocate index path\n");
+    return -1;
+  }
+  unlink(tmp);
+  unlink(ipath);
+  free(ipath);
+
+  /* The series blocks of a session number its series from 0. */
+  c->n = 0;
+  r->off = TL_FILE_HEADER_SIZE;
+  while ((ret = tl_reader_next(r, &blk)) > 0) {
+    if (blk.type != TL_BLOCK_SERIES || blk.series >= TL_SERIES_MAX ||
+        blk.payload_len > TL_SERIES_NAME_MAX)
+      continue;
+    if (blk.series == 0)
+      n_session = 0;
+    if (blk.series != n_session)
+      continue;
+    memcpy(c->series[n_session].name, blk.payload, blk.payload_len);
+    c->series[n_session].name[blk.payload_len] = '\0';
+    n_session++;
+  }
+  if (ret < 0)
+    goto corrupt;
+
+  if (tl_writer_open(&c->w, tmp, 0) < 0)
+    return -1;
+  for (i = 0; i < n_session; i++) {
+    c->series[i].out = tl_writer_add_series(&c->w, c->series[i].name);
+    c->series[i].pending = 0;
+    if (c->series[i].out < 0)
+      goto err;
+  }
+  c->n = n_session;
+
+  for (i = 0; i < TL_SERIES_MAX; i++)
+    c->map[i] = -1;
+
+  r->off = TL_FILE_HEADER_SIZE;
+  while ((ret = tl_reader_next(r, &blk)) > 0) {
+    struct compact_series *cs;
+    uint32_t j;
+
+    if (blk.series >= TL_SERIES_MAX)
+      continue;
+    if (blk.type == TL_BLOCK_SERIES) {
+      cs = find_series(c, blk.payload,
+                       blk.payload_len > TL_SERIES_NAME_MAX
+                           ? TL_SERIES_NAME_MAX
+                           : blk.payload_len);
+      if (cs == NULL)
+        goto err;
+      c->map[blk.series] = (int)(cs - c->series);
+      continue;
+    }
+    if (blk.type != TL_BLOCK_SAMPLES || c->map[blk.series] < 0)
+      continue;
+
+    if (tl_block_decode(&blk, times, idles) < 0) {
+      ret = -1;
+      break;
+    }
+    cs = &c->series[c->map[blk.series]];
+    for (j = 0; j < blk.count; j++) {
+      if (compact_sample(c, cs, times[j], idles[j]) < 0)
+        goto err;
+    }
+  }
+  if (ret < 0) {
+    tl_writer_close(&c->w);
+    goto corrupt;
+  }
+
+  for (i = 0; i < c->n; i++) {
+    if (c->series[i].pending &&
+        compact_emit(c, &c->series[i], c->series[i].time, c->series[i].idle) <
+            0)
+      goto err;
+  }
+
+  return tl_writer_flush(&c->w);
+
+corrupt:
+  fprintf(stderr, "corrupt timeline block at offset %zu\n", r->off);
+  return -1;
+
+err:
+  tl_writer_close(&c->w);
+  return -1;
+}
+
+/*
+ * This function returns the time before which samples have to be dropped so
+ * the compacted timeline "tmp" of "size" bytes shrinks to "max_size" bytes,
+ * taking whole blocks from its start.
+ */
+static uint64_t size_cutoff(const char *tmp, uint64_t size,
+                            uint64_t max_size) {
+  uint64_t excess = size - max_size, freed = 0, cutoff = 0;
+  struct tl_index idx;
+  size_t i;
+
+  if (tl_index_open(&idx, tmp, size) < 0)
+    return 0;
+
+  for (i = 0; i < idx.n && freed < excess; i++) {
+    struct tl_index_entry e, next;
+
+    tl_index_get(&idx, i, &e);
+    if (e.type != TL_BLOCK_SAMPLES)
+      continue;
+    next.offset = size;
+    if (i + 1 < idx.n)
+      tl_index_get(&idx, i + 1, &next);
+    freed += next.offset - e.offset;
+    if (e.t_max + 1 > cutoff)
+      cutoff = e.t_max + 1;
+  }
+
+  tl_index_close(&idx);
+  return cutoff;
+}
+
+/*
+ * This function appends the blocks written to the timeline "path" after
+ * offset "from" to the compacted timeline of "c". The timeline must be
+ * locked, so no block is written meanwhile.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int copy_tail(struct compaction *c, const char *path, size_t from) {
+  struct tl_reader r;
+  struct tl_block blk;
+  size_t off;
+  int ret;
+
+  if (tl_reader_open(&r, path) < 0)
+    return -1;
+
+  r.off = from;
+  for (off = r.off; (ret = tl_reader_next(&r, &blk)) > 0; off = r.off) {
+    if (write_block_data(&c->w, &blk, r.data + off, r.off - off) < 0) {
+      ret = -1;
+      break;
+    }
+  }
+  if (ret < 0)
+    fprintf(stderr, "couldn't copy timeline block at offset %zu\n", off);
+
+  tl_reader_close(&r);
+  return ret;
+}
+
+/*
+ * This function compacts the timeline "path" according to "ret" (see struct
+ * tl_retention): blocks of all recording sessions are merged into full blocks
+ * per series name, old samples are downsampled and dropped, and the result
+ * replaces the timeline and its index. Blocks written by a recorder while the
+ * timeline is being compacted are carried over and the recorder continues in
+ * the compacted timeline.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int tl_compact(const char *path, const struct tl_retention *ret) {
+  static struct compaction c;
+  char *tmp = suffixed_path(path, ".compact");
+  char *ipath = index_path(path);
+  char *tmp_ipath = tmp ? index_path(tmp) : NULL;
+  struct stat st, cur;
+  struct tl_reader r;
+  size_t snapshot;
+  int fd, i;
+
+  if (tmp == NULL || ipath == NULL || tmp_ipath == NULL) {
+    fprintf(stderr, "couldn't allocate timeline path\n");
+    goto err_path;
+  }
+
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fprintf(stderr, "couldn't open timeline '%s': %s\n", path,
+            strerror(errno));
+    goto err_path;
+  }
+
+  /* Blocks are written under the lock, so the mapping ends with a block. */
+  if (flock(fd, LOCK_EX) < 0) {
+    fprintf(stderr, "couldn't lock timeline '%s': %s\n", path,
+            strerror(errno));
+    goto err_fd;
+  }
+  if (tl_reader_open(&r, path) < 0)
+    goto err_fd;
+  flock(fd, LOCK_UN);
+  snapshot = r.size;
+
+  c.ret = ret;
+  c.drop_before = ret->drop_before;
+  for (i = 0;; i++) {
+    uint64_t cutoff;
+
+    if (compact_pass(&c, &r, tmp) < 0) {
+      tl_reader_close(&r);
+      goto err_tmp;
+    }
+    if (!ret->max_size || c.w.size <= ret->max_size || i == 8)
+      break;
+
+    /* Repacking may change block sizes, so check again. */
+    cutoff = size_cutoff(tmp, c.w.size, ret->max_size);
+    if (cutoff <= c.drop_before)
+      break;
+    c.drop_before = cutoff;
+    if (tl_writer_close(&c.w) < 0) {
+      tl_reader_close(&r);
+      goto err_tmp;
+    }
+  }
+  tl_reader_close(&r);
+
+  if (flock(fd, LOCK_EX) < 0 || fstat(fd, &cur) < 0 || stat(path, &st) < 0) {
+    fprintf(stderr, "couldn't lock timeline '%s': %s\n", path,
+            strerror(errno));
+    goto err_writer;
+  }
+  if (st.st_dev != cur.st_dev || st.st_ino != cur.st_ino) {
+    fprintf(stderr, "timeline '%s' was replaced while compacting it\n",
+            path);
+    goto err_writer;
+  }
+
+  if (copy_tail(&c, path, snapshot) < 0)
+    goto err_writer;
+  if (fdatasync(c.w.fd) < 0 || fdatasync(c.w.idx_fd) < 0) {
+    fprintf(stderr, "couldn't sync timeline '%s': %s\n", tmp,
+            strerror(errno));
+    goto err_writer;
+  }
+
+  /* A reader seeing the new index next to the old timeline ignores it as
+   * stale. */
+  if (rename(tmp_ipath, ipath) < 0 || rename(tmp, path) < 0) {
+    fprintf(stderr, "couldn't replace timeline '%s': %s\n", path,
+            strerror(errno));
+    goto err_writer;
+  }
+
+  tl_writer_close(&c.w);
+  close(fd);
+  free(tmp_ipath);
+  free(ipath);
+  free(tmp);
+  return 0;
+
+err_writer:
+  tl_writer_close(&c.w);
+err_tmp:
+  unlink(tmp);
+  unlink(tmp_ipath);
+err_fd:
+  close(fd);
+err_path:
+  free(tmp_ipath);
+  free(ipath);
+  free(tmp);
+  return -1;
+}
@@ -0,0 +1,234 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Compressed columnar timeline files of recorded idle time samples.
+ *
+ * A timeline file starts with a 16 byte file header followed by blocks. Every
+ * block has a 40 byte header (see struct tl_block) and a payload. Blocks of
+ * type TL_BLOCK_SERIES name a series (usually one per display), blocks of type
+ * TL_BLOCK_SAMPLES hold up to TL_BLOCK_SAMPLES_MAX samples of one series in
+ * two columns:
+ *
+ *  - the time column holds the offset of the first timestamp to "t_min" as
+ *    varint and the delta-of-delta of all following timestamps, zigzag varint
+ *    encoded (the delta before the first one counts as 0),
+ *  - the idle column holds the first idle time as varint and the difference
+ *    of every following idle time to its prediction (the previous idle time
+ *    plus the elapsed time), zigzag varint encoded.
+ *
+ * With a constant sampling interval both columns mostly consist of single
+ * byte zeros. All integers in headers are little endian.
+ *
+ * Next to every timeline file FILE the writer keeps a sparse index FILE.idx: a
+ * 32 byte header (magic, version, the longest time span of a block and the
+ * size of the timeline covered by the index) followed by a 32 byte entry
+ * (t_min, t_max, offset, type, series and count) per block. Blocks are written
+ * when they are complete, so the entries are ordered by t_max as long as the
+ * wall clock doesn't go backwards, which allows binary searching for a time.
+ * Entries of series blocks carry the t_max of the entry before them.
+ *
+ * Samples which are not yet part of a written block can be protected by a
+ * journal FILE.journal (see journal.h). It is emptied whenever all blocks
+ * are written and synced, and replayed into the timeline when the writer is
+ * opened after a crash.
+ *
+ * Blocks are written with the timeline locked (flock). tl_compact() rewrites
+ * a timeline into FILE.compact while it is being recorded, takes the lock to
+ * carry over the blocks written meanwhile and renames the result over FILE.
+ * A writer which finds FILE replaced after taking the lock switches to the
+ * new file. The series of the last recording session keep their numbers in
+ * the compacted timeline.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_TIMELINE_H
+#define XPRINTIDLE_TIMELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TL_FILE_MAGIC "XPITIMEL"
+#define TL_FILE_VERSION 1
+#define TL_FILE_HEADER_SIZE 16
+
+#define TL_BLOCK_MAGIC 0x42545058 /* "XPTB" */
+#define TL_BLOCK_HEADER_SIZE 40
+
+#define TL_BLOCK_SAMPLES 1
+#define TL_BLOCK_SERIES 2
+
+/* Maximum number of samples in one block. */
+#define TL_BLOCK_SAMPLES_MAX 1024
+
+/* Maximum number of series in one file. */
+#define TL_SERIES_MAX 256
+
+/* Longest series name. */
+#define TL_SERIES_NAME_MAX 255
+
+#define TL_INDEX_MAGIC "XPITLIDX"
+#define TL_INDEX_VERSION 1
+#define TL_INDEX_HEADER_SIZE 32
+#define TL_INDEX_ENTRY_SIZE 32
+
+/* Longest encoded varint. */
+#define TL_VARINT_MAX 10
+
+struct tl_block {
+  uint16_t type;
+  uint16_t series;
+  uint32_t count;
+  uint32_t time_len;
+  uint32_t payload_len;
+  uint32_t crc;
+  uint64_t t_min;
+  uint64_t t_max;
+  const unsigned char *payload;
+};
+
+/* Streaming encoder for the samples block of one series. Every appended
+ * sample is encoded into the two column buffers right away. */
+struct tl_encoder {
+  uint16_t series;
+  uint32_t count;
+  uint64_t t_min, t_max;
+  uint64_t prev_time, prev_idle;
+  int64_t prev_delta;
+  size_t time_len, idle_len;
+  unsigned char time_col[TL_BLOCK_SAMPLES_MAX * TL_VARINT_MAX];
+  unsigned char idle_col[TL_BLOCK_SAMPLES_MAX * TL_VARINT_MAX];
+};
+
+struct journal;
+
+struct tl_writer {
+  char *path;
+  int fd;
+  int idx_fd;
+  uint64_t size;
+  uint64_t max_span;
+  uint64_t last_time;
+  size_t n_series;
+  struct tl_encoder *enc[TL_SERIES_MAX];
+  struct journal *journal;
+};
+
+/* Retention settings of a timeline compaction. A setting of 0 disables the
+ * respective step. */
+struct tl_retention {
+  /* keep only the last sample of every "resolution" milliseconds of the
+   * samples taken before "raw_before" */
+  uint64_t raw_before;
+  uint64_t resolution;
+  /* drop samples taken before "drop_before" */
+  uint64_t drop_before;
+  /* drop the oldest samples until the timeline is at most "max_size" bytes */
+  uint64_t max_size;
+};
+
+struct tl_reader {
+  const unsigned char *data;
+  size_t size;
+  size_t off;
+};
+
+struct tl_index_entry {
+  uint64_t t_min;
+  uint64_t t_max;
+  uint64_t offset;
+  uint16_t type;
+  uint16_t series;
+  uint32_t count;
+};
+
+struct tl_index {
+  const unsigned char *data;
+  size_t size;
+  size_t n;
+  uint64_t max_span;
+};
+
+uint32_t tl_crc32(uint32_t crc, const void *buf, size_t len);
+
+void tl_encoder_init(struct tl_encoder *enc, uint16_t series);
+void tl_encoder_append(struct tl_encoder *enc, uint64_t time, uint64_t idle);
+size_t tl_encoder_finish(struct tl_encoder *enc, unsigned char *buf);
+
+#ifdef XPRINTIDLE_NO_RECORD
+
+/* xprintidle built without the "record" feature doesn't link the timeline
+ * library and doesn't accept --record. */
+static inline int tl_writer_open(struct tl_writer *w, const char *path,
+                                 int journal) {
+  (void)w;
+  (void)path;
+  (void)journal;
+  return -1;
+}
+static inline int tl_writer_add_series(struct tl_writer *w, const char *name) {
+  (void)w;
+  (void)name;
+  return -1;
+}
+static inline int tl_writer_append(struct tl_writer *w, uint16_t series,
+                                   uint64_t time, uint64_t idle) {
+  (void)w;
+  (void)series;
+  (void)time;
+  (void)idle;
+  return -1;
+}
+static inline int tl_writer_commit(struct tl_writer *w) {
+  (void)w;
+  return -1;
+}
+static inline int tl_writer_close(struct tl_writer *w) {
+  (void)w;
+  return -1;
+}
+
+#else
+
+int tl_writer_open(struct tl_writer *w, const char *path, int journal);
+int tl_writer_add_series(struct tl_writer *w, const char *name);
+int tl_writer_append(struct tl_writer *w, uint16_t series, uint64_t time,
+                     uint64_t idle);
+int tl_writer_flush(struct tl_writer *w);
+int tl_writer_commit(struct tl_writer *w);
+int tl_writer_close(struct tl_writer *w);
+
+#endif /* XPRINTIDLE_NO_RECORD */
+
+int tl_compact(const char *path, const struct tl_retention *ret);
+
+int tl_reader_open(struct tl_reader *r, const char *path);
+int tl_reader_next(struct tl_reader *r, struct tl_block *blk);
+void tl_reader_close(struct tl_reader *r);
+
+int tl_index_open(struct tl_index *idx, const char *path, uint64_t size);
+void tl_index_get(const struct tl_index *idx, size_t i,
+                  struct tl_index_entry *e);
+size_t tl_index_seek(const struct tl_index *idx, uint64_t time);
+void tl_index_close(struct tl_index *idx);
+int tl_index_rebuild(const char *path);
+
+int tl_block_parse(const unsigned char *buf, size_t size, struct tl_block *blk);
+int tl_block_decode(const struct tl_block *blk, uint64_t *times,
+                    uint64_t *idles);
+
+/* Size of a buffer that can hold any encoded block, header included. */
+#define TL_BLOCK_MAX                                                           \
+  (TL_BLOCK_HEADER_SIZE + 2 * TL_BLOCK_SAMPLES_MAX * TL_VARINT_MAX)
+
+#endif /* XPRINTIDLE_TIMELINE_H */
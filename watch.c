@@ -0,0 +1,1058 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Watch mode of xprintidle: periodically sample the idle time of one or more
+ * X displays and stream it to stdout.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "activity.h"
+#include "agent.h"
+#include "apps.h"
+#include "histogram.h"
+#include "input.h"
+#include "journald.h"
+#include "publish.h"
+#include "server.h"
+#include "sessions.h"
+#include "sink.h"
+#include "timeline.h"
+#include "watch.h"
+#include "xprintidle.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define JSON_TIME "{\"time\":"
+#define JSON_DISPLAY ",\"display\":"
+#define JSON_IDLE ",\"idle\":"
+#define JSON_FULLSCREEN ",\"fullscreen\":"
+#define JSON_ACTIVITY ",\"activity\":"
+#define HUMAN_FULLSCREEN " (fullscreen)"
+#define HUMAN_ACTIVE "% active"
+
+struct watch_display {
+  struct idle_display x;
+  /* "NAME " in front of plain and human records if there are several
+   * displays, empty otherwise. */
+  char label[WATCH_DISPLAY_NAME_MAX + 1];
+  size_t label_len;
+  /* Everything of a NDJSON record between the time and the idle value. */
+  char json[sizeof(JSON_DISPLAY) + JSON_STRING_MAX(WATCH_DISPLAY_NAME_MAX) +
+            sizeof(JSON_IDLE)];
+  size_t json_len;
+};
+
+/* Longest record render_record() writes. */
+#define RECORD_MAX                                                             \
+  (sizeof(JSON_TIME) + U64_STR_MAX +                                           \
+   sizeof(((struct watch_display *)0)->json) + HUMAN_TIME_MAX +                \
+   sizeof(JSON_FULLSCREEN) + sizeof("false") + sizeof(JSON_ACTIVITY) +         \
+   ACTIVITY_STR_MAX + 3)
+
+#define JSON_APP ",\"app\":"
+#define JSON_ACTIVE ",\"active\":"
+#define JSON_TITLE ",\"title\":"
+
+/* Longest record render_app() writes. */
+#define APP_RECORD_MAX                                                         \
+  (sizeof(JSON_TIME) + U64_STR_MAX + sizeof(JSON_APP) +                        \
+   JSON_STRING_MAX(APPS_NAME_MAX) + sizeof(JSON_ACTIVE) + U64_STR_MAX +        \
+   sizeof(JSON_TITLE) + JSON_STRING_MAX(APPS_TITLE_MAX) + HUMAN_TIME_MAX + 3)
+
+/* Longest record render_histogram() writes. */
+#define HISTOGRAM_RECORD_MAX                                                   \
+  (sizeof(JSON_TIME) + U64_STR_MAX + sizeof(JSON_DISPLAY) +                    \
+   JSON_STRING_MAX(WATCH_DISPLAY_NAME_MAX) + HISTOGRAM_JSON_MAX + 3)
+
+/* Prefixes and suffix of the plain and human-readable histogram lines, which
+ * fit into RECORD_MAX. */
+#define PLAIN_HISTOGRAM "histogram "
+#define HUMAN_HISTOGRAM "histogram: "
+#define HUMAN_PERIODS " periods"
+
+#define JSON_KEYS ",\"keys\":"
+#define JSON_CLICKS ",\"clicks\":"
+#define JSON_MOTION ",\"motion\":"
+#define PLAIN_INPUT "input "
+#define HUMAN_INPUT "input: "
+#define HUMAN_KEYS " keystrokes, "
+#define HUMAN_CLICKS " clicks, "
+
+/* Longest record render_input() writes. */
+#define INPUT_RECORD_MAX                                                       \
+  (sizeof(JSON_TIME) + sizeof(JSON_DISPLAY) +                                  \
+   JSON_STRING_MAX(WATCH_DISPLAY_NAME_MAX) + sizeof(JSON_KEYS) +               \
+   sizeof(JSON_CLICKS) + sizeof(JSON_MOTION) + 4 * U64_STR_MAX +               \
+   sizeof(HUMAN_INPUT) + sizeof(HUMAN_KEYS) + sizeof(HUMAN_CLICKS) +           \
+   sizeof(" px") + 3)
+
+/* Records other than samples (histograms, input counts and the active time
+ * of applications), collected for the stdout sink, which takes them over. */
+struct text {
+  char *data;
+  size_t len, cap;
+};
+
+/*
+ * This function returns a pointer to at least "size" free bytes at the end of
+ * "t", growing it if necessary. The caller adds the bytes it used to "t->len".
+ * If "t" can't be grown NULL is returned.
+ */
+static char *text_reserve(struct text *t, size_t size) {
+  if (t->cap - t->len < size) {
+    size_t cap = t->cap ? t->cap : 4096;
+    char *data;
+
+    while (cap - t->len < size)
+      cap *= 2;
+    data = realloc(t->data, cap);
+    if (data == NULL) {
+      fprintf(stderr, "couldn't allocate output\n");
+      return NULL;
+    }
+    t->data = data;
+    t->cap = cap;
+  }
+
+  return t->data + t->len;
+}
+
+/*
+ * This function hands the records of "t" over to the stdout sink "s" unless
+ * "ok" is 0 and empties "t"; the sink is flushed after them if "flush" is set.
+ */
+static void text_send(struct text *t, struct sink *s, int ok, int flush) {
+  if (ok && t->len)
+    sink_write_text(s, t->data, t->len, flush);
+  else
+    free(t->data);
+  memset(t, 0, sizeof(*t));
+}
+
+/*
+ * Timers of the watch loop. "tick" expires every interval on CLOCK_BOOTTIME,
+ * which keeps running during suspend, so a round which became due while the
+ * system was suspended is done right after resume instead of one interval
+ * later. "jump" is an absolute CLOCK_REALTIME timer in the far future armed
+ * with TFD_TIMER_CANCEL_ON_SET; it is canceled when the wall clock is set and
+ * on resume, which makes the loop sample right away.
+ */
+struct watch_clock {
+  int tick;
+  int jump;
+};
+
+static volatile sig_atomic_t stop, dump;
+
+static void handle_stop(int sig) {
+  (void)sig;
+  stop = 1;
+}
+
+static void handle_dump(int sig) {
+  (void)sig;
+  dump = 1;
+}
+
+/*
+ * This function makes SIGINT and SIGTERM end the watch loop after the current
+ * round, so pending timeline blocks are written before exiting. SIGPIPE is
+ * ignored, so a closed stdout only fails its sink.
+ */
+static void install_stop_handlers(void) {
+  struct sigaction sa;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = handle_stop;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  sa.sa_handler = SIG_IGN;
+  sigaction(SIGPIPE, &sa, NULL);
+}
+
+/*
+ * This function makes SIGUSR1 end the wait for the next round, after which
+ * the idle period histograms and the active time of the applications are
+ * printed.
+ */
+static void install_dump_handler(void) {
+  struct sigaction sa;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = handle_dump;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGUSR1, &sa, NULL);
+}
+
+/*
+ * This function prepares the constant parts of the records of "wd", so
+ * rendering a sample only has to format the numbers.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int prepare_display(struct watch_display *wd, int labeled) {
+  size_t len = strlen(wd->x.name);
+  char *p;
+
+  if (len > WATCH_DISPLAY_NAME_MAX) {
+    fprintf(stderr, "display name '%s' too long\n", wd->x.name);
+    return -1;
+  }
+
+  wd->label_len = 0;
+  if (labeled) {
+    memcpy(wd->label, wd->x.name, len);
+    wd->label[len] = ' ';
+    wd->label_len = len + 1;
+  }
+
+  p = wd->json;
+  memcpy(p, JSON_DISPLAY, sizeof(JSON_DISPLAY) - 1);
+  p += sizeof(JSON_DISPLAY) - 1;
+  p += format_json_string(p, wd->x.name);
+  memcpy(p, JSON_IDLE, sizeof(JSON_IDLE) - 1);
+  p += sizeof(JSON_IDLE) - 1;
+  wd->json_len = (size_t)(p - wd->json);
+
+  return 0;
+}
+
+/*
+ * This function writes the sample "s" of "wd" in the given format to "buf",
+ * which must hold at least RECORD_MAX characters. Unless "s->fullscreen" is
+ * -1 (not followed), whether the active window is fullscreen is added: as a
+ * member of NDJSON records, as a second column 0 or 1 of plain records and as
+ * " (fullscreen)" after human-readable ones. Unless "s->activity" is
+ * SAMPLE_NO_ACTIVITY, the active fraction of its window is added in the same
+ * way, after a comma for human-readable records. The number of characters
+ * written is returned.
+ */
+static size_t render_record(char *buf, enum output_format format,
+                            const struct watch_display *wd,
+                            const struct sample *s) {
+  int activity = s->activity;
+  int fullscreen = s->fullscreen;
+  char *p = buf;
+
+  switch (format) {
+  case FORMAT_NDJSON:
+    memcpy(p, JSON_TIME, sizeof(JSON_TIME) - 1);
+    p += sizeof(JSON_TIME) - 1;
+    p += format_u64(p, s->time);
+    memcpy(p, wd->json, wd->json_len);
+    p += wd->json_len;
+    p += format_u64(p, s->idle);
+    if (fullscreen >= 0) {
+      memcpy(p, JSON_FULLSCREEN, sizeof(JSON_FULLSCREEN) - 1);
+      p += sizeof(JSON_FULLSCREEN) - 1;
+      if (fullscreen) {
+        memcpy(p, "true", 4);
+        p += 4;
+      } else {
+        memcpy(p, "false", 5);
+        p += 5;
+      }
+    }
+    if (activity != SAMPLE_NO_ACTIVITY) {
+      memcpy(p, JSON_ACTIVITY, sizeof(JSON_ACTIVITY) - 1);
+      p += sizeof(JSON_ACTIVITY) - 1;
+      p += activity_format(p, activity);
+    }
+    *p++ = '}';
+    break;
+  case FORMAT_HUMAN:
+    memcpy(p, wd->label, wd->label_len);
+    p += wd->label_len;
+    p += format_human_time(p, s->idle);
+    if (fullscreen > 0) {
+      memcpy(p, HUMAN_FULLSCREEN, sizeof(HUMAN_FULLSCREEN) - 1);
+      p += sizeof(HUMAN_FULLSCREEN) - 1;
+    }
+    if (activity >= 0) {
+      *p++ = ',';
+      *p++ = ' ';
+      p += format_u64(p, (uint64_t)(activity + 5) / 10);
+      memcpy(p, HUMAN_ACTIVE, sizeof(HUMAN_ACTIVE) - 1);
+      p += sizeof(HUMAN_ACTIVE) - 1;
+    }
+    break;
+  case FORMAT_PLAIN:
+  default:
+    memcpy(p, wd->label, wd->label_len);
+    p += wd->label_len;
+    p += format_u64(p, s->idle);
+    if (fullscreen >= 0) {
+      *p++ = ' ';
+      *p++ = fullscreen ? '1' : '0';
+    }
+    if (activity != SAMPLE_NO_ACTIVITY) {
+      *p++ = ' ';
+      if (activity >= 0)
+        p += activity_format(p, activity);
+      else
+        *p++ = '-';
+    }
+    break;
+  }
+  *p++ = '\n';
+
+  return (size_t)(p - buf);
+}
+
+/*
+ * This function writes the active time of application "i" of "t" in the
+ * given format to "buf", which must hold at least APP_RECORD_MAX characters.
+ * The number of characters written is returned.
+ */
+static size_t render_app(char *buf, enum output_format format,
+                         const struct app_table *t, size_t i, uint64_t now) {
+  const char *name = app_name(t, i);
+  size_t len = strlen(name);
+  char *p = buf;
+
+  switch (format) {
+  case FORMAT_NDJSON:
+    memcpy(p, JSON_TIME, sizeof(JSON_TIME) - 1);
+    p += sizeof(JSON_TIME) - 1;
+    p += format_u64(p, now);
+    memcpy(p, JSON_APP, sizeof(JSON_APP) - 1);
+    p += sizeof(JSON_APP) - 1;
+    p += format_json_string(p, name);
+    memcpy(p, JSON_ACTIVE, sizeof(JSON_ACTIVE) - 1);
+    p += sizeof(JSON_ACTIVE) - 1;
+    p += format_u64(p, t->active[i]);
+    memcpy(p, JSON_TITLE, sizeof(JSON_TITLE) - 1);
+    p += sizeof(JSON_TITLE) - 1;
+    p += format_json_string(p, t->title[i]);
+    *p++ = '}';
+    break;
+  case FORMAT_HUMAN:
+    memcpy(p, name, len);
+    p += len;
+    *p++ = ' ';
+    p += format_human_time(p, t->active[i]);
+    break;
+  case FORMAT_PLAIN:
+  default:
+    memcpy(p, name, len);
+    p += len;
+    *p++ = ' ';
+    p += format_u64(p, t->active[i]);
+    break;
+  }
+  *p++ = '\n';
+
+  return (size_t)(p - buf);
+}
+
+/*
+ * This function writes the active time of all applications of "t" to "out".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int dump_apps(struct text *out, enum output_format format,
+                     const struct app_table *t, uint64_t now) {
+  size_t i;
+
+  for (i = 0; i < t->names.n; i++) {
+    char *p = text_reserve(out, APP_RECORD_MAX);
+
+    if (p == NULL)
+      return -1;
+    out->len += render_app(p, format, t, i, now);
+  }
+
+  return 0;
+}
+
+/*
+ * This function writes the idle period histogram "h" of "wd" as a NDJSON
+ * record (see histogram_format_json()) to "buf", which must hold at least
+ * HISTOGRAM_RECORD_MAX characters. The number of characters written is
+ * returned.
+ */
+static size_t render_histogram(char *buf, const struct watch_display *wd,
+                               const struct histogram *h, uint64_t now) {
+  char *p = buf;
+
+  memcpy(p, JSON_TIME, sizeof(JSON_TIME) - 1);
+  p += sizeof(JSON_TIME) - 1;
+  p += format_u64(p, now);
+  memcpy(p, JSON_DISPLAY, sizeof(JSON_DISPLAY) - 1);
+  p += sizeof(JSON_DISPLAY) - 1;
+  p += format_json_string(p, wd->x.name);
+  *p++ = ',';
+  p += histogram_format_json(p, h);
+  *p++ = '}';
+  *p++ = '\n';
+
+  return (size_t)(p - buf);
+}
+
+/*
+ * This function writes the idle period histograms "hists" of the "n"
+ * displays "wds" to "out": a record per display for NDJSON, otherwise a line
+ * "histogram" with the lower bound and the count of every bucket which isn't
+ * empty.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int dump_histograms(struct text *out, enum output_format format,
+                           const struct watch_display *wds,
+                           const struct histogram *hists, size_t n,
+                           uint64_t now) {
+  size_t i, b;
+
+  for (i = 0; i < n; i++) {
+    char *p;
+
+    if (format == FORMAT_NDJSON) {
+      p = text_reserve(out, HISTOGRAM_RECORD_MAX);
+      if (p == NULL)
+        return -1;
+      out->len += render_histogram(p, &wds[i], &hists[i], now);
+      continue;
+    }
+
+    for (b = 0; b < HISTOGRAM_BUCKETS; b++) {
+      char *start;
+
+      if (hists[i].buckets[b] == 0)
+        continue;
+      start = p = text_reserve(out, RECORD_MAX);
+      if (p == NULL)
+        return -1;
+      memcpy(p, wds[i].label, wds[i].label_len);
+      p += wds[i].label_len;
+      if (format == FORMAT_HUMAN) {
+        memcpy(p, HUMAN_HISTOGRAM, sizeof(HUMAN_HISTOGRAM) - 1);
+        p += sizeof(HUMAN_HISTOGRAM) - 1;
+        p += format_human_time(p, histogram_lower_bound(b));
+        *p++ = ':';
+        *p++ = ' ';
+        p += format_u64(p, hists[i].buckets[b]);
+        memcpy(p, HUMAN_PERIODS, sizeof(HUMAN_PERIODS) - 1);
+        p += sizeof(HUMAN_PERIODS) - 1;
+      } else {
+        memcpy(p, PLAIN_HISTOGRAM, sizeof(PLAIN_HISTOGRAM) - 1);
+        p += sizeof(PLAIN_HISTOGRAM) - 1;
+        p += format_u64(p, histogram_lower_bound(b));
+        *p++ = ' ';
+        p += format_u64(p, hists[i].buckets[b]);
+      }
+      *p++ = '\n';
+      out->len += (size_t)(p - start);
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * This function writes the input counts of the minute "m" of "wd" in the
+ * given format to "buf", which must hold at least INPUT_RECORD_MAX
+ * characters: as a NDJSON record timed at the start of the minute, otherwise
+ * as a line "input" with the keystrokes, clicks and pixels of motion. The
+ * number of characters written is returned.
+ */
+static size_t render_input(char *buf, enum output_format format,
+                           const struct watch_display *wd,
+                           const struct input_minute *m) {
+  char *p = buf;
+
+  switch (format) {
+  case FORMAT_NDJSON:
+    memcpy(p, JSON_TIME, sizeof(JSON_TIME) - 1);
+    p += sizeof(JSON_TIME) - 1;
+    p += format_u64(p, m->time);
+    memcpy(p, JSON_DISPLAY, sizeof(JSON_DISPLAY) - 1);
+    p += sizeof(JSON_DISPLAY) - 1;
+    p += format_json_string(p, wd->x.name);
+    memcpy(p, JSON_KEYS, sizeof(JSON_KEYS) - 1);
+    p += sizeof(JSON_KEYS) - 1;
+    p += format_u64(p, m->keys);
+    memcpy(p, JSON_CLICKS, sizeof(JSON_CLICKS) - 1);
+    p += sizeof(JSON_CLICKS) - 1;
+    p += format_u64(p, m->clicks);
+    memcpy(p, JSON_MOTION, sizeof(JSON_MOTION) - 1);
+    p += sizeof(JSON_MOTION) - 1;
+    p += format_u64(p, m->motion);
+    *p++ = '}';
+    break;
+  case FORMAT_HUMAN:
+    memcpy(p, wd->label, wd->label_len);
+    p += wd->label_len;
+    memcpy(p, HUMAN_INPUT, sizeof(HUMAN_INPUT) - 1);
+    p += sizeof(HUMAN_INPUT) - 1;
+    p += format_u64(p, m->keys);
+    memcpy(p, HUMAN_KEYS, sizeof(HUMAN_KEYS) - 1);
+    p += sizeof(HUMAN_KEYS) - 1;
+    p += format_u64(p, m->clicks);
+    memcpy(p, HUMAN_CLICKS, sizeof(HUMAN_CLICKS) - 1);
+    p += sizeof(HUMAN_CLICKS) - 1;
+    p += format_u64(p, m->motion);
+    memcpy(p, " px", 3);
+    p += 3;
+    break;
+  case FORMAT_PLAIN:
+  default:
+    memcpy(p, wd->label, wd->label_len);
+    p += wd->label_len;
+    memcpy(p, PLAIN_INPUT, sizeof(PLAIN_INPUT) - 1);
+    p += sizeof(PLAIN_INPUT) - 1;
+    p += format_u64(p, m->keys);
+    *p++ = ' ';
+    p += format_u64(p, m->clicks);
+    *p++ = ' ';
+    p += format_u64(p, m->motion);
+    break;
+  }
+  *p++ = '\n';
+
+  return (size_t)(p - buf);
+}
+
+/* The stdout sink: records in the selected format. */
+struct stdout_sink {
+  struct outbuf *out;
+  enum output_format format;
+  const struct watch_display *wds;
+};
+
+static int stdout_write(void *ctx, const struct sample *s) {
+  struct stdout_sink *ss = ctx;
+  char *p = outbuf_reserve(ss->out, RECORD_MAX);
+
+  outbuf_commit(ss->out, render_record(p, ss->format, &ss->wds[s->display], s));
+  return 0;
+}
+
+static int stdout_write_text(void *ctx, const char *text, size_t len) {
+  struct stdout_sink *ss = ctx;
+
+  while (len) {
+    size_t chunk = len < OUTBUF_SIZE ? len : OUTBUF_SIZE;
+
+    memcpy(outbuf_reserve(ss->out, chunk), text, chunk);
+    outbuf_commit(ss->out, chunk);
+    text += chunk;
+    len -= chunk;
+  }
+  return 0;
+}
+
+static int stdout_flush(void *ctx) {
+  struct stdout_sink *ss = ctx;
+
+  if (outbuf_flush(ss->out) < 0) {
+    fprintf(stderr, "couldn't write stdout: %s\n", strerror(ss->out->error));
+    return -1;
+  }
+  return 0;
+}
+
+/* The timeline sink; flushing commits the journal. */
+static int record_write(void *ctx, const struct sample *s) {
+  return tl_writer_append(ctx, (uint16_t)s->display, s->time, s->idle);
+}
+
+static int record_flush(void *ctx) { return tl_writer_commit(ctx); }
+
+/* The collector sink; the agent drops samples instead of failing. */
+static int send_write(void *ctx, const struct sample *s) {
+  agent_sample(ctx, s->display, s->time, s->idle);
+  return 0;
+}
+
+static int send_flush(void *ctx) {
+  agent_flush(ctx);
+  return 0;
+}
+
+/* Largest value of time_t, which is 32 or 64 bit wide. */
+#define TIME_T_MAX ((time_t)(sizeof(time_t) > 4 ? INT64_MAX : INT32_MAX))
+
+/* How far ahead of now the jump timer is armed, far enough to never expire
+ * (about 20 years). */
+#define JUMP_AHEAD_S ((time_t)20 * 365 * 24 * 60 * 60)
+
+static uint64_t realtime_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/*
+ * This function (re)starts the timers of "wc": the next tick is due
+ * "interval" milliseconds from now, and the jump timer waits for the next
+ * change of the wall clock. It is armed relative to now, so it never expires
+ * on its own; should it anyway, the next call arms it again.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int arm_clock(struct watch_clock *wc, uint64_t interval) {
+  struct itimerspec tick, jump;
+
+  tick.it_value.tv_sec = (time_t)(interval / 1000);
+  tick.it_value.tv_nsec = (long)(interval % 1000) * 1000000;
+  tick.it_interval = tick.it_value;
+
+  memset(&jump, 0, sizeof(jump));
+  clock_gettime(CLOCK_REALTIME, &jump.it_value);
+  jump.it_value.tv_sec = jump.it_value.tv_sec > TIME_T_MAX - JUMP_AHEAD_S
+                             ? TIME_T_MAX
+                             : jump.it_value.tv_sec + JUMP_AHEAD_S;
+
+  if (timerfd_settime(wc->tick, 0, &tick, NULL) < 0 ||
+      timerfd_settime(wc->jump, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+                      &jump, NULL) < 0) {
+    fprintf(stderr, "couldn't arm timer: %s\n", strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+static int open_clock(struct watch_clock *wc, uint64_t interval) {
+  wc->tick = timerfd_create(CLOCK_BOOTTIME, TFD_CLOEXEC);
+  wc->jump = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+  if (wc->tick < 0 || wc->jump < 0) {
+    fprintf(stderr, "couldn't create timer: %s\n", strerror(errno));
+    return -1;
+  }
+
+  return arm_clock(wc, interval);
+}
+
+static void close_clock(struct watch_clock *wc) {
+  if (wc->tick >= 0)
+    close(wc->tick);
+  if (wc->jump >= 0)
+    close(wc->jump);
+}
+
+/*
+ * This function waits until the next round is due, the wall clock was set or
+ * the system resumed from suspend, or SIGINT, SIGTERM or SIGUSR1 is received.
+ * A tick missed by a slow round isn't caught up on. The clients of "srv" are
+ * served and the window events of the "n_apps" trackers "apps" are handled
+ * while waiting. "fds" must hold 2 + SERVER_POLLFDS_MAX + "n_apps" entries.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int wait_round(struct watch_clock *wc, uint64_t interval,
+                      struct server *srv, struct app_tracker *apps,
+                      size_t n_apps, struct pollfd *fds) {
+  size_t i;
+
+  fds[0].fd = wc->tick;
+  fds[0].events = POLLIN;
+  fds[1].fd = wc->jump;
+  fds[1].events = POLLIN;
+  for (i = 0; i < n_apps; i++) {
+    fds[2 + i].fd = ConnectionNumber(apps[i].dpy);
+    fds[2 + i].events = POLLIN;
+  }
+
+  while (!stop && !dump) {
+    uint64_t expirations;
+    size_t first = 2 + n_apps;
+    size_t nfds = first + (srv ? server_pollfds(srv, fds + first) : 0);
+    int ret;
+
+    /* events may have been queued while waiting for replies */
+    for (i = 0; i < n_apps; i++)
+      app_tracker_handle(&apps[i]);
+
+    ret = poll(fds, nfds, -1);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      fprintf(stderr, "couldn't wait for timer: %s\n", strerror(errno));
+      return -1;
+    }
+    if (srv)
+      server_handle(srv, fds + first, nfds - first);
+
+    if (fds[1].revents & POLLIN) {
+      /* The read fails with ECANCELED; restart the interval from now. */
+      if (read(wc->jump, &expirations, sizeof(expirations)) < 0 &&
+          errno != ECANCELED && errno != EAGAIN)
+        return -1;
+      return arm_clock(wc, interval);
+    }
+    if (fds[0].revents & POLLIN) {
+      if (read(wc->tick, &expirations, sizeof(expirations)) < 0 &&
+          errno != EINTR)
+        return -1;
+      return 0;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * This function samples the idle time of all displays given in "opts" every
+ * "opts->interval" milliseconds and delivers the samples to the sinks (see
+ * sink.h): stdout, flushed according to "opts->batch". If "opts->record" is
+ * set, the samples are also recorded to that timeline file, journaled unless
+ * "opts->commit.records" is 0 and flushed, which commits the journal,
+ * according to "opts->commit". If "opts->send" is set, the samples are
+ * sent to the collector at that address (see agent.h), flushed according to
+ * "opts->send_batch". A failing sink doesn't stop the others; the watch mode
+ * ends once all have failed. If "opts->publish" is set, the latest samples
+ * are published in that shared memory segment (see publish.h), with
+ * transitions at "opts->threshold". If "opts->listen" is set, the samples are
+ * pushed to the subscribers on that socket (see server.h). The lengths of the
+ * idle periods of every display (from crossing "opts->threshold" to the next
+ * input) are kept in histograms (see histogram.h), which are served on the
+ * socket and printed after the round following SIGUSR1. If "opts->apps" is
+ * set, the active time of the applications is accounted (see apps.h) and
+ * printed along with them and at the end.
+ * If "opts->fullscreen" is set, every sample tells whether the active window
+ * of its display is fullscreen, as kept up to date from window events. If
+ * "opts->activity" is set, every sample tells which fraction of that many
+ * milliseconds up to it the user was active (see activity.h). If
+ * "opts->input" is set, the keystrokes, clicks and pointer motion of every
+ * display are counted per minute (see input.h) and printed when the minute is
+ * over.
+ * If "opts->journal" is set, the samples are also written to that journald
+ * socket (see journald.h) with the DPMS level of their display, flushed
+ * according to "opts->journal_batch".
+ * If "opts->interval" is 0 only one round is done. Otherwise sampling goes on
+ * until SIGINT or SIGTERM is received. Rounds are timed on CLOCK_BOOTTIME and
+ * an extra round is done right away when the system resumes or the wall
+ * clock is set.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int watch_run(const struct watch_options *opts) {
+  static struct outbuf out;
+  static struct tl_writer rec;
+  static struct publisher pub;
+  static struct server srv;
+  static struct agent agent;
+  static struct journald jd;
+  static struct app_table apps;
+  static struct sink_set sinks;
+  struct stdout_sink ss;
+  struct sink *console = NULL;
+  struct text extra = {NULL, 0, 0};
+  struct session_store store;
+  const char **names = NULL;
+  struct watch_clock wc = {-1, -1};
+  struct watch_display *wds;
+  struct sample *samples;
+  struct app_tracker *trackers = NULL;
+  struct histogram *hists;
+  struct activity *acts = NULL;
+  struct input_counter *inputs = NULL;
+  struct pollfd *fds = NULL;
+  size_t n = opts->n_displays ? opts->n_displays : 1;
+  size_t opened = 0, tracked = 0, windows = 0, counted = 0, i;
+  int recording = 0, publishing = 0, serving = 0, sending = 0, journaling = 0;
+  int ret = -1;
+
+  wds = calloc(n, sizeof(*wds));
+  samples = calloc(n, sizeof(*samples));
+  hists = calloc(n, sizeof(*hists));
+  fds = malloc((2 + SERVER_POLLFDS_MAX + n) * sizeof(*fds));
+  if (wds == NULL || samples == NULL || hists == NULL || fds == NULL) {
+    fprintf(stderr, "couldn't allocate display state\n");
+    free(wds);
+    free(samples);
+    free(hists);
+    free(fds);
+    return -1;
+  }
+  if (session_store_init(&store, n, opts->threshold) < 0) {
+    free(wds);
+    free(samples);
+    free(hists);
+    free(fds);
+    return -1;
+  }
+  outbuf_init(&out, STDOUT_FILENO);
+  sink_set_init(&sinks);
+
+  for (; opened < n; opened++) {
+    const char *name = opts->n_displays ? opts->displays[opened] : NULL;
+
+    if (idle_display_open(&wds[opened].x, name, 0) < 0)
+      goto out;
+    if (prepare_display(&wds[opened], n > 1) < 0 ||
+        session_store_add(&store) < 0) {
+      opened++;
+      goto out;
+    }
+  }
+
+  if (opts->activity) {
+    acts = calloc(n, sizeof(*acts));
+    if (acts == NULL) {
+      fprintf(stderr, "couldn't allocate activity windows\n");
+      goto out;
+    }
+    for (; windows < n; windows++) {
+      if (activity_init(&acts[windows], opts->activity) < 0)
+        goto out;
+    }
+  }
+
+  if (opts->input) {
+    uint64_t now = realtime_ms();
+
+    inputs = calloc(n, sizeof(*inputs));
+    if (inputs == NULL) {
+      fprintf(stderr, "couldn't allocate input counters\n");
+      goto out;
+    }
+    for (; counted < n; counted++) {
+      if (input_open(&inputs[counted], wds[counted].x.dpy, now) < 0)
+        goto out;
+    }
+  }
+
+  if (opts->record) {
+    if (tl_writer_open(&rec, opts->record, opts->commit.records != 0) < 0)
+      goto out;
+    recording = 1;
+    for (i = 0; i < n; i++) {
+      if (tl_writer_add_series(&rec, wds[i].x.name) < 0)
+        goto out;
+    }
+  }
+
+  names = malloc(n * sizeof(*names));
+  if (names == NULL) {
+    fprintf(stderr, "couldn't allocate display names\n");
+    goto out;
+  }
+  for (i = 0; i < n; i++)
+    names[i] = wds[i].x.name;
+
+  if (opts->publish) {
+    if (publish_open(&pub, opts->publish, names, n, opts->threshold) < 0)
+      goto out;
+    publishing = 1;
+  }
+
+  if (opts->listen) {
+    if (server_open(&srv, opts->listen, names, hists, acts, inputs, n) < 0)
+      goto out;
+    serving = 1;
+  }
+
+  if (opts->send) {
+    if (agent_open(&agent, opts->send, names, n) < 0)
+      goto out;
+    sending = 1;
+  }
+
+  if (opts->journal) {
+    if (journald_open(&jd, opts->journal, names, n) < 0)
+      goto out;
+    journaling = 1;
+  }
+
+  /* every sink writes on its own thread, so a slow reader of stdout or a
+   * slow disk holds up neither the sampling nor the other sinks */
+  if (recording && sink_add(&sinks, "timeline", record_write, NULL,
+                            record_flush, &rec, &opts->commit) == NULL)
+    goto out;
+  if (sending && sink_add(&sinks, "collector", send_write, NULL, send_flush,
+                          &agent, &opts->send_batch) == NULL)
+    goto out;
+  if (journaling &&
+      sink_add(&sinks, "journal", journald_write, NULL, journald_flush, &jd,
+               &opts->journal_batch) == NULL)
+    goto out;
+  ss.out = &out;
+  ss.format = opts->format;
+  ss.wds = wds;
+  console = sink_add(&sinks, "stdout", stdout_write, stdout_write_text,
+                     stdout_flush, &ss, &opts->batch);
+  if (console == NULL)
+    goto out;
+
+  if (opts->apps || opts->fullscreen) {
+    trackers = calloc(n, sizeof(*trackers));
+    if (trackers == NULL) {
+      fprintf(stderr, "couldn't allocate window trackers\n");
+      goto out;
+    }
+    for (; tracked < n; tracked++) {
+      if (app_tracker_open(&trackers[tracked], wds[tracked].x.dpy,
+                           opts->apps ? &apps : NULL, opts->threshold) < 0)
+        goto out;
+    }
+  }
+
+  if (opts->interval && open_clock(&wc, opts->interval) < 0)
+    goto out;
+
+  install_stop_handlers();
+  install_dump_handler();
+
+  while (!stop) {
+    uint64_t stamp = realtime_ms();
+    int changed = 0;
+
+    if (publishing)
+      publish_begin(&pub);
+    for (i = 0; i < n; i++) {
+      /* the last sample and when its idle period began */
+      uint64_t idle, last_idle = store.idle[i];
+      uint64_t since = store.time[i] - last_idle;
+      int was_idle = store.time[i] && store.state[i];
+      struct sample *smp = &samples[i];
+
+      if (idle_display_query(&wds[i].x, &idle) < 0)
+        goto out;
+      smp->display = i;
+      smp->time = stamp;
+      smp->idle = idle;
+      smp->fullscreen = -1;
+      smp->activity = SAMPLE_NO_ACTIVITY;
+      smp->transition = SAMPLE_STEADY;
+      smp->dpms = -1;
+      if (journaling && idle_display_query_dpms(&wds[i].x, &smp->dpms) == 0)
+        store.dpms[i] =
+            smp->dpms < 0 ? SESSION_DPMS_UNKNOWN : (unsigned char)smp->dpms;
+      if (windows) {
+        activity_sample(&acts[i], stamp, idle, opts->threshold);
+        smp->activity = activity_permille(&acts[i]);
+      }
+      if (opts->fullscreen) {
+        /* events which came in with the reply */
+        app_tracker_handle(&trackers[i]);
+        smp->fullscreen = trackers[i].fullscreen;
+      }
+
+      if (serving) {
+        char line[RECORD_MAX];
+
+        server_sample(&srv, i, idle, line,
+                      render_record(line, FORMAT_NDJSON, &wds[i], smp));
+      }
+
+      if (tracked)
+        app_tracker_sample(&trackers[i], idle);
+      if (session_store_update(&store, i, stamp, idle)) {
+        changed = 1;
+        smp->transition = store.state[i] ? SAMPLE_TO_IDLE : SAMPLE_TO_ACTIVE;
+        /* an idle period ended with input "idle" milliseconds ago; if the
+         * wall clock was set back, it lasted at least "last_idle". It is
+         * counted from crossing the threshold, not from the last input. */
+        if (was_idle)
+          histogram_add(&hists[i], (stamp - idle > since + last_idle
+                                        ? stamp - idle - since
+                                        : last_idle) -
+                                       opts->threshold);
+      }
+      if (publishing)
+        publish_display(&pub, &store, i);
+    }
+    if (publishing)
+      publish_end(&pub, changed);
+    if (serving)
+      server_flush(&srv);
+
+    /* the raw events which arrived since the last round came in with the
+     * replies; minutes which are over go ahead of the samples of the new one */
+    for (i = 0; i < counted; i++) {
+      input_read(&inputs[i]);
+      if (input_tick(&inputs[i], stamp)) {
+        char *p = text_reserve(&extra, INPUT_RECORD_MAX);
+
+        if (p)
+          extra.len += render_input(p, opts->format, &wds[i],
+                                    input_last(&inputs[i]));
+      }
+    }
+    text_send(&extra, console, 1, 0);
+
+    sink_deliver(&sinks, samples, n);
+    if (dump) {
+      int ok =
+          dump_histograms(&extra, opts->format, wds, hists, n, stamp) == 0;
+
+      dump = 0;
+      if (ok && tracked)
+        ok = dump_apps(&extra, opts->format, &apps, stamp) == 0;
+      text_send(&extra, console, ok, 1);
+    }
+    if (sink_alive(&sinks) == 0)
+      goto out;
+
+    if (opts->interval == 0)
+      break;
+
+    if (wait_round(&wc, opts->interval, serving ? &srv : NULL, trackers,
+                   tracked, fds) < 0)
+      goto out;
+  }
+  ret = 0;
+
+out:
+  for (i = 0; i < tracked; i++)
+    app_tracker_close(&trackers[i]);
+  if (opts->apps && tracked == n && console)
+    text_send(&extra, console,
+              dump_apps(&extra, opts->format, &apps, realtime_ms()) == 0, 1);
+  free(extra.data);
+  if (sink_close_all(&sinks) < 0)
+    ret = -1;
+  free(trackers);
+  for (i = 0; i < counted; i++)
+    input_close(&inputs[i]);
+  free(inputs);
+  app_table_free(&apps);
+  for (i = 0; i < windows; i++)
+    activity_free(&acts[i]);
+  free(acts);
+  close_clock(&wc);
+  if (journaling)
+    journald_close(&jd);
+  if (sending)
+    agent_close(&agent);
+  if (serving)
+    server_close(&srv);
+  if (publishing)
+    publish_close(&pub);
+  if (recording && tl_writer_close(&rec) < 0)
+    ret = -1;
+  for (i = 0; i < opened; i++)
+    idle_display_close(&wds[i].x);
+  free(names);
+  session_store_free(&store);
+  free(fds);
+  free(hists);
+  free(samples);
+  free(wds);
+  return ret;
+}
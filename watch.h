@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Watch mode of xprintidle: periodically sample the idle time of one or more
+ * X displays and stream it to stdout.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_WATCH_H
+#define XPRINTIDLE_WATCH_H
+
+#include "format.h"
+#include "sink.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Longest display name accepted by the watch mode. */
+#define WATCH_DISPLAY_NAME_MAX 255
+
+struct watch_options {
+  uint64_t interval;
+  enum output_format format;
+  const char **displays;
+  size_t n_displays;
+  const char *record;
+  /* batch settings of the timeline sink, which commit its journal; a
+   * "records" of 0 disables the journal */
+  struct sink_batch commit;
+  const char *publish;
+  uint64_t threshold;
+  const char *listen;
+  const char *send;
+  int apps;
+  int fullscreen;
+  uint64_t activity;
+  int input;
+  /* batch settings of the stdout and collector sinks */
+  struct sink_batch batch;
+  struct sink_batch send_batch;
+  /* journal socket, NULL for none */
+  const char *journal;
+  struct sink_batch journal_batch;
+};
+
+int watch_run(const struct watch_options *opts);
+
+#endif /* XPRINTIDLE_WATCH_H */
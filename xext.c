@@ -0,0 +1,115 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Lazy loading of the X extension libraries, see xext.h.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "xext.h"
+
+#include <dlfcn.h>
+#include <stdio.h>
+
+struct xext_screensaver xext_screensaver;
+#ifndef XPRINTIDLE_NO_DPMS
+struct xext_dpms xext_dpms;
+#endif
+
+/* A function to resolve and where to store its address. */
+struct symbol {
+  const char *name;
+  void *dest;
+};
+
+/*
+ * This function loads the library "lib" and resolves the "n" symbols
+ * "syms". A library which is already loaded, "*loaded" being set, isn't
+ * loaded again.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int load(const char *lib, const struct symbol *syms, size_t n,
+                int *loaded) {
+  void *handle;
+  size_t i;
+
+  if (*loaded)
+    return 0;
+
+  handle = dlopen(lib, RTLD_LAZY | RTLD_LOCAL);
+  if (handle == NULL) {
+    fprintf(stderr, "couldn't load %s: %s\n", lib, dlerror());
+    return -1;
+  }
+
+  for (i = 0; i < n; i++) {
+    void *sym = dlsym(handle, syms[i].name);
+
+    if (sym == NULL) {
+      fprintf(stderr, "couldn't find %s in %s\n", syms[i].name, lib);
+      dlclose(handle);
+      return -1;
+    }
+    /* POSIX guarantees function pointers survive the round trip through
+     * void *, as dlsym() needs */
+    *(void **)syms[i].dest = sym;
+  }
+
+  *loaded = 1;
+  return 0;
+}
+
+/*
+ * This function loads libXss unless done before.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int xext_load_screensaver(void) {
+  static const struct symbol syms[] = {
+      {"XScreenSaverQueryExtension", &xext_screensaver.query_extension},
+      {"XScreenSaverAllocInfo", &xext_screensaver.alloc_info},
+      {"XScreenSaverQueryInfo", &xext_screensaver.query_info},
+      {"XScreenSaverQueryVersion", &xext_screensaver.query_version},
+      {"XScreenSaverSuspend", &xext_screensaver.suspend},
+  };
+  static int loaded;
+
+  return load(XEXT_SCREENSAVER_LIB, syms, sizeof(syms) / sizeof(*syms),
+              &loaded);
+}
+
+#ifndef XPRINTIDLE_NO_DPMS
+
+/*
+ * This function loads the DPMS functions of libXext unless done before.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int xext_load_dpms(void) {
+  static const struct symbol syms[] = {
+      {"DPMSQueryExtension", &xext_dpms.query_extension},
+      {"DPMSCapable", &xext_dpms.capable},
+      {"DPMSGetTimeouts", &xext_dpms.get_timeouts},
+      {"DPMSInfo", &xext_dpms.info},
+      {"DPMSEnable", &xext_dpms.enable},
+      {"DPMSDisable", &xext_dpms.disable},
+  };
+  static int loaded;
+
+  return load(XEXT_DPMS_LIB, syms, sizeof(syms) / sizeof(*syms), &loaded);
+}
+
+#endif /* XPRINTIDLE_NO_DPMS */
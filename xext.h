@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Access to the X extension libraries used by xprintidle: libXss for the
+ * MIT-SCREEN-SAVER extension and libXext for DPMS.
+ *
+ * Normally xprintidle is linked against both. When built with the meson
+ * option "lazy_x_extensions" (XPRINTIDLE_LAZY_XEXT), they are instead loaded
+ * with dlopen() by xext_load_screensaver() and xext_load_dpms() right before
+ * their first use, and their functions are called through the pointers
+ * below, so runs which don't query a display don't load them at all. Callers
+ * use the usual function names in both cases; they only have to call the
+ * load functions first. Without the DPMS workaround (XPRINTIDLE_NO_DPMS)
+ * libXext isn't used at all.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_XEXT_H
+#define XPRINTIDLE_XEXT_H
+
+#include <X11/Xlib.h>
+#include <X11/extensions/scrnsaver.h>
+#ifndef XPRINTIDLE_NO_DPMS
+#include <X11/extensions/dpms.h>
+#endif
+
+#ifdef XPRINTIDLE_LAZY_XEXT
+
+#define XEXT_SCREENSAVER_LIB "libXss.so.1"
+#define XEXT_DPMS_LIB "libXext.so.6"
+
+struct xext_screensaver {
+  Bool (*query_extension)(Display *dpy, int *event_base, int *error_base);
+  XScreenSaverInfo *(*alloc_info)(void);
+  Status (*query_info)(Display *dpy, Drawable drawable,
+                       XScreenSaverInfo *info);
+  Status (*query_version)(Display *dpy, int *major, int *minor);
+  void (*suspend)(Display *dpy, Bool suspend);
+};
+
+extern struct xext_screensaver xext_screensaver;
+
+int xext_load_screensaver(void);
+
+#define XScreenSaverQueryExtension xext_screensaver.query_extension
+#define XScreenSaverAllocInfo xext_screensaver.alloc_info
+#define XScreenSaverQueryInfo xext_screensaver.query_info
+#define XScreenSaverQueryVersion xext_screensaver.query_version
+#define XScreenSaverSuspend xext_screensaver.suspend
+
+#ifndef XPRINTIDLE_NO_DPMS
+
+struct xext_dpms {
+  Bool (*query_extension)(Display *dpy, int *event_base, int *error_base);
+  Bool (*capable)(Display *dpy);
+  Status (*get_timeouts)(Display *dpy, CARD16 *standby, CARD16 *suspend,
+                         CARD16 *off);
+  Status (*info)(Display *dpy, CARD16 *power_level, BOOL *state);
+  Status (*enable)(Display *dpy);
+  Status (*disable)(Display *dpy);
+};
+
+extern struct xext_dpms xext_dpms;
+
+int xext_load_dpms(void);
+
+#define DPMSQueryExtension xext_dpms.query_extension
+#define DPMSCapable xext_dpms.capable
+#define DPMSGetTimeouts xext_dpms.get_timeouts
+#define DPMSInfo xext_dpms.info
+#define DPMSEnable xext_dpms.enable
+#define DPMSDisable xext_dpms.disable
+
+#endif /* XPRINTIDLE_NO_DPMS */
+
+#else
+
+static inline int xext_load_screensaver(void) { return 0; }
+static inline int xext_load_dpms(void) { return 0; }
+
+#endif /* XPRINTIDLE_LAZY_XEXT */
+
+#endif /* XPRINTIDLE_XEXT_H */
@@ -0,0 +1,584 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * This program collects the sample streams of many agents
+ * ("xprintidle --send", see collector.h) over TCP and keeps the latest state
+ * of every session, so aggregate queries over a whole fleet of desktops can
+ * be answered without asking any of them.
+ *
+ * All connections are multiplexed with epoll. The state of the sessions is
+ * kept in a session store (see sessions.h), with the sessions found by their
+ * interned name (see names.h), so lookups touch a few cache lines and
+ * aggregate queries are linear scans over the columns of the store.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "collector.h"
+#include "format.h"
+#include "names.h"
+#include "sessions.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef XPRINTIDLE_VERSION
+#define XPRINTIDLE_VERSION "n/a"
+#endif
+
+/* Size of the receive buffer of a connection; holds at least one frame. */
+#define CONN_BUF_SIZE 8192
+
+/* Highest session number an agent may use. */
+#define CONN_SESSIONS_MAX 65536
+
+/* Longest query line. */
+#define QUERY_LINE_MAX 512
+
+#define EPOLL_EVENTS_MAX 256
+
+/* Idle time from which on a session counts as idle in the store. */
+#define COLLECTOR_THRESHOLD 60000
+
+/*
+ * The sessions known to the collector. The times in "store" are on the
+ * monotonic clock of the collector at which the samples were received; the
+ * host columns hold the rest of the state of a session.
+ */
+struct host_table {
+  /* the host names, numbered like the sessions of "store" */
+  struct names names;
+  struct session_store store;
+  size_t cap;
+  /* time of the last sample as sent by the agent */
+  uint64_t *sent;
+  /* number of connections the session is bound on */
+  uint32_t *online;
+  size_t n_online;
+};
+
+enum conn_kind {
+  CONN_UNKNOWN,
+  CONN_AGENT,
+  CONN_QUERY,
+};
+
+struct conn {
+  int fd;
+  enum conn_kind kind;
+  /* session number -> host index + 1, 0 if unbound */
+  uint32_t *sessions;
+  size_t n_sessions;
+  size_t len;
+  unsigned char buf[CONN_BUF_SIZE];
+};
+
+static volatile sig_atomic_t stop;
+
+static void handle_stop(int sig) {
+  (void)sig;
+  stop = 1;
+}
+
+void print_usage(char *name) {
+  fprintf(stdout,
+          "usage: %s [OPTIONS]\n"
+          "Collect the samples sent by xprintidle --send and answer queries\n"
+          "\n"
+          "  -h, --help              Print this help\n"
+          "  -v, --version           Print the program version\n"
+          "  -l, --listen=ADDR[:PORT]\n"
+          "                          Listen on ADDR (default 127.0.0.1:%s)\n"
+          "\n"
+          "Queries are sent as lines on the same port and answered with a\n"
+          "JSON line each:\n"
+          "  count idle>MS           Number of online sessions idle for more\n"
+          "                          than MS milliseconds\n"
+          "  count idle<MS           ... for less than MS milliseconds\n"
+          "  hosts                   Number of known and online sessions\n"
+          "  get NAME                State of the session NAME\n"
+          "\n"
+          "Report bugs at: https://github.com/g0hl1n/xprintidle/issues\n",
+          name, COLLECTOR_PORT);
+}
+
+void print_version(void) {
+  fprintf(stdout, "xprintidle-collector %s\n", XPRINTIDLE_VERSION);
+}
+
+static uint64_t monotonic_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static uint16_t get16(const unsigned char *p) {
+  return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get32(const unsigned char *p) {
+  return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+static uint64_t get64(const unsigned char *p) {
+  return get32(p) | (uint64_t)get32(p + 4) << 32;
+}
+
+/*
+ * This function looks up the host "name" of length "len" in "t" and adds it
+ * if it's unknown.
+ * On success the index of the host is returned.
+ * On error -1 is returned.
+ */
+static long host_lookup(struct host_table *t, const char *name, size_t len) {
+  long host = names_find(&t->names, name, len);
+
+  if (host >= 0)
+    return host;
+  if (names_reserve(&t->names, len) < 0)
+    return -1;
+
+  if (t->store.n == t->cap) {
+    size_t cap = t->cap ? t->cap * 2 : 1024;
+    uint64_t *sent = realloc(t->sent, cap * sizeof(*sent));
+    uint32_t *online = sent ? realloc(t->online, cap * sizeof(*online)) : NULL;
+
+    if (sent)
+      t->sent = sent;
+    if (online == NULL) {
+      fprintf(stderr, "couldn't allocate hosts\n");
+      return -1;
+    }
+    t->online = online;
+    t->cap = cap;
+  }
+
+  host = session_store_add(&t->store);
+  if (host < 0)
+    return -1;
+  t->sent[host] = 0;
+  t->online[host] = 0;
+  names_add(&t->names, name, len);
+  return host;
+}
+
+/* This function returns the index of the host "name" in "t" or -1. */
+static long host_find(const struct host_table *t, const char *name) {
+  return names_find(&t->names, name, strlen(name));
+}
+
+/*
+ * This function drops a connection of "host" of "t", which goes offline with
+ * its last one.
+ */
+static void unbind(struct host_table *t, size_t host) {
+  if (--t->online[host] == 0) {
+    t->n_online--;
+    session_store_drop(&t->store, host);
+  }
+}
+
+/*
+ * This function binds "session" of the agent connection "c" to the host
+ * "name" of length "len".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int bind_session(struct host_table *t, struct conn *c, uint32_t session,
+                        const char *name, size_t len) {
+  long host;
+
+  if (session >= CONN_SESSIONS_MAX || len == 0 || len > COLLECTOR_NAME_MAX)
+    return -1;
+  len = strnlen(name, len);
+
+  if (session >= c->n_sessions) {
+    size_t n = session + 1;
+    uint32_t *sessions = realloc(c->sessions, n * sizeof(*sessions));
+
+    if (sessions == NULL)
+      return -1;
+    memset(sessions + c->n_sessions, 0,
+           (n - c->n_sessions) * sizeof(*sessions));
+    c->sessions = sessions;
+    c->n_sessions = n;
+  }
+
+  host = host_lookup(t, name, len);
+  if (host < 0)
+    return -1;
+  if (c->sessions[session]) {
+    if (c->sessions[session] == (uint32_t)host + 1)
+      return 0;
+    unbind(t, c->sessions[session] - 1);
+  }
+  c->sessions[session] = (uint32_t)host + 1;
+  if (t->online[host]++ == 0)
+    t->n_online++;
+  return 0;
+}
+
+/*
+ * This function handles the frames received on the agent connection "c".
+ * On success 0 is returned.
+ * On error (a malformed stream) -1 is returned.
+ */
+static int handle_frames(struct host_table *t, struct conn *c) {
+  uint64_t now = monotonic_ms();
+  size_t off = 0;
+
+  while (c->len - off >= COLLECTOR_FRAME_HEADER_SIZE) {
+    const unsigned char *p = c->buf + off;
+    size_t len = get16(p + 2);
+
+    if (COLLECTOR_FRAME_HEADER_SIZE + len > c->len - off)
+      break;
+    p += COLLECTOR_FRAME_HEADER_SIZE;
+
+    if (c->buf[off] == COLLECTOR_FRAME_SESSION) {
+      if (len < 4 ||
+          bind_session(t, c, get32(p), (const char *)p + 4, len - 4) < 0)
+        return -1;
+    } else if (c->buf[off] == COLLECTOR_FRAME_SAMPLE) {
+      uint32_t session, host;
+
+      if (len < COLLECTOR_SAMPLE_SIZE - COLLECTOR_FRAME_HEADER_SIZE)
+        return -1;
+      session = get32(p);
+      if (session >= c->n_sessions || c->sessions[session] == 0)
+        return -1;
+      host = c->sessions[session] - 1;
+      t->sent[host] = get64(p + 4);
+      session_store_update(&t->store, host, now, get64(p + 12));
+    }
+    off += COLLECTOR_FRAME_HEADER_SIZE + len;
+  }
+
+  memmove(c->buf, c->buf + off, c->len - off);
+  c->len -= off;
+  return 0;
+}
+
+/* This function writes the reply to "line" to "buf" and returns its length. */
+static size_t answer(const struct host_table *t, const char *line, char *buf) {
+  const struct session_store *s = &t->store;
+  uint64_t now = monotonic_ms();
+  char *p = buf;
+  uint64_t ms;
+  char *end;
+  long host;
+
+  if (!strncmp(line, "count idle", 10) &&
+      (line[10] == '>' || line[10] == '<') && line[11] >= '0' &&
+      line[11] <= '9') {
+    errno = 0;
+    ms = strtoull(line + 11, &end, 10);
+    if (errno == 0 && *end == '\0') {
+      p += sprintf(p, "{\"count\":");
+      p += format_u64(p,
+                      session_store_count_idle(s, now, ms, line[10] == '>'));
+      p += sprintf(p, "}\n");
+      return (size_t)(p - buf);
+    }
+  } else if (!strcmp(line, "hosts")) {
+    p += sprintf(p, "{\"hosts\":");
+    p += format_u64(p, s->n);
+    p += sprintf(p, ",\"online\":");
+    p += format_u64(p, t->n_online);
+    p += sprintf(p, "}\n");
+    return (size_t)(p - buf);
+  } else if (!strncmp(line, "get ", 4)) {
+    host = host_find(t, line + 4);
+    if (host < 0)
+      return (size_t)sprintf(buf, "{\"error\":\"unknown host\"}\n");
+
+    p += sprintf(p, "{\"name\":");
+    p += format_json_string(p, names_get(&t->names, host));
+    p += sprintf(p, ",\"online\":%s,\"time\":",
+                 s->live[host] ? "true" : "false");
+    p += format_u64(p, t->sent[host]);
+    p += sprintf(p, ",\"idle\":");
+    p += format_u64(p, s->live[host] ? s->idle[host] + now - s->time[host]
+                                     : s->idle[host]);
+    p += sprintf(p, "}\n");
+    return (size_t)(p - buf);
+  }
+
+  return (size_t)sprintf(buf, "{\"error\":\"invalid query\"}\n");
+}
+
+/*
+ * This function answers the query lines received on "c". Replies are short,
+ * so a client which doesn't take them without blocking is disconnected.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int handle_queries(const struct host_table *t, struct conn *c) {
+  static char reply[64 + JSON_STRING_MAX(COLLECTOR_NAME_MAX) + 3 * U64_STR_MAX];
+  size_t off = 0;
+  char *nl;
+
+  while ((nl = memchr(c->buf + off, '\n', c->len - off))) {
+    char *line = (char *)c->buf + off;
+    size_t len;
+
+    *nl = '\0';
+    if (nl > line && nl[-1] == '\r')
+      nl[-1] = '\0';
+    len = answer(t, line, reply);
+    if (send(c->fd, reply, len, MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)len)
+      return -1;
+    off = (size_t)(nl - (char *)c->buf) + 1;
+  }
+
+  if (off == 0 && c->len > QUERY_LINE_MAX)
+    return -1;
+  memmove(c->buf, c->buf + off, c->len - off);
+  c->len -= off;
+  return 0;
+}
+
+/*
+ * This function reads what's available on "c" and handles it.
+ * On success 0 is returned.
+ * On error or end of stream -1 is returned.
+ */
+static int conn_read(struct host_table *t, struct conn *c) {
+  for (;;) {
+    ssize_t ret = read(c->fd, c->buf + c->len, CONN_BUF_SIZE - c->len);
+
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+    if (ret == 0)
+      return -1;
+    c->len += (size_t)ret;
+
+    if (c->kind == CONN_UNKNOWN && c->len >= COLLECTOR_MAGIC_SIZE) {
+      if (memcmp(c->buf, COLLECTOR_MAGIC, COLLECTOR_MAGIC_SIZE) == 0) {
+        c->kind = CONN_AGENT;
+        c->len -= COLLECTOR_MAGIC_SIZE;
+        memmove(c->buf, c->buf + COLLECTOR_MAGIC_SIZE, c->len);
+      } else {
+        c->kind = CONN_QUERY;
+      }
+    }
+
+    if (c->kind == CONN_AGENT && handle_frames(t, c) < 0)
+      return -1;
+    if (c->kind == CONN_QUERY && handle_queries(t, c) < 0)
+      return -1;
+    /* a frame never exceeds the buffer, so a full buffer is an error */
+    if (c->len == CONN_BUF_SIZE)
+      return -1;
+  }
+}
+
+static void conn_close(struct host_table *t, struct conn *c) {
+  size_t i;
+
+  for (i = 0; i < c->n_sessions; i++) {
+    if (c->sessions[i])
+      unbind(t, c->sessions[i] - 1);
+  }
+  close(c->fd);
+  free(c->sessions);
+  free(c);
+}
+
+/*
+ * This function creates the listening socket for "addr" and returns it.
+ * On error -1 is returned.
+ */
+static int listen_on(const char *addr) {
+  struct addrinfo hints, *res, *ai;
+  const char *port;
+  char *copy, *host;
+  int fd = -1, err, one = 1;
+
+  copy = strdup(addr);
+  if (copy == NULL) {
+    fprintf(stderr, "couldn't allocate listen address\n");
+    return -1;
+  }
+  host = collector_split_address(copy, &port);
+  if (host == NULL) {
+    fprintf(stderr, "invalid listen address '%s'\n", addr);
+    free(copy);
+    return -1;
+  }
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  err = getaddrinfo(*host ? host : NULL, port, &hints, &res);
+  if (err) {
+    fprintf(stderr, "couldn't resolve '%s': %s\n", addr, gai_strerror(err));
+    free(copy);
+    return -1;
+  }
+
+  for (ai = res; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                ai->ai_protocol);
+    if (fd < 0)
+      continue;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 4096) == 0)
+      break;
+    close(fd);
+    fd = -1;
+  }
+  if (fd < 0)
+    fprintf(stderr, "couldn't listen on '%s': %s\n", addr, strerror(errno));
+
+  freeaddrinfo(res);
+  free(copy);
+  return fd;
+}
+
+/*
+ * This function accepts all pending connections on "lfd" and adds them to
+ * the epoll instance "ep".
+ */
+static void accept_all(int ep, int lfd) {
+  for (;;) {
+    struct epoll_event ev;
+    struct conn *c;
+    int fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        fprintf(stderr, "couldn't accept: %s\n", strerror(errno));
+      return;
+    }
+
+    c = calloc(1, sizeof(*c));
+    if (c == NULL) {
+      fprintf(stderr, "couldn't allocate connection\n");
+      close(fd);
+      continue;
+    }
+    c->fd = fd;
+    c->kind = CONN_UNKNOWN;
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      close(fd);
+      free(c);
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  static const struct option long_options[] = {
+      {"help", no_argument, NULL, 'h'},
+      {"version", no_argument, NULL, 'v'},
+      {"listen", required_argument, NULL, 'l'},
+      {NULL, 0, NULL, 0},
+  };
+  static struct epoll_event events[EPOLL_EVENTS_MAX];
+  static struct host_table table;
+  const char *addr = "127.0.0.1:" COLLECTOR_PORT;
+  struct epoll_event ev;
+  struct sigaction sa;
+  int ep, lfd, opt;
+
+  while ((opt = getopt_long(argc, argv, "hvl:", long_options, NULL)) != -1) {
+    switch (opt) {
+    case 'v':
+      print_version();
+      return EXIT_SUCCESS;
+    case 'l':
+      addr = optarg;
+      break;
+    case 'h':
+    default:
+      print_usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (optind < argc) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (session_store_init(&table.store, 1024, COLLECTOR_THRESHOLD) < 0)
+    return EXIT_FAILURE;
+
+  lfd = listen_on(addr);
+  if (lfd < 0)
+    return EXIT_FAILURE;
+
+  ep = epoll_create1(EPOLL_CLOEXEC);
+  if (ep < 0) {
+    fprintf(stderr, "couldn't create epoll instance: %s\n", strerror(errno));
+    return EXIT_FAILURE;
+  }
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  if (epoll_ctl(ep, EPOLL_CTL_ADD, lfd, &ev) < 0) {
+    fprintf(stderr, "couldn't watch the listening socket: %s\n",
+            strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = handle_stop;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  while (!stop) {
+    int n = epoll_wait(ep, events, EPOLL_EVENTS_MAX, -1);
+    int i;
+
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      fprintf(stderr, "couldn't wait for events: %s\n", strerror(errno));
+      return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < n; i++) {
+      struct conn *c = events[i].data.ptr;
+
+      if (c == NULL)
+        accept_all(ep, lfd);
+      else if (conn_read(&table, c) < 0)
+        conn_close(&table, c);
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,574 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * This program reads timeline files recorded by "xprintidle --record" and
+ * prints their samples or statistics about them, and compacts them.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _XOPEN_SOURCE 700
+#define _DEFAULT_SOURCE
+
+#include "format.h"
+#include "timeline.h"
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef XPRINTIDLE_VERSION
+#define XPRINTIDLE_VERSION "n/a"
+#endif
+
+/* A unit suffix of a number given on the command line. */
+struct unit {
+  char c;
+  uint64_t factor;
+};
+
+/* Units of ages and durations given on the command line. */
+static const struct unit ages[] = {{'s', 1000},
+                                   {'m', 60 * 1000},
+                                   {'h', 60 * 60 * 1000},
+                                   {'d', 24 * 60 * 60 * 1000},
+                                   {0, 0}};
+
+/* Names of the series of a timeline, as given by its series blocks. */
+struct series_names {
+  char name[TL_SERIES_MAX][TL_SERIES_NAME_MAX + 1];
+  size_t len[TL_SERIES_MAX];
+};
+
+void print_usage(char *name) {
+  fprintf(stdout,
+          "usage: %s COMMAND FILE [ARGS]\n"
+          "Read a timeline file recorded by xprintidle --record\n"
+          "\n"
+          "Commands:\n"
+          "  dump     Print all samples as CSV (series,time,idle)\n"
+          "  stats    Print the number of blocks and samples and the\n"
+          "           compression ratio compared to CSV\n"
+          "  index    Rebuild the index FILE.idx\n"
+          "  active FROM TO [THRESHOLD]\n"
+          "           Print the active time of every series between FROM\n"
+          "           and TO; the user counts as active while the idle time\n"
+          "           is below the age THRESHOLD (default 1m)\n"
+          "  compact [OPTIONS]\n"
+          "           Merge the blocks of all recording sessions and apply\n"
+          "           the retention options; may run while recording\n"
+          "    --raw-age=AGE        Downsample samples older than AGE\n"
+          "    --resolution=AGE     ... to one per AGE (default 1m)\n"
+          "    --max-age=AGE        Drop samples older than AGE\n"
+          "    --max-size=SIZE      Drop the oldest samples until the\n"
+          "                         file is at most SIZE bytes\n"
+          "\n"
+          "Times are given as milliseconds since the epoch or as local time\n"
+          "in the form 'YYYY-MM-DD HH:MM[:SS]'. Ages are given in milliseconds\n"
+          "or with a unit of s, m, h or d, sizes in bytes or with a unit of\n"
+          "K, M or G.\n"
+          "\n"
+          "Report bugs at: https://github.com/g0hl1n/xprintidle/issues\n",
+          name);
+}
+
+static void set_name(struct series_names *names, const struct tl_block *blk) {
+  size_t len = blk->payload_len;
+
+  if (len > TL_SERIES_NAME_MAX)
+    len = TL_SERIES_NAME_MAX;
+  memcpy(names->name[blk->series], blk->payload, len);
+  names->len[blk->series] = len;
+}
+
+/*
+ * This function prints all samples of the timeline "path" as CSV.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int dump(const char *path) {
+  static struct series_names names;
+  static struct outbuf out;
+  static uint64_t times[TL_BLOCK_SAMPLES_MAX], idles[TL_BLOCK_SAMPLES_MAX];
+  struct tl_reader r;
+  struct tl_block blk;
+  int ret;
+
+  if (tl_reader_open(&r, path) < 0)
+    return -1;
+
+  outbuf_init(&out, STDOUT_FILENO);
+
+  while ((ret = tl_reader_next(&r, &blk)) > 0) {
+    uint32_t i;
+
+    if (blk.series >= TL_SERIES_MAX)
+      continue;
+    if (blk.type == TL_BLOCK_SERIES) {
+      set_name(&names, &blk);
+      continue;
+    }
+    if (blk.type != TL_BLOCK_SAMPLES)
+      continue;
+
+    if (tl_block_decode(&blk, times, idles) < 0) {
+      ret = -1;
+      break;
+    }
+
+    for (i = 0; i < blk.count; i++) {
+      char *p = outbuf_reserve(&out, TL_SERIES_NAME_MAX + 2 * U64_STR_MAX + 3);
+      char *q = p;
+
+      memcpy(q, names.name[blk.series], names.len[blk.series]);
+      q += names.len[blk.series];
+      *q++ = ',';
+      q += format_u64(q, times[i]);
+      *q++ = ',';
+      q += format_u64(q, idles[i]);
+      *q++ = '\n';
+      outbuf_commit(&out, (size_t)(q - p));
+    }
+  }
+
+  if (outbuf_flush(&out) < 0)
+    ret = -1;
+  tl_reader_close(&r);
+
+  if (ret < 0) {
+    fprintf(stderr, "corrupt timeline block in '%s'\n", path);
+    return -1;
+  }
+
+  return 0;
+}
+
+/*
+ * This function prints statistics about the timeline "path".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int stats(const char *path) {
+  static uint64_t times[TL_BLOCK_SAMPLES_MAX], idles[TL_BLOCK_SAMPLES_MAX];
+  uint64_t blocks = 0, samples = 0, csv = 0;
+  struct tl_reader r;
+  struct tl_block blk;
+  char tmp[U64_STR_MAX];
+  int ret;
+
+  if (tl_reader_open(&r, path) < 0)
+    return -1;
+
+  while ((ret = tl_reader_next(&r, &blk)) > 0) {
+    uint32_t i;
+
+    if (blk.type != TL_BLOCK_SAMPLES)
+      continue;
+    if (tl_block_decode(&blk, times, idles) < 0) {
+      ret = -1;
+      break;
+    }
+
+    blocks++;
+    samples += blk.count;
+    for (i = 0; i < blk.count; i++)
+      csv += format_u64(tmp, times[i]) + format_u64(tmp, idles[i]) + 2;
+  }
+
+  if (ret < 0)
+    fprintf(stderr, "corrupt timeline block in '%s'\n", path);
+
+  printf("blocks:  %" PRIu64 "\n"
+         "samples: %" PRIu64 "\n"
+         "bytes:   %zu\n"
+         "csv:     %" PRIu64 "\n"
+         "ratio:   %.1f\n",
+         blocks, samples, r.off, csv, r.off ? (double)csv / (double)r.off : 0);
+
+  tl_reader_close(&r);
+  return ret < 0 ? -1 : 0;
+}
+
+/*
+ * This function parses a time given on the command line and writes it as
+ * milliseconds since the epoch to "ms".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int parse_time(const char *str, uint64_t *ms) {
+  struct tm tm;
+  const char *end;
+  time_t t;
+
+  if (*str && strspn(str, "0123456789") == strlen(str)) {
+    *ms = strtoull(str, NULL, 10);
+    return 0;
+  }
+
+  memset(&tm, 0, sizeof(tm));
+  end = strptime(str, "%Y-%m-%d", &tm);
+  if (end == NULL || (*end != ' ' && *end != 'T'))
+    return -1;
+  str = end + 1;
+  end = strptime(str, "%H:%M:%S", &tm);
+  if (end == NULL)
+    end = strptime(str, "%H:%M", &tm);
+  if (end == NULL || *end)
+    return -1;
+
+  tm.tm_isdst = -1;
+  t = mktime(&tm);
+  if (t == (time_t)-1)
+    return -1;
+
+  *ms = (uint64_t)t * 1000;
+  return 0;
+}
+
+/*
+ * This function parses a number followed by an optional unit from "units"
+ * (pairs of a unit character and its factor) and writes the product to "val".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int parse_scaled(const char *str, const struct unit *units,
+                        uint64_t *val) {
+  char *end;
+
+  if (*str < '0' || *str > '9')
+    return -1;
+  *val = strtoull(str, &end, 10);
+  if (*end == '\0')
+    return 0;
+  for (; units->c; units++) {
+    if (*end == units->c && end[1] == '\0') {
+      *val *= units->factor;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+/*
+ * This function lowers the I/O priority of the process to the idle class, so
+ * a compaction only gets disk time nobody else wants. Kernels or schedulers
+ * without I/O priorities ignore it.
+ */
+static void set_idle_io_priority(void) {
+#ifdef SYS_ioprio_set
+  /* from linux/ioprio.h, which isn't installed everywhere */
+  const int who_process = 1, class_idle = 3, class_shift = 13;
+
+  syscall(SYS_ioprio_set, who_process, 0, class_idle << class_shift);
+#endif
+}
+
+/*
+ * This function compacts the timeline "path" with the retention options in
+ * "argv".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int compact(const char *path, int argc, char *argv[]) {
+  static const struct unit sizes[] = {
+      {'K', 1024}, {'M', 1024 * 1024}, {'G', 1024 * 1024 * 1024}, {0, 0}};
+  static const struct option longopts[] = {
+      {"raw-age", required_argument, NULL, 'r'},
+      {"resolution", required_argument, NULL, 'R'},
+      {"max-age", required_argument, NULL, 'a'},
+      {"max-size", required_argument, NULL, 's'},
+      {0, 0, 0, 0}};
+  struct tl_retention ret = {0, 60 * 1000, 0, 0};
+  uint64_t raw_age = 0, max_age = 0, now;
+  struct timespec ts;
+  struct stat before, after;
+  int c;
+
+  while ((c = getopt_long(argc, argv, "", longopts, NULL)) != -1) {
+    int bad;
+
+    switch (c) {
+    case 'r':
+      bad = parse_scaled(optarg, ages, &raw_age);
+      break;
+    case 'R':
+      bad = parse_scaled(optarg, ages, &ret.resolution);
+      break;
+    case 'a':
+      bad = parse_scaled(optarg, ages, &max_age);
+      break;
+    case 's':
+      bad = parse_scaled(optarg, sizes, &ret.max_size);
+      break;
+    default:
+      return -1;
+    }
+    if (bad) {
+      fprintf(stderr, "invalid argument '%s'\n", optarg);
+      return -1;
+    }
+  }
+  if (optind != argc) {
+    fprintf(stderr, "unexpected argument '%s'\n", argv[optind]);
+    return -1;
+  }
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  now = (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+  if (raw_age && raw_age < now)
+    ret.raw_before = now - raw_age;
+  if (max_age && max_age < now)
+    ret.drop_before = now - max_age;
+
+  set_idle_io_priority();
+
+  if (stat(path, &before) < 0) {
+    fprintf(stderr, "couldn't stat timeline '%s'\n", path);
+    return -1;
+  }
+  if (tl_compact(path, &ret) < 0 || stat(path, &after) < 0)
+    return -1;
+
+  printf("before: %lld\n"
+         "after:  %lld\n",
+         (long long)before.st_size, (long long)after.st_size);
+  return 0;
+}
+
+/* Accumulated activity of one display for the "active" command. */
+struct activity {
+  char name[TL_SERIES_NAME_MAX];
+  size_t len;
+  uint64_t prev;
+  uint64_t active;
+  int seen;
+};
+
+/* The displays of the "active" command, merged by name since recording
+ * sessions may number them differently, and the display of every series of
+ * the current session (-1 if unknown). */
+struct active_displays {
+  size_t n;
+  struct activity act[TL_SERIES_MAX];
+  int map[TL_SERIES_MAX];
+};
+
+/*
+ * This function maps the series of the series block "blk" to the display of
+ * "d" with its name, adding the display if it's new. A block of series 0
+ * starts a recording session, which forgets the series of the previous one.
+ */
+static void map_series(struct active_displays *d, const struct tl_block *blk) {
+  size_t len = blk->payload_len, i;
+
+  if (len > TL_SERIES_NAME_MAX)
+    len = TL_SERIES_NAME_MAX;
+  if (blk->series == 0) {
+    for (i = 0; i < TL_SERIES_MAX; i++)
+      d->map[i] = -1;
+  }
+
+  for (i = 0; i < d->n; i++) {
+    if (d->act[i].len == len && !memcmp(d->act[i].name, blk->payload, len))
+      break;
+  }
+  if (i == d->n) {
+    if (d->n == TL_SERIES_MAX)
+      return;
+    memcpy(d->act[i].name, blk->payload, len);
+    d->act[i].len = len;
+    d->n++;
+  }
+  d->map[blk->series] = (int)i;
+}
+
+/*
+ * This function adds the activity of the samples of "blk" between "from" and
+ * "to" to "act". A sample with an idle time below "threshold" marks the time
+ * since the previous sample of the series (but at most "threshold") as
+ * active. The first sample read has no previous one and marks "threshold",
+ * so a range starting inside a block counts the same as reading from the
+ * start of the timeline.
+ */
+static void add_activity(struct activity *act, const struct tl_block *blk,
+                         const uint64_t *times, const uint64_t *idles,
+                         uint64_t from, uint64_t to, uint64_t threshold) {
+  uint32_t i;
+
+  for (i = 0; i < blk->count; i++) {
+    uint64_t start = times[i] > threshold ? times[i] - threshold : 0;
+    uint64_t end = times[i];
+
+    if (act->seen && act->prev > start && act->prev <= end)
+      start = act->prev;
+    act->prev = times[i];
+    act->seen = 1;
+
+    if (idles[i] >= threshold)
+      continue;
+    if (start < from)
+      start = from;
+    if (end > to)
+      end = to;
+    if (end > start)
+      act->active += end - start;
+  }
+}
+
+/*
+ * This function prints the active time of every series of the timeline
+ * "path" between "from" and "to". It binary searches the index for the first
+ * block ending at or after "from" and only touches the mapped pages of blocks
+ * overlapping the range. Without a usable index the whole timeline is read.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int active(const char *path, uint64_t from, uint64_t to, uint64_t threshold) {
+  static struct active_displays d;
+  static uint64_t times[TL_BLOCK_SAMPLES_MAX], idles[TL_BLOCK_SAMPLES_MAX];
+  struct tl_reader r;
+  struct tl_index idx;
+  struct tl_block blk;
+  size_t start, i;
+  int indexed;
+
+  if (tl_reader_open(&r, path) < 0)
+    return -1;
+  for (i = 0; i < TL_SERIES_MAX; i++)
+    d.map[i] = -1;
+
+  indexed = tl_index_open(&idx, path, r.size) == 0;
+  if (!indexed && tl_index_rebuild(path) == 0)
+    indexed = tl_index_open(&idx, path, r.size) == 0;
+
+  if (!indexed) {
+    /* Corrupt tail, scan everything we can read. */
+    int ret;
+
+    while ((ret = tl_reader_next(&r, &blk)) > 0) {
+      if (blk.series >= TL_SERIES_MAX)
+        continue;
+      if (blk.type == TL_BLOCK_SERIES) {
+        map_series(&d, &blk);
+      } else if (blk.type == TL_BLOCK_SAMPLES && d.map[blk.series] >= 0 &&
+                 blk.t_max >= from && blk.t_min <= to &&
+                 tl_block_decode(&blk, times, idles) == 0) {
+        add_activity(&d.act[d.map[blk.series]], &blk, times, idles, from, to,
+                     threshold);
+      }
+    }
+  } else {
+    struct tl_index_entry e;
+
+    start = tl_index_seek(&idx, from);
+
+    /* The names of the series in use at "start" are defined by the series
+     * blocks of the last recording session started before it. */
+    for (i = start; i-- > 0;) {
+      tl_index_get(&idx, i, &e);
+      if (e.type == TL_BLOCK_SERIES && e.series == 0)
+        break;
+    }
+    for (i = i == (size_t)-1 ? 0 : i; i < start; i++) {
+      tl_index_get(&idx, i, &e);
+      if (e.type == TL_BLOCK_SERIES && e.series < TL_SERIES_MAX &&
+          tl_block_parse(r.data + e.offset, r.size - e.offset, &blk) > 0)
+        map_series(&d, &blk);
+    }
+
+    for (i = start; i < idx.n; i++) {
+      tl_index_get(&idx, i, &e);
+      if (e.series >= TL_SERIES_MAX)
+        continue;
+      /* Entries are ordered by t_max, nothing after this can start before
+       * "to" anymore. */
+      if (e.t_max > to && e.t_max - to > idx.max_span)
+        break;
+      if (e.type == TL_BLOCK_SAMPLES && (e.t_min > to || e.t_max < from))
+        continue;
+      if (tl_block_parse(r.data + e.offset, r.size - e.offset, &blk) < 0)
+        continue;
+      if (blk.type == TL_BLOCK_SERIES) {
+        map_series(&d, &blk);
+      } else if (d.map[blk.series] >= 0 &&
+                 tl_block_decode(&blk, times, idles) == 0) {
+        add_activity(&d.act[d.map[blk.series]], &blk, times, idles, from, to,
+                     threshold);
+      }
+    }
+    tl_index_close(&idx);
+  }
+
+  for (i = 0; i < d.n; i++) {
+    char human[HUMAN_TIME_MAX + 1];
+
+    if (!d.act[i].seen)
+      continue;
+    human[format_human_time(human, d.act[i].active)] = '\0';
+    printf("%.*s: %" PRIu64 " active minutes (%s)\n", (int)d.act[i].len,
+           d.act[i].name, d.act[i].active / 60000, human);
+  }
+
+  tl_reader_close(&r);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc == 2 &&
+      (!strcmp(argv[1], "-v") || !strcmp(argv[1], "--version"))) {
+    fprintf(stdout, "xprintidle-timeline %s\n", XPRINTIDLE_VERSION);
+    return EXIT_SUCCESS;
+  }
+
+  if (argc >= 5 && !strcmp(argv[1], "active")) {
+    uint64_t from, to, threshold = 60000;
+
+    if (parse_time(argv[3], &from) < 0 || parse_time(argv[4], &to) < 0 ||
+        argc > 6) {
+      fprintf(stderr, "invalid time range\n");
+      return EXIT_FAILURE;
+    }
+    if (argc == 6 && parse_scaled(argv[5], ages, &threshold) < 0) {
+      fprintf(stderr, "invalid threshold '%s'\n", argv[5]);
+      return EXIT_FAILURE;
+    }
+    return active(argv[2], from, to, threshold) < 0 ? EXIT_FAILURE
+                                                    : EXIT_SUCCESS;
+  }
+
+  if (argc >= 3 && !strcmp(argv[1], "compact"))
+    return compact(argv[2], argc - 2, argv + 2) < 0 ? EXIT_FAILURE
+                                                    : EXIT_SUCCESS;
+
+  if (argc != 3) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (!strcmp(argv[1], "dump"))
+    return dump(argv[2]) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+  if (!strcmp(argv[1], "stats"))
+    return stats(argv[2]) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+  if (!strcmp(argv[1], "index"))
+    return tl_index_rebuild(argv[2]) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+  print_usage(argv[0]);
+  return EXIT_FAILURE;
+}
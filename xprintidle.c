@@ -29,20 +29,31 @@
  * the GNU GPL, version 2 _only_.
  */
 
-#include <X11/Xlib.h>
-#include <X11/extensions/dpms.h>
-#include <X11/extensions/scrnsaver.h>
+#define _POSIX_C_SOURCE 200809L
+
+#include "format.h"
+#include "inhibit.h"
+#include "journald.h"
+#include "watch.h"
+#include "xext.h"
+#include "xprintidle.h"
+
+#include <X11/extensions/dpmsconst.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #ifndef XPRINTIDLE_VERSION
 #define XPRINTIDLE_VERSION "n/a"
 #endif
 
-unsigned long workaroundCreepyXServer(Display *dpy, unsigned long idleTime);
-
+/* The usage of options which are left out of some builds (see
+ * meson_options.txt) is printed separately. */
 void print_usage(char *name) {
   fprintf(stdout,
           "usage: %s [OPTION]\n"
@@ -52,11 +63,92 @@ void print_usage(char *name) {
           "  -h, --help              Show this text\n"
           "  -H, --human-readable    Output the time in a human readable format\n"
           "  -v, --version           Print the program version\n"
-          "\n"
-          "Report bugs at: https://github.com/g0hl1n/xprintidle/issues\n"
-          "Written by Magnus Henoch and others; see\n"
-          "https://github.com/g0hl1n/xprintidle/blob/master/AUTHORS\n",
+          "  -d, --display=NAME      Query display NAME instead of $DISPLAY;\n"
+          "                          may be given several times\n"
+          "  -w, --watch=MS          Print the idle time every MS milliseconds\n"
+          "      --format=FORMAT     Output format: 'plain' (the default),\n"
+          "                          'human' (same as -H) or 'ndjson'\n",
           name);
+#ifndef XPRINTIDLE_NO_RECORD
+  fputs("      --record=FILE       Also record the samples to the timeline\n"
+        "                          FILE (see xprintidle-timeline)\n"
+        "      --commit-records=N  Sync the journal of the timeline after N\n"
+        "                          samples (default 64, 0 disables it)\n"
+        "      --commit-interval=MS\n"
+        "                          Sync the journal at least every MS\n"
+        "                          milliseconds (default 1000)\n",
+        stdout);
+#endif
+#ifndef XPRINTIDLE_NO_PUBLISH
+  fputs("      --publish=FILE      Publish the latest idle times in the\n"
+        "                          shared memory segment FILE\n",
+        stdout);
+#endif
+  fputs("      --batch=SINK:N[:MS] Write to SINK once N samples are pending,\n"
+        "                          or MS milliseconds after the oldest one\n"
+        "                          (default 1); SINK: 'stdout'",
+        stdout);
+#ifndef XPRINTIDLE_NO_SEND
+  fputs(", 'send'", stdout);
+#endif
+#ifndef XPRINTIDLE_NO_JOURNALD
+  fputs(", 'journal'", stdout);
+#endif
+  fputs("\n", stdout);
+  fputs("      --threshold=MS      Idle time from which on the user counts\n"
+        "                          as idle (default 60000)\n"
+        "      --activity=MS       Also print which fraction of the last MS\n"
+        "                          milliseconds the user was active\n",
+        stdout);
+#ifndef XPRINTIDLE_NO_LISTEN
+  fputs("      --listen=SOCKET     Push the samples to subscribers of the\n"
+        "                          unix socket SOCKET\n",
+        stdout);
+#endif
+#ifndef XPRINTIDLE_NO_SEND
+  fputs("      --send=HOST[:PORT]  Send the samples to the collector at\n"
+        "                          HOST (see xprintidle-collector)\n",
+        stdout);
+#endif
+#ifndef XPRINTIDLE_NO_JOURNALD
+  fputs("      --journal[=SOCKET]  Write the samples to the journald socket\n"
+        "                          SOCKET (default " JOURNALD_SOCKET ")\n",
+        stdout);
+#endif
+#ifndef XPRINTIDLE_NO_APPS
+  fputs("      --apps              Account the active time per application\n"
+        "                          and print it on SIGUSR1 and at the end\n"
+        "      --fullscreen        Also print whether the active window is\n"
+        "                          fullscreen\n",
+        stdout);
+#endif
+#ifndef XPRINTIDLE_NO_XI2
+  fputs("      --input             Count keystrokes, clicks and pointer\n"
+        "                          motion per minute\n",
+        stdout);
+#endif
+#ifndef XPRINTIDLE_NO_INHIBIT
+  fputs("      --inhibit[=dpms] -- CMD\n"
+        "                          Suspend the screen saver (and with\n"
+        "                          'dpms' disable DPMS) while CMD runs\n",
+        stdout);
+#endif
+#ifndef XPRINTIDLE_NO_PROBE_CACHE
+  fputs("      --probe-cache       Cache the extensions of the X server in\n"
+        "                          $XDG_RUNTIME_DIR for later runs\n",
+        stdout);
+#endif
+  fputs("      --format-stdin[=TYPE]\n"
+        "                          Read millisecond values from stdin and\n"
+        "                          print them in a human readable format;\n"
+        "                          TYPE is 'text' (one value per line, the\n"
+        "                          default) or 'binary' (64 bit little\n"
+        "                          endian records)\n"
+        "\n"
+        "Report bugs at: https://github.com/g0hl1n/xprintidle/issues\n"
+        "Written by Magnus Henoch and others; see\n"
+        "https://github.com/g0hl1n/xprintidle/blob/master/AUTHORS\n",
+        stdout);
 }
 
 void print_version(void) {
@@ -64,123 +156,574 @@ void print_version(void) {
 }
 
 /*
- * This function gets the X idle time in milliseconds and writes it to the
- * "idle" argument.
+ * This function adds the DPMS timeouts which have passed in the power level
+ * "state" to the idle time "idleTime" and returns the result (see
+ * workaroundCreepyXServer()).
+ */
+static unsigned long add_dpms_time(unsigned long idleTime, CARD16 standby,
+                                   CARD16 suspend, CARD16 off, CARD16 state) {
+  switch (state) {
+  case DPMSModeStandby:
+    /* this check is a little bit paranoid, but be sure */
+    if (idleTime < (unsigned)(standby * 1000))
+      idleTime += (standby * 1000);
+    break;
+  case DPMSModeSuspend:
+    if (idleTime < (unsigned)((suspend + standby) * 1000))
+      idleTime += ((suspend + standby) * 1000);
+    break;
+  case DPMSModeOff:
+    if (idleTime < (unsigned)((off + suspend + standby) * 1000))
+      idleTime += ((off + suspend + standby) * 1000);
+    break;
+  case DPMSModeOn:
+  default:
+    break;
+  }
+
+  return idleTime;
+}
+
+/*
+ * This function opens the X display "name" (or $DISPLAY if "name" is NULL),
+ * checks for the screen saver extension and prepares "d" for querying the
+ * idle time with idle_display_query(). If "cache" is set, the extensions are
+ * looked up in the probe cache (see probe.h) and only probed on a miss.
  * On success 0 is returned.
  * On error -1 is returned.
  */
-int get_x_idletime(uint64_t *idle) {
-  XScreenSaverInfo *ssi;
-  Display *dpy;
-  int event_basep, error_basep, vendrel;
-
-  dpy = XOpenDisplay(NULL);
-  if (dpy == NULL) {
-    fprintf(stderr, "couldn't open display\n");
+int idle_display_open(struct idle_display *d, const char *name, int cache) {
+  int event_basep, error_basep;
+
+  if (!cache && xext_load_screensaver() < 0)
     return -1;
+
+  d->dpy = XOpenDisplay(name);
+  if (d->dpy == NULL) {
+    if (name)
+      fprintf(stderr, "couldn't open display '%s'\n", name);
+    else
+      fprintf(stderr, "couldn't open display\n");
+    return -1;
+  }
+  d->name = XDisplayString(d->dpy);
+  d->ssi = NULL;
+  d->dpms = 0;
+  d->probe.screensaver = 0;
+
+#ifdef XPRINTIDLE_NO_DPMS
+  d->creepy = 0;
+#else
+  /* xorg fixed the reset of the idle time in some (unknown) release. We now it
+   * is fixed in v1.20.00, therefore don't do the workaround for this version.
+   * If anybody finds the commit and therefore xorg release which fixes this
+   * issue please send a patch or raise an issue ;-) */
+  d->creepy = VendorRelease(d->dpy) < 12000000;
+#endif
+
+  if (cache) {
+    if (probe_load(d->dpy, &d->probe) == 0 &&
+        (!d->creepy || d->probe.dpms != PROBE_DPMS_UNKNOWN))
+      return 0;
+    if (probe_run(d->dpy, &d->probe, d->creepy) < 0) {
+      fprintf(stderr, "screen saver extension not supported\n");
+      XCloseDisplay(d->dpy);
+      return -1;
+    }
+    probe_store(d->dpy, &d->probe);
+    return 0;
   }
 
-  if (!XScreenSaverQueryExtension(dpy, &event_basep, &error_basep)) {
+  if (!XScreenSaverQueryExtension(d->dpy, &event_basep, &error_basep)) {
     fprintf(stderr, "screen saver extension not supported\n");
-    XCloseDisplay(dpy);
+    XCloseDisplay(d->dpy);
     return -1;
   }
 
-  ssi = XScreenSaverAllocInfo();
-  if (ssi == NULL) {
+  d->ssi = XScreenSaverAllocInfo();
+  if (d->ssi == NULL) {
     fprintf(stderr, "couldn't allocate screen saver info\n");
-    XCloseDisplay(dpy);
+    XCloseDisplay(d->dpy);
     return -1;
   }
 
-  if (!XScreenSaverQueryInfo(dpy, DefaultRootWindow(dpy), ssi)) {
+  return 0;
+}
+
+/*
+ * This function gets the X idle time of the display "d" opened with the
+ * probe cache. If the requests fail with cached opcodes, the server is
+ * probed again and the query repeated.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int query_probed(struct idle_display *d, uint64_t *idle) {
+  CARD16 standby, suspend, off, state;
+  BOOL onoff;
+  int dpms;
+
+  for (;;) {
+    if (probe_query_idle(d->dpy, &d->probe, idle) == 0) {
+      if (!d->creepy || d->probe.dpms <= 0)
+        return 0;
+      dpms = probe_query_dpms(d->dpy, &d->probe, &standby, &suspend, &off,
+                              &state, &onoff);
+      if (dpms == 0) {
+        if (onoff)
+          *idle = add_dpms_time(*idle, standby, suspend, off, state);
+        return 0;
+      }
+    }
+
+    if (!d->probe.cached || probe_run(d->dpy, &d->probe, d->creepy) < 0) {
+      fprintf(stderr, "couldn't query screen saver info\n");
+      return -1;
+    }
+    probe_store(d->dpy, &d->probe);
+  }
+}
+
+/*
+ * This function gets the X idle time of the display "d" in milliseconds and
+ * writes it to the "idle" argument.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int idle_display_query(struct idle_display *d, uint64_t *idle) {
+  if (d->probe.screensaver)
+    return query_probed(d, idle);
+
+  if (!XScreenSaverQueryInfo(d->dpy, DefaultRootWindow(d->dpy), d->ssi)) {
     fprintf(stderr, "couldn't query screen saver info\n");
-    XFree(ssi);
-    XCloseDisplay(dpy);
     return -1;
   }
 
-  /* xorg fixed the reset of the idle time in some (unknown) release. We now it
-   * is fixed in v1.20.00, therefore don't do the workaround for this version.
-   * If anybody finds the commit and therefore xorg release which fixes this
-   * issue please send a patch or raise an issue ;-) */
-  vendrel = VendorRelease(dpy);
-  if (vendrel < 12000000) {
-    *idle = workaroundCreepyXServer(dpy, ssi->idle);
+  if (d->creepy) {
+    *idle = workaroundCreepyXServer(d->dpy, d->ssi->idle);
   } else {
-    *idle = ssi->idle;
+    *idle = d->ssi->idle;
   }
 
-  XFree(ssi);
-  XCloseDisplay(dpy);
-
   return 0;
 }
 
+void idle_display_close(struct idle_display *d) {
+  if (d->ssi)
+    XFree(d->ssi);
+  XCloseDisplay(d->dpy);
+}
+
+/*
+ * This function gets the X idle time of the display "name" in milliseconds
+ * and writes it to the "idle" argument, using the probe cache if "cache" is
+ * set.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int get_x_idletime(const char *name, uint64_t *idle, int cache) {
+  struct idle_display d;
+  int ret;
+
+  if (idle_display_open(&d, name, cache) < 0)
+    return -1;
+
+  ret = idle_display_query(&d, idle);
+  idle_display_close(&d);
+
+  return ret;
+}
+
 /* This function prints miliseconds in a human-readable format. */
 void print_human_time(uint64_t time) {
-  /* The C standard says that integer division round towards 0. */
+  char buf[HUMAN_TIME_MAX + 1];
+  size_t len = format_human_time(buf, time);
 
-  int convFacs[] = {24 * 60 * 60 * 1000, 60 * 60 * 1000, 60 * 1000, 1000, 1};
-  char *names[] = {"day", "hour", "minute", "second", "millisecond"};
-  size_t units = sizeof(convFacs) / sizeof(int);
+  buf[len++] = '\n';
+  fwrite(buf, 1, len, stdout);
+}
 
-  int firstPrint = 1;
-  size_t i;
-  for (i = 0; i < units; i++) {
-    int unitMag = time / convFacs[i];
-    time %= convFacs[i];
+/*
+ * This function writes one value of the stdin filter in a human-readable
+ * format to "out".
+ */
+static inline void filter_emit(struct outbuf *out, uint64_t time) {
+  char *p = outbuf_reserve(out, HUMAN_TIME_MAX + 1);
+  size_t len = format_human_time(p, time);
 
-    if (!unitMag)
+  p[len++] = '\n';
+  outbuf_commit(out, len);
+}
+
+/*
+ * This function reads millisecond values from stdin and writes them in a
+ * human-readable format to stdout. If "binary" is zero, the input consists of
+ * decimal values separated by newlines. Otherwise it consists of 64 bit little
+ * endian records.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int format_stdin(int binary) {
+  static unsigned char in[OUTBUF_SIZE];
+  static struct outbuf out;
+  unsigned long line = 1;
+  uint64_t value = 0;
+  /* 0 before the number of a line, 1 within it, 2 after it */
+  int digits = 0;
+  size_t partial = 0;
+  ssize_t ret;
+
+  outbuf_init(&out, STDOUT_FILENO);
+
+  for (;;) {
+    unsigned char *p, *end;
+
+    ret = read(STDIN_FILENO, in + partial, sizeof(in) - partial);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      fprintf(stderr, "couldn't read stdin: %s\n", strerror(errno));
+      return -1;
+    }
+    if (ret == 0)
+      break;
+
+    p = in;
+    end = in + partial + (size_t)ret;
+
+    if (binary) {
+      for (; end - p >= 8; p += 8) {
+        filter_emit(&out, (uint64_t)p[0] | (uint64_t)p[1] << 8 |
+                              (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 |
+                              (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 |
+                              (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56);
+      }
+      partial = (size_t)(end - p);
+      memmove(in, p, partial);
       continue;
+    }
 
-    if (!firstPrint)
-      printf(", ");
-    printf("%d %s", unitMag, names[i]);
-    if (unitMag != 1)
-      printf("s");
+    for (; p < end; p++) {
+      unsigned digit = (unsigned)*p - '0';
+
+      if (digit < 10) {
+        if (digits == 2) {
+          fprintf(stderr, "invalid value on line %lu\n", line);
+          return -1;
+        }
+        if (value > (UINT64_MAX - digit) / 10) {
+          fprintf(stderr, "value out of range on line %lu\n", line);
+          return -1;
+        }
+        value = value * 10 + digit;
+        digits = 1;
+      } else if (*p == '\n') {
+        if (digits)
+          filter_emit(&out, value);
+        value = 0;
+        digits = 0;
+        line++;
+      } else if (*p == ' ' || *p == '\t' || *p == '\r') {
+        if (digits)
+          digits = 2;
+      } else {
+        fprintf(stderr, "invalid value on line %lu\n", line);
+        return -1;
+      }
+    }
+  }
+
+  if (partial) {
+    fprintf(stderr, "truncated record at end of input\n");
+    return -1;
+  }
+  if (digits)
+    filter_emit(&out, value);
 
-    firstPrint = 0;
+  if (outbuf_flush(&out) < 0) {
+    fprintf(stderr, "couldn't write stdout: %s\n", strerror(out.error));
+    return -1;
   }
 
-  /* Smallest unit would be 0. */
-  if (firstPrint)
-    printf("0 %ss", names[units - 1]);
+  return 0;
+}
+
+/*
+ * This function parses a non-negative decimal number and writes it to the
+ * "val" argument.
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+int parse_u64(const char *str, uint64_t *val) {
+  unsigned long long ull;
+  char *end;
+
+  if (*str < '0' || *str > '9')
+    return -1;
+
+  errno = 0;
+  ull = strtoull(str, &end, 10);
+  if (errno || *end != '\0')
+    return -1;
+
+  *val = ull;
+  return 0;
+}
+
+/*
+ * This function parses the argument "SINK:RECORDS[:MS]" of --batch into the
+ * batch settings of the sink SINK in "opts".
+ * On success 0 is returned.
+ * On error -1 is returned.
+ */
+static int parse_batch(const char *arg, struct watch_options *opts) {
+  char buf[64], *records, *ms;
+  struct sink_batch *batch, parsed = {0, 0};
+  uint64_t val;
+
+  if (strlen(arg) >= sizeof(buf))
+    return -1;
+  strcpy(buf, arg);
+  records = strchr(buf, ':');
+  if (records == NULL)
+    return -1;
+  *records++ = '\0';
+  ms = strchr(records, ':');
+  if (ms)
+    *ms++ = '\0';
+
+  if (!strcmp(buf, "stdout"))
+    batch = &opts->batch;
+#ifndef XPRINTIDLE_NO_SEND
+  else if (!strcmp(buf, "send"))
+    batch = &opts->send_batch;
+#endif
+#ifndef XPRINTIDLE_NO_JOURNALD
+  else if (!strcmp(buf, "journal"))
+    batch = &opts->journal_batch;
+#endif
+  else
+    return -1;
 
-  printf("\n");
+  if (parse_u64(records, &val) < 0 ||
+      (ms && parse_u64(ms, &parsed.interval) < 0))
+    return -1;
+  parsed.records = (size_t)val;
+  *batch = parsed;
+  return 0;
 }
 
 int main(int argc, char *argv[]) {
-  uint64_t idle;
-  int human = 0;
+  static const struct option long_options[] = {
+      {"help", no_argument, NULL, 'h'},
+      {"human-readable", no_argument, NULL, 'H'},
+      {"version", no_argument, NULL, 'v'},
+      {"display", required_argument, NULL, 'd'},
+      {"watch", required_argument, NULL, 'w'},
+      {"format", required_argument, NULL, 'f'},
+#ifndef XPRINTIDLE_NO_RECORD
+      {"record", required_argument, NULL, 'R'},
+      {"commit-records", required_argument, NULL, 'C'},
+      {"commit-interval", required_argument, NULL, 'I'},
+#endif
+#ifndef XPRINTIDLE_NO_PUBLISH
+      {"publish", required_argument, NULL, 'P'},
+#endif
+      {"batch", required_argument, NULL, 'b'},
+      {"threshold", required_argument, NULL, 't'},
+      {"activity", required_argument, NULL, 'a'},
+#ifndef XPRINTIDLE_NO_LISTEN
+      {"listen", required_argument, NULL, 'L'},
+#endif
+#ifndef XPRINTIDLE_NO_SEND
+      {"send", required_argument, NULL, 'S'},
+#endif
+#ifndef XPRINTIDLE_NO_JOURNALD
+      {"journal", optional_argument, NULL, 'j'},
+#endif
+#ifndef XPRINTIDLE_NO_APPS
+      {"apps", no_argument, NULL, 'A'},
+      {"fullscreen", no_argument, NULL, 'U'},
+#endif
+#ifndef XPRINTIDLE_NO_XI2
+      {"input", no_argument, NULL, 'k'},
+#endif
+#ifndef XPRINTIDLE_NO_PROBE_CACHE
+      {"probe-cache", no_argument, NULL, 'c'},
+#endif
+#ifndef XPRINTIDLE_NO_INHIBIT
+      {"inhibit", optional_argument, NULL, 'i'},
+#endif
+      {"format-stdin", optional_argument, NULL, 'F'},
+      {NULL, 0, NULL, 0},
+  };
+  struct watch_options wopts = {
+      .format = FORMAT_PLAIN,
+      .commit = {64, 1000},
+      .threshold = 60000,
+      .batch = {1, 0},
+      .send_batch = {1, 0},
+      .journal_batch = {1, 0},
+  };
+  uint64_t idle, val;
+  int watch = 0, cache = 0, inhibit = 0;
+  int filter = 0, filter_binary = 0;
+  int opt, ret;
+
+  wopts.displays = calloc((size_t)argc, sizeof(*wopts.displays));
+  if (wopts.displays == NULL) {
+    fprintf(stderr, "couldn't allocate display list\n");
+    return EXIT_FAILURE;
+  }
 
-  /* TODO change this to getopts as soon as we have more options */
-  if (argc != 1) {
-    if (!strcmp(argv[1], "-v") || !strcmp(argv[1], "--version")) {
+  while ((opt = getopt_long(argc, argv, "hHvd:w:", long_options, NULL)) !=
+         -1) {
+    switch (opt) {
+    case 'v':
       print_version();
       return EXIT_SUCCESS;
-    } else if (!strcmp(argv[1], "-H") || !strcmp(argv[1], "--human-readable")) {
-      human = 1;
-    } else if (!strcmp(argv[1], "-h") || !strcmp(argv[1], "--help")) {
+    case 'H':
+      wopts.format = FORMAT_HUMAN;
+      break;
+    case 'd':
+      wopts.displays[wopts.n_displays++] = optarg;
+      break;
+    case 'w':
+      if (parse_u64(optarg, &wopts.interval) < 0 || wopts.interval == 0) {
+        fprintf(stderr, "invalid watch interval '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      watch = 1;
+      break;
+    case 'f':
+      if (parse_output_format(optarg, &wopts.format) < 0) {
+        fprintf(stderr, "unknown output format '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'R':
+      wopts.record = optarg;
+      break;
+    case 'C':
+      if (parse_u64(optarg, &val) < 0) {
+        fprintf(stderr, "invalid number of records '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      wopts.commit.records = (size_t)val;
+      break;
+    case 'I':
+      if (parse_u64(optarg, &wopts.commit.interval) < 0) {
+        fprintf(stderr, "invalid commit interval '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'P':
+      wopts.publish = optarg;
+      break;
+    case 'b':
+      if (parse_batch(optarg, &wopts) < 0) {
+        fprintf(stderr, "invalid batch settings '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'L':
+      wopts.listen = optarg;
+      break;
+    case 'S':
+      wopts.send = optarg;
+      break;
+    case 'j':
+      wopts.journal = optarg ? optarg : JOURNALD_SOCKET;
+      break;
+    case 'A':
+      wopts.apps = 1;
+      break;
+    case 'U':
+      wopts.fullscreen = 1;
+      break;
+    case 'k':
+      wopts.input = 1;
+      break;
+    case 'c':
+      cache = 1;
+      break;
+    case 'i':
+      if (optarg == NULL) {
+        inhibit = 1;
+      } else if (!strcmp(optarg, "dpms")) {
+        inhibit = 2;
+      } else {
+        fprintf(stderr, "unknown inhibit mode '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 't':
+      if (parse_u64(optarg, &wopts.threshold) < 0) {
+        fprintf(stderr, "invalid threshold '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'a':
+      if (parse_u64(optarg, &wopts.activity) < 0 || wopts.activity == 0) {
+        fprintf(stderr, "invalid activity window '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'F':
+      filter = 1;
+      if (optarg == NULL || !strcmp(optarg, "text")) {
+        filter_binary = 0;
+      } else if (!strcmp(optarg, "binary")) {
+        filter_binary = 1;
+      } else {
+        fprintf(stderr, "unknown input type '%s'\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+    case 'h':
+    default:
       print_usage(argv[0]);
       return EXIT_FAILURE;
     }
+  }
+
+  if (filter)
+    return format_stdin(filter_binary) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+  if (inhibit) {
+    if (optind == argc || wopts.n_displays > 1) {
+      fprintf(stderr, "--inhibit needs one display and a command\n");
+      return EXIT_FAILURE;
+    }
+    ret = inhibit_run(wopts.n_displays ? wopts.displays[0] : NULL,
+                      argv + optind, inhibit == 2);
+    return ret < 0 ? EXIT_FAILURE : ret;
+  }
 
+  /* Everything but a single plain or human-readable value goes through the
+   * record writer of the watch mode. */
+  if (watch || wopts.n_displays > 1 || wopts.format == FORMAT_NDJSON ||
+      wopts.record || wopts.publish || wopts.listen || wopts.send ||
+      wopts.journal || wopts.apps || wopts.fullscreen || wopts.activity ||
+      wopts.input) {
+    ret = watch_run(&wopts);
+    return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
   }
 
-  if (get_x_idletime(&idle) < 0) {
+  if (get_x_idletime(wopts.n_displays ? wopts.displays[0] : NULL, &idle,
+                     cache) < 0) {
     return EXIT_FAILURE;
   }
 
-  if (human) {
+  if (wopts.format == FORMAT_HUMAN) {
     print_human_time(idle);
     return EXIT_SUCCESS;
   }
 
-  printf("%llu\n", idle);
+  printf("%" PRIu64 "\n", idle);
   return EXIT_SUCCESS;
 }
 
+#ifndef XPRINTIDLE_NO_DPMS
 /*
  * This function works around an XServer idleTime bug in the
  * XScreenSaverExtension if dpms is running. In this case the current
@@ -200,6 +743,8 @@ unsigned long workaroundCreepyXServer(Display *dpy, unsigned long idleTime) {
   CARD16 state;
   BOOL onoff;
 
+  if (xext_load_dpms() < 0)
+    return idleTime;
   if (!DPMSQueryExtension(dpy, &dummy, &dummy))
     return idleTime;
   else if (!DPMSCapable(dpy))
@@ -211,24 +756,31 @@ unsigned long workaroundCreepyXServer(Display *dpy, unsigned long idleTime) {
   if (!onoff)
     return idleTime;
 
-  switch (state) {
-  case DPMSModeStandby:
-    /* this check is a little bit paranoid, but be sure */
-    if (idleTime < (unsigned)(standby * 1000))
-      idleTime += (standby * 1000);
-    break;
-  case DPMSModeSuspend:
-    if (idleTime < (unsigned)((suspend + standby) * 1000))
-      idleTime += ((suspend + standby) * 1000);
-    break;
-  case DPMSModeOff:
-    if (idleTime < (unsigned)((off + suspend + standby) * 1000))
-      idleTime += ((off + suspend + standby) * 1000);
-    break;
-  case DPMSModeOn:
-  default:
-    break;
+  return add_dpms_time(idleTime, standby, suspend, off, state);
+}
+
+/*
+ * This function gets the DPMS power level of the display "d" (DPMSModeOn to
+ * DPMSModeOff) and writes it to the "level" argument, -1 if DPMS is disabled.
+ * Whether the server supports DPMS is only checked once.
+ * On success 0 is returned.
+ * On error (DPMS not supported) -1 is returned.
+ */
+int idle_display_query_dpms(struct idle_display *d, int *level) {
+  int dummy;
+  CARD16 state;
+  BOOL onoff;
+
+  if (d->dpms == 0) {
+    d->dpms = -1;
+    if (xext_load_dpms() == 0 && DPMSQueryExtension(d->dpy, &dummy, &dummy) &&
+        DPMSCapable(d->dpy))
+      d->dpms = 1;
   }
+  if (d->dpms < 0 || !DPMSInfo(d->dpy, &state, &onoff))
+    return -1;
 
-  return idleTime;
+  *level = onoff ? state : -1;
+  return 0;
 }
+#endif /* XPRINTIDLE_NO_DPMS */
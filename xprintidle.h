@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: GPL-2.0-only
+ *
+ * Access to the idle time of an X display, shared by the different modes of
+ * xprintidle.
+ *
+ * This file is part of xprintidle.
+ *
+ * xprintidle is free software; you can redistribute it and/or modify it under
+ * the terms of version 2 of the GNU General Public License as published by the
+ * Free Software Foundation.
+ *
+ * xprintidle is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * xprintidle. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef XPRINTIDLE_H
+#define XPRINTIDLE_H
+
+#include "probe.h"
+
+#include <X11/Xlib.h>
+#include <X11/extensions/scrnsaver.h>
+#include <stdint.h>
+
+/* An open connection to an X display which supports the screen saver
+ * extension. */
+struct idle_display {
+  Display *dpy;
+  XScreenSaverInfo *ssi;
+  const char *name;
+  int creepy;
+  /* DPMS for idle_display_query_dpms(): 0 unchecked, 1 usable, -1 not */
+  int dpms;
+  /* extensions found by the probe cache; "screensaver" is 0 without it */
+  struct probe probe;
+};
+
+int idle_display_open(struct idle_display *d, const char *name, int cache);
+int idle_display_query(struct idle_display *d, uint64_t *idle);
+void idle_display_close(struct idle_display *d);
+
+#ifdef XPRINTIDLE_NO_DPMS
+/* Built without the "dpms" feature, the workaround is never needed. */
+static inline unsigned long workaroundCreepyXServer(Display *dpy,
+                                                    unsigned long idleTime) {
+  (void)dpy;
+  return idleTime;
+}
+static inline int idle_display_query_dpms(struct idle_display *d,
+                                          int *level) {
+  (void)d;
+  (void)level;
+  return -1;
+}
+#else
+unsigned long workaroundCreepyXServer(Display *dpy, unsigned long idleTime);
+int idle_display_query_dpms(struct idle_display *d, int *level);
+#endif
+
+#endif /* XPRINTIDLE_H */